@@ -4,16 +4,36 @@
 
 #include "MOX_AEIO_Dialogs.h"
 
+#include "MOX_ReadAhead.h"
+#include "MOX_AudioAhead.h"
+#include "MOX_FrameCache.h"
+#include "MOX_Platform.h"
+#include "MOX_Downsample.h"
+#include "MOX_StreamPool.h"
+#include "MOX_IndexCache.h"
+#include "MOX_Probe.h"
+#include "MOX_FrameInfo.h"
+#include "MOX_Memory.h"
+#include "MOX_Bytes.h"
+#include "MOX_Threads.h"
+#include "MOX_Proxy.h"
+#include "MOX_EncodeQueue.h"
+#include "MOX_BufferPool.h"
+#include "MOX_WriteBehind.h"
+#include "MOX_BackgroundWriter.h"
+
 #include <MoxFiles/InputFile.h>
 #include <MoxFiles/OutputFile.h>
 #include <MoxFiles/Thread.h>
 #include <MoxMxf/PlatformIOStream.h>
 
 #include <map>
+#include <list>
+#include <vector>
 #include <sstream>
+#include <algorithm>
 
 #include <assert.h>
-#include <time.h>
 //#include <sys/timeb.h>
 
 #ifdef MAC_ENV
@@ -48,159 +68,1628 @@ class ErrThrower : public std::exception
 
 
 
-class AEInputFile
+class AEStreamSource : public MoxStreamSource
+{
+  public:
+	AEStreamSource(const A_PathType *path) : _path(path) {}
+	virtual ~AEStreamSource() {}
+	
+	virtual MoxMxf::IOStream * openStream() const { return new PlatformIOStream(_path, PlatformIOStream::ReadOnly); }
+	
+  private:
+	const A_PathType *_path; // owned by AEInputFile
+};
+
+
+static MoxReadAhead::Settings gReadAheadSettings;
+
+static MoxAudioAhead::Settings gAudioAheadSettings;
+
+static MoxEncodeQueue::Settings gEncodeQueueSettings;
+
+static MoxWriteBehindStream::Settings gWriteBehindSettings;
+static bool gWriteBehind = true;
+
+static MoxFrameCache g_frame_cache;
+
+static MoxStreamPool g_stream_pool;
+
+static MoxIndexCache g_index_cache;
+
+
+static int gReadersPerFile = 4;
+
+// write a quarter-size proxy next to each movie we export
+static bool gWriteProxies = false;
+
+// When everything we're holding goes over the high-water mark, trim to the target
+static size_t gMemoryHighWater = 0;
+static size_t gMemoryTarget = 0;
+
+
+static MoxMxf::UInt64
+HeaderFingerprint(const MoxFiles::Header &head)
+{
+	// Everything about the file except its duration,
+	// so we can tell when frames were just added on.
+	MoxByteWriter writer;
+	
+	writer.putInt(head.width(), 4);
+	writer.putInt(head.height(), 4);
+	writer.putInt(head.frameRate().Numerator, 4);
+	writer.putInt(head.frameRate().Denominator, 4);
+	writer.putInt(head.pixelAspectRatio().Numerator, 4);
+	writer.putInt(head.pixelAspectRatio().Denominator, 4);
+	writer.putInt(head.sampleRate().Numerator, 4);
+	writer.putInt(head.sampleRate().Denominator, 4);
+	
+	const MoxFiles::ChannelList &channels = head.channels();
+	
+	for(MoxFiles::ChannelList::ConstIterator i = channels.begin(); i != channels.end(); ++i)
+	{
+		writer.putBytes(std::string(i.name()) + '\0');
+		writer.putInt(i.channel().type, 4);
+	}
+	
+	const MoxFiles::AudioChannelList &audio_channels = head.audioChannels();
+	
+	for(MoxFiles::AudioChannelList::ConstIterator i = audio_channels.begin(); i != audio_channels.end(); ++i)
+	{
+		writer.putBytes(std::string(i.name()) + '\0');
+		writer.putInt(i.channel().type, 4);
+	}
+	
+	return MoxChecksum(writer.data().data(), writer.size());
+}
+
+
+class AEInputFile
+{
+  public:
+	AEInputFile(const A_PathType *file_pathZ);
+	~AEInputFile();
+	
+	enum Change
+	{
+		UNCHANGED,
+		APPENDED,	// frames were added, the old ones are still good
+		REPLACED	// written over, only frames with matching hashes are still good
+	};
+	
+	// Check the file on disk and reload if it's been changed.
+	Change synch();
+	
+	// goes up every time synch() reloads
+	unsigned int generation() const { return _generation; }
+	
+	// The last frame AE drew, so idle time can warm it back up.  A factor of 0
+	// means it wasn't drawn at full size or with our own box filter.
+	struct Touch
+	{
+		MoxMxf::UInt64 time;
+		int frame;
+		int width;
+		int height;
+		int factor_x;
+		int factor_y;
+		MoxFiles::PixelType type;
+	};
+	
+	void touch(const Touch &touch);
+	Touch lastTouch();
+
+	// A copy, because synch() can swap the readers out at any time.
+	// Use a reader for anything else.
+	MoxFiles::Header header();
+	
+	// With multi-frame rendering several threads might want frames from
+	// the same file, so each one gets its own InputFile to decode with.
+	MoxFiles::InputFile & acquireReader();
+	void releaseReader(MoxFiles::InputFile &file);
+	
+	MoxReadAhead & readAhead() { return *_read_ahead; }
+	
+	MoxAudioAhead * audioAhead() { return _audio_ahead; } // NULL if there's no audio
+	
+	// from the .moxinfo file, if we exported this
+	int sourceFrame(int frame);
+	bool getBounds(int frame, MoxRect &bounds);
+	
+	// Draw from the proxy, if we exported one and it's big enough.
+	// Returns false if the master has to be decoded instead.
+	bool drawProxy(int frame, char *dest, ptrdiff_t rowbytes, int width, int height,
+					MoxFiles::PixelType type, const MoxRect &region);
+	
+	unsigned int id() const { return _id; }
+	
+	void idle(MoxMxf::UInt64 timeout);
+	
+	// Hash the end of the file once, so synch() can tell if it only grew.
+	// Returns false if it was already done or the file is busy.
+	bool sampleTail();
+	
+  private:
+	A_PathType *_path;
+	static size_t pathLen(const A_PathType *path);
+	
+	AEStreamSource *_source;
+	
+	struct Reader
+	{
+		MoxPooledStream *stream;
+		MoxIndexStream *index_stream;
+		MoxFiles::InputFile *file;
+		bool in_use;
+	};
+	
+	std::vector<Reader *> _readers; // the first one is always there
+	
+	IlmThread::Mutex _mutex;
+	IlmThread::Semaphore _readers_available;
+	
+	// Specs sharing the file can synch() at the same time, and two of them
+	// each holding some of the reader slots would wait on each other forever.
+	IlmThread::Mutex _synch_mutex;
+	
+	Reader * newReader();
+	static void deleteReader(Reader *reader);
+	
+	MoxReadAhead *_read_ahead;
+	
+	MoxAudioAhead *_audio_ahead;
+	
+	MoxFrameInfo _info;
+	
+	void readInfo();
+	
+	MoxProxyReader *_proxy;
+	unsigned int _proxy_id; // proxy frames get cached separately
+	
+	const unsigned int _id;
+	
+	// what the file looked like when we read it
+	MoxMxf::UInt64 _size;
+	MoxMxf::UInt64 _modified;
+	MoxMxf::UInt64 _fingerprint;
+	
+	// hash of the last few bytes, to see if they're still there after the file grows
+	bool _tail_tried;
+	bool _tail_sampled;
+	MoxMxf::UInt64 _tail_sample;
+	
+	bool tailSample(MoxMxf::UInt64 size, MoxMxf::UInt64 &sample) const;
+	
+	unsigned int _generation;
+	
+	Touch _last_touch;
+};
+
+AEInputFile::AEInputFile(const A_PathType *file_pathZ) :
+	_source(NULL),
+	_readers_available(gReadersPerFile),
+	_read_ahead(NULL),
+	_audio_ahead(NULL),
+	_proxy(NULL),
+	_proxy_id(0),
+	_id(MoxFrameCache::newFileID()),
+	_path(NULL),
+	_size(0),
+	_modified(0),
+	_fingerprint(0),
+	_tail_tried(false),
+	_tail_sampled(false),
+	_tail_sample(0),
+	_generation(0)
+{
+	if(file_pathZ == NULL)
+		throw MoxMxf::NullExc("Null path");
+
+	const size_t len = pathLen(file_pathZ);
+	
+	if(len == 0)
+		throw MoxMxf::ArgExc("Empty path");
+	
+	_path = new A_PathType[len + 1];
+	
+	memcpy(_path, file_pathZ, sizeof(A_PathType) * (len + 1));
+	
+	
+	_source = new AEStreamSource(_path);
+	
+	MoxFileStat(MoxUTF8Path(_path), &_size, &_modified);
+	
+	// opening counts as being touched, but there's no frame yet
+	_last_touch.time = MoxMilliseconds();
+	_last_touch.frame = -1;
+	_last_touch.width = _last_touch.height = 0;
+	_last_touch.factor_x = _last_touch.factor_y = 0;
+	_last_touch.type = MoxFiles::UINT8;
+	
+	try
+	{
+		_readers.push_back( newReader() );
+	}
+	catch(...)
+	{
+		delete _source;
+		delete [] _path;
+		
+		throw;
+	}
+	
+	const MoxFiles::Header &head = _readers.front()->file->header();
+	
+	_fingerprint = HeaderFingerprint(head);
+	
+	// The decoders come and go with idle time, so they open from the index cache.
+	_read_ahead = new MoxReadAhead(new MoxIndexedStreamSource(g_index_cache, _path,
+										new MoxPooledStreamSource(g_stream_pool, *_source)),
+									head.duration(), gReadAheadSettings);
+	
+	if(head.audioChannels().size() > 0)
+	{
+		_audio_ahead = new MoxAudioAhead(new MoxIndexedStreamSource(g_index_cache, _path,
+												new MoxPooledStreamSource(g_stream_pool, *_source)),
+											MoxAudioAhead::audioLength(head), gAudioAheadSettings);
+	}
+	
+	readInfo();
+}
+
+void
+AEInputFile::readInfo()
+{
+	// alpha bounds and such, if we exported this file
+	MoxFrameInfo info;
+	
+	if( info.read( MoxUTF8Path(_path) ) )
+	{
+		const int duration = header().duration();
+		
+		std::vector<int> sources(duration);
+		
+		for(int i = 0; i < duration; i++)
+			sources[i] = info.sourceFrame(i);
+		
+		_read_ahead->setSourceFrames(sources);
+	}
+	
+	// The frames of a new proxy could be different, so it gets a new ID.
+	// Nobody is drawing while we're here (see drawProxy).
+	MoxProxyReader *proxy = MoxProxyReader::open(MoxUTF8Path(_path), info);
+	
+	IlmThread::Lock lock(_mutex);
+	
+	_info = info;
+	
+	if(_proxy != NULL)
+	{
+		g_frame_cache.invalidate(_proxy_id);
+		
+		delete _proxy;
+	}
+	
+	_proxy = proxy;
+	_proxy_id = (proxy != NULL ? MoxFrameCache::newFileID() : 0);
+}
+
+void
+AEInputFile::touch(const Touch &touch)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	_last_touch = touch;
+}
+
+AEInputFile::Touch
+AEInputFile::lastTouch()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	return _last_touch;
+}
+
+int
+AEInputFile::sourceFrame(int frame)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	return _info.sourceFrame(frame);
+}
+
+bool
+AEInputFile::getBounds(int frame, MoxRect &bounds)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	return _info.getBounds(frame, bounds);
+}
+
+bool
+AEInputFile::drawProxy(int frame, char *dest, ptrdiff_t rowbytes, int width, int height,
+						MoxFiles::PixelType type, const MoxRect &region)
+{
+	// Holding a reader slot keeps synch() from swapping the proxy out from under us.
+	_readers_available.wait();
+	
+	bool drew = false;
+	
+	try
+	{
+		MoxProxyReader *proxy = NULL;
+		unsigned int proxy_id = 0;
+		
+		{
+			IlmThread::Lock lock(_mutex);
+			
+			proxy = _proxy;
+			proxy_id = _proxy_id;
+		}
+		
+		if(proxy != NULL && width <= proxy->width() && height <= proxy->height())
+		{
+			const MoxFrameCache::Key cache_key(proxy_id, frame, type, width, height, "ARGB");
+			
+			if( g_frame_cache.fetch(cache_key, dest, rowbytes, &region) )
+			{
+				drew = true;
+			}
+			else if( proxy->draw(frame, dest, rowbytes, width, height, type, "ARGB") )
+			{
+				g_frame_cache.insert(cache_key, dest, rowbytes);
+				
+				drew = true;
+			}
+		}
+	}
+	catch(...)
+	{
+		_readers_available.post();
+		
+		throw;
+	}
+	
+	_readers_available.post();
+	
+	return drew;
+}
+
+AEInputFile::~AEInputFile()
+{
+	g_frame_cache.invalidate(_id);
+	
+	if(_proxy != NULL)
+	{
+		g_frame_cache.invalidate(_proxy_id);
+		
+		delete _proxy;
+	}
+
+	delete _read_ahead;
+	
+	delete _audio_ahead;
+	
+	for(std::vector<Reader *>::iterator i = _readers.begin(); i != _readers.end(); ++i)
+	{
+		assert(!(*i)->in_use);
+		
+		deleteReader(*i);
+	}
+	
+	delete _source;
+	
+	delete [] _path;
+}
+
+MoxFiles::Header
+AEInputFile::header()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	return _readers.front()->file->header();
+}
+
+MoxFiles::InputFile &
+AEInputFile::acquireReader()
+{
+	// only gReadersPerFile at a time, the rest wait their turn
+	_readers_available.wait();
+	
+	IlmThread::Lock lock(_mutex);
+	
+	for(std::vector<Reader *>::iterator i = _readers.begin(); i != _readers.end(); ++i)
+	{
+		if(!(*i)->in_use)
+		{
+			(*i)->in_use = true;
+			
+			return *(*i)->file;
+		}
+	}
+	
+	try
+	{
+		Reader *reader = newReader();
+		
+		reader->in_use = true;
+		
+		_readers.push_back(reader);
+		
+		return *reader->file;
+	}
+	catch(...)
+	{
+		_readers_available.post();
+		
+		throw;
+	}
+}
+
+void
+AEInputFile::releaseReader(MoxFiles::InputFile &file)
+{
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		for(std::vector<Reader *>::iterator i = _readers.begin(); i != _readers.end(); ++i)
+		{
+			if((*i)->file == &file)
+			{
+				assert((*i)->in_use);
+			
+				(*i)->in_use = false;
+			}
+		}
+	}
+	
+	_readers_available.post();
+}
+
+AEInputFile::Reader *
+AEInputFile::newReader()
+{
+	Reader *reader = new Reader;
+	
+	reader->stream = NULL;
+	reader->index_stream = NULL;
+	reader->file = NULL;
+	reader->in_use = false;
+	
+	try
+	{
+		// The pool closes the file when too many are open and reopens it
+		// when we need it again, so the InputFile (with its parsed header)
+		// can stick around for as long as AE has the footage.
+		reader->stream = new MoxPooledStream(g_stream_pool, *_source);
+		
+		// If we've seen this file before, the header and index come out of
+		// the index cache and the pool never has to open the file at all.
+		reader->index_stream = g_index_cache.open(_path, *reader->stream);
+		
+		reader->file = new MoxFiles::InputFile(*reader->index_stream);
+		
+		MoxMemory::add(MoxMemory::DECODERS, MoxMemory::decoderBytes(reader->file->header()));
+		
+		g_index_cache.store(*reader->index_stream);
+	}
+	catch(...)
+	{
+		deleteReader(reader);
+		
+		throw;
+	}
+	
+	return reader;
+}
+
+void
+AEInputFile::deleteReader(Reader *reader)
+{
+	if(reader->file != NULL)
+		MoxMemory::remove(MoxMemory::DECODERS, MoxMemory::decoderBytes(reader->file->header()));
+	
+	delete reader->file;
+	
+	delete reader->index_stream;
+	
+	delete reader->stream;
+	
+	delete reader;
+}
+
+void
+AEInputFile::idle(MoxMxf::UInt64 timeout)
+{
+	// AE expects us to close files between calls.  The pool takes care of
+	// the streams, but we can also give up the read-ahead decoders and frames,
+	// plus any extra readers a multi-frame render left behind.
+	IlmThread::Lock lock(_mutex);
+	
+	MoxMxf::UInt64 last_access = 0;
+	
+	for(std::vector<Reader *>::const_iterator i = _readers.begin(); i != _readers.end(); ++i)
+	{
+		if((*i)->in_use)
+			return;
+		
+		if((*i)->stream->lastAccess() > last_access)
+			last_access = (*i)->stream->lastAccess();
+	}
+	
+	if((MoxMilliseconds() - last_access) > timeout)
+	{
+		_read_ahead->release(); // might still be busy, we'll get it next time
+		
+		if(_audio_ahead != NULL)
+			_audio_ahead->release();
+		
+		if(_proxy != NULL)
+			_proxy->release();
+		
+		while(_readers.size() > 1)
+		{
+			deleteReader( _readers.back() );
+			
+			_readers.pop_back();
+		}
+	}
+}
+
+bool
+AEInputFile::sampleTail()
+{
+	// Idle is a better time for this than when the file is opened, but
+	// it means a stat and a read, so none of our locks are held for it.
+	MoxMxf::UInt64 size = 0, modified = 0;
+	unsigned int generation = 0;
+	
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		if(_tail_tried)
+			return false;
+		
+		for(std::vector<Reader *>::const_iterator i = _readers.begin(); i != _readers.end(); ++i)
+		{
+			if((*i)->in_use)
+				return false;
+		}
+		
+		_tail_tried = true;
+		
+		size = _size;
+		modified = _modified;
+		generation = _generation;
+	}
+	
+	MoxMxf::UInt64 now_size = 0, now_modified = 0, sample = 0;
+	
+	const bool sampled = (MoxFileStat(MoxUTF8Path(_path), &now_size, &now_modified) &&
+							now_size == size && now_modified == modified && tailSample(size, sample));
+	
+	IlmThread::Lock lock(_mutex);
+	
+	if(_generation == generation) // synch() didn't reload it while we were looking
+	{
+		_tail_sampled = sampled;
+		_tail_sample = sample;
+	}
+	
+	return true;
+}
+
+bool
+AEInputFile::tailSample(MoxMxf::UInt64 size, MoxMxf::UInt64 &sample) const
+{
+	const MoxMxf::UInt64 sample_size = 4096;
+	
+	const MoxMxf::UInt64 start = (size > sample_size ? size - sample_size : 0);
+	
+	std::vector<unsigned char> buf((size_t)(size - start));
+	
+	if( buf.empty() )
+		return false;
+	
+	try
+	{
+		// goes through the pool, so it counts against the open file limit
+		MoxPooledStream stream(g_stream_pool, *_source);
+		
+		stream.FileSeek(start);
+		
+		const bool got = (stream.FileRead(&buf[0], buf.size()) == buf.size());
+		
+		if(got)
+			sample = MoxHash64(&buf[0], buf.size(), size);
+		
+		return got;
+	}
+	catch(...)
+	{
+		return false;
+	}
+}
+
+AEInputFile::Change
+AEInputFile::synch()
+{
+	IlmThread::Lock synch_lock(_synch_mutex);
+	
+	const std::string path = MoxUTF8Path(_path);
+	
+	MoxMxf::UInt64 size = 0, modified = 0;
+	
+	if(!MoxFileStat(path, &size, &modified) || (size == _size && modified == _modified))
+		return UNCHANGED; // AE will deal with missing files
+	
+	bool tail_sampled = false;
+	MoxMxf::UInt64 tail_sample = 0;
+	
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		tail_sampled = _tail_sampled;
+		tail_sample = _tail_sample;
+	}
+	
+	// If the file grew and the end of the old one is still there, it was added on to.
+	// MoxFiles can't add to an index it already read, so the header still gets
+	// read again, but all the cached frames can stay.
+	MoxMxf::UInt64 sample = 0;
+	
+	const bool grew = (tail_sampled && size > _size && tailSample(_size, sample) && sample == tail_sample);
+	
+	
+	// wait for everyone to finish decoding
+	for(int i = 0; i < gReadersPerFile; i++)
+		_readers_available.wait();
+	
+	Reader *reader = NULL;
+	
+	try
+	{
+		reader = newReader();
+	}
+	catch(...)
+	{
+		// Might still be getting written.  We'll try again next time.
+		for(int i = 0; i < gReadersPerFile; i++)
+			_readers_available.post();
+		
+		return UNCHANGED;
+	}
+	
+	const MoxFiles::Header &head = reader->file->header();
+	
+	const int old_duration = header().duration();
+	const int new_duration = head.duration();
+	
+	const MoxMxf::UInt64 fingerprint = HeaderFingerprint(head);
+	
+	const bool appended = (grew && fingerprint == _fingerprint && new_duration >= old_duration);
+	
+	MoxFrameInfo old_info;
+	
+	std::vector<Reader *> old_readers;
+	
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		old_info = _info;
+		
+		old_readers.swap(_readers);
+		
+		_readers.push_back(reader);
+		
+		_size = size;
+		_modified = modified;
+		_fingerprint = fingerprint;
+		
+		_tail_tried = _tail_sampled = false;
+		
+		_generation++;
+	}
+	
+	// We have every slot, so nobody is decoding with these.  Headers
+	// only ever leave as copies, so nobody is looking at them either.
+	for(std::vector<Reader *>::iterator i = old_readers.begin(); i != old_readers.end(); ++i)
+		deleteReader(*i);
+	
+	_read_ahead->reset(new_duration);
+	
+	if(_audio_ahead != NULL)
+		_audio_ahead->reset( MoxAudioAhead::audioLength(head) );
+	
+	readInfo();
+	
+	
+	// Keep the cached frames that are still good.  Hashes from our
+	// exporter tell us for sure, otherwise go by whether it was appended.
+	std::vector<bool> unchanged(old_duration < new_duration ? old_duration : new_duration, appended);
+	
+	for(int i = 0; i < (int)unchanged.size(); i++)
+	{
+		MoxMxf::UInt64 old_hash = 0, new_hash = 0;
+		
+		if(old_info.getHash(i, old_hash) && _info.getHash(i, new_hash))
+			unchanged[i] = (old_hash == new_hash);
+	}
+	
+	g_frame_cache.invalidateChanged(_id, unchanged);
+	
+	
+	for(int i = 0; i < gReadersPerFile; i++)
+		_readers_available.post();
+	
+	return (appended ? APPENDED : REPLACED);
+}
+
+size_t
+AEInputFile::pathLen(const A_PathType *path)
+{
+	const A_PathType *p = path;
+	
+	size_t len = 0;
+	
+	while(*p++ != '\0')
+		len++;
+		
+	return len;
+}
+
+
+class AEReader
+{
+  public:
+	AEReader(AEInputFile &input_file) : _input_file(input_file), _file(input_file.acquireReader()) {}
+	~AEReader() { _input_file.releaseReader(_file); }
+	
+	MoxFiles::InputFile & file() { return _file; }
+	
+  private:
+	AEInputFile &_input_file;
+	MoxFiles::InputFile &_file;
+};
+
+
+// In-specs and their files.  Render threads all come through here,
+// so the map is split into shards that each have their own lock.
+// AE makes a new in-spec when footage is imported twice, proxied or
+// reloaded, so specs that point to the same file share one AEInputFile.
+class AEInputFileMap
+{
+  public:
+	AEInputFileMap() {}
+	~AEInputFileMap() {}
+	
+	AEInputFile * find(AEIO_InSpecH specH);
+	
+	AEInputFile & open(AEIO_InSpecH specH, const A_PathType *path);
+	
+	bool close(AEIO_InSpecH specH); // false if we didn't have it
+	
+	// Reloads the file if it changed on disk.  Each spec sharing the file
+	// hears about the change once.  Returns false if we didn't have it.
+	bool synch(AEIO_InSpecH specH, bool *changed);
+	
+	// Every open file, held on to until you release() each one.
+	void retainAll(std::vector<AEInputFile *> &files);
+	void release(AEInputFile *input_file);
+	
+	void idle(MoxMxf::UInt64 timeout);
+	
+	// sampleTail() for up to max_files files that need it
+	void sampleTails(int max_files);
+	
+	size_t size();
+	
+  private:
+	enum { NUM_SHARDS = 16 };
+	
+	typedef std::map<AEIO_InSpecH, AEInputFile *> FileMap;
+	typedef std::map<AEIO_InSpecH, unsigned int> GenerationMap;
+	
+	struct Shard
+	{
+		IlmThread::Mutex mutex;
+		FileMap files;
+		GenerationMap generations; // what each spec has been told about
+	};
+	
+	Shard _shards[NUM_SHARDS];
+	
+	Shard & shard(AEIO_InSpecH specH) { return _shards[(reinterpret_cast<size_t>(specH) / sizeof(void *)) % NUM_SHARDS]; }
+	
+	struct FileEntry
+	{
+		int refcount;
+		std::string identity;
+	};
+	
+	typedef std::map<AEInputFile *, FileEntry> RefMap;
+	typedef std::map<std::string, AEInputFile *> IdentityMap;
+	
+	RefMap _refs;
+	IdentityMap _identities;
+	IlmThread::Mutex _refs_mutex;
+};
+
+AEInputFile *
+AEInputFileMap::find(AEIO_InSpecH specH)
+{
+	Shard &s = shard(specH);
+	
+	IlmThread::Lock lock(s.mutex);
+	
+	FileMap::const_iterator file = s.files.find(specH);
+	
+	return (file != s.files.end() ? file->second : NULL);
+}
+
+AEInputFile &
+AEInputFileMap::open(AEIO_InSpecH specH, const A_PathType *path)
+{
+	AEInputFile *input_file = find(specH);
+	
+	if(input_file != NULL)
+		return *input_file;
+	
+	
+	// find out if we already have this file open under another spec
+	const std::string identity = MoxFileIdentity( MoxUTF8Path(path) );
+	
+	if( !identity.empty() )
+	{
+		IlmThread::Lock lock(_refs_mutex);
+		
+		IdentityMap::const_iterator shared = _identities.find(identity);
+		
+		if(shared != _identities.end())
+		{
+			input_file = shared->second;
+			
+			_refs[input_file].refcount++;
+		}
+	}
+	
+	if(input_file == NULL)
+	{
+		AEInputFile *new_file = new AEInputFile(path);
+		
+		IlmThread::Lock lock(_refs_mutex);
+		
+		IdentityMap::const_iterator shared = (identity.empty() ? _identities.end() : _identities.find(identity));
+		
+		if(shared != _identities.end())
+		{
+			// another thread opened it while we were
+			input_file = shared->second;
+			
+			_refs[input_file].refcount++;
+			
+			lock.release();
+			
+			delete new_file;
+		}
+		else
+		{
+			input_file = new_file;
+			
+			FileEntry &entry = _refs[input_file];
+			
+			entry.refcount = 1;
+			entry.identity = identity;
+			
+			if( !identity.empty() )
+				_identities[identity] = input_file;
+		}
+	}
+	
+	
+	Shard &s = shard(specH);
+	
+	IlmThread::Lock lock(s.mutex);
+	
+	std::pair<FileMap::iterator, bool> result = s.files.insert( FileMap::value_type(specH, input_file) );
+	
+	AEInputFile *spec_file = result.first->second;
+	
+	if(result.second)
+	{
+		s.generations[specH] = spec_file->generation();
+	}
+	else
+	{
+		// another render thread beat us to this spec
+		lock.release();
+		
+		release(input_file);
+	}
+	
+	return *spec_file;
+}
+
+bool
+AEInputFileMap::close(AEIO_InSpecH specH)
+{
+	AEInputFile *input_file = NULL;
+	
+	{
+		Shard &s = shard(specH);
+		
+		IlmThread::Lock lock(s.mutex);
+		
+		FileMap::iterator file = s.files.find(specH);
+		
+		if(file == s.files.end())
+			return false;
+		
+		input_file = file->second;
+		
+		s.files.erase(file);
+		
+		s.generations.erase(specH);
+	}
+	
+	release(input_file);
+	
+	return true;
+}
+
+bool
+AEInputFileMap::synch(AEIO_InSpecH specH, bool *changed)
+{
+	AEInputFile *input_file = find(specH);
+	
+	if(input_file == NULL)
+		return false;
+	
+	input_file->synch();
+	
+	Shard &s = shard(specH);
+	
+	IlmThread::Lock lock(s.mutex);
+	
+	unsigned int &seen = s.generations[specH];
+	
+	*changed = (seen != input_file->generation());
+	
+	seen = input_file->generation();
+	
+	return true;
+}
+
+void
+AEInputFileMap::release(AEInputFile *input_file)
+{
+	IlmThread::Lock lock(_refs_mutex);
+	
+	RefMap::iterator ref = _refs.find(input_file);
+	
+	assert(ref != _refs.end());
+	
+	if(ref != _refs.end() && --ref->second.refcount == 0)
+	{
+		if( !ref->second.identity.empty() )
+			_identities.erase(ref->second.identity);
+		
+		_refs.erase(ref);
+		
+		lock.release();
+		
+		delete input_file;
+	}
+}
+
+void
+AEInputFileMap::retainAll(std::vector<AEInputFile *> &files)
+{
+	IlmThread::Lock lock(_refs_mutex);
+	
+	for(RefMap::iterator file = _refs.begin(); file != _refs.end(); ++file)
+	{
+		file->second.refcount++;
+		
+		files.push_back(file->first);
+	}
+}
+
+void
+AEInputFileMap::idle(MoxMxf::UInt64 timeout)
+{
+	// Render threads need _refs_mutex to open and close specs,
+	// so it's only held long enough to get the list.
+	std::vector<AEInputFile *> files;
+	
+	retainAll(files);
+	
+	for(std::vector<AEInputFile *>::iterator i = files.begin(); i != files.end(); ++i)
+	{
+		(*i)->idle(timeout);
+		
+		release(*i);
+	}
+}
+
+void
+AEInputFileMap::sampleTails(int max_files)
+{
+	std::vector<AEInputFile *> files;
+	
+	retainAll(files);
+	
+	for(std::vector<AEInputFile *>::iterator i = files.begin(); i != files.end(); ++i)
+	{
+		if(max_files > 0 && (*i)->sampleTail())
+			max_files--;
+		
+		release(*i);
+	}
+}
+
+size_t
+AEInputFileMap::size()
+{
+	size_t total = 0;
+	
+	for(int i=0; i < NUM_SHARDS; i++)
+	{
+		IlmThread::Lock lock(_shards[i].mutex);
+		
+		total += _shards[i].files.size();
+	}
+	
+	return total;
+}
+
+static AEInputFileMap g_infiles;
+
+
+// After a project opens, the first look at every clip has to wait for a decode.
+// While AE sits idle, we decode the first frame and the last one AE drew for
+// the most recently used files and put them in the frame cache.  Only one
+// frame at a time, in the background, and only after AE has stopped asking
+// for frames for a bit.
+class AEWarmup
+{
+  public:
+	AEWarmup();
+	~AEWarmup() {}
+	
+	void setEnabled(bool enabled) { _enabled = enabled; }
+	
+	// DrawSparseFrame calls this so we stay out of the way
+	void noteDraw(MoxFiles::PixelType type);
+	
+	// find something to do, taking no more than a few milliseconds
+	void idle();
+	
+	// waits for the current frame to finish
+	void shutdown();
+	
+  private:
+	bool _enabled;
+	bool _busy;
+	MoxMxf::UInt64 _last_draw;
+	MoxFiles::PixelType _last_type; // new files probably get drawn the same way
+	
+	IlmThread::Mutex _mutex;
+	IlmThread::ThreadPool *_pool;
+	IlmThread::TaskGroup *_task_group;
+	
+	struct Job
+	{
+		AEInputFile *file;
+		int frame;
+		int width;
+		int height;
+		int factor_x;
+		int factor_y;
+		MoxFiles::PixelType type;
+	};
+	
+	bool quiet();
+	static bool findJob(AEInputFile *file, MoxFiles::PixelType default_type, Job &job);
+	void decode(const Job &job);
+	
+	friend class AEWarmupTask;
+};
+
+class AEWarmupTask : public IlmThread::Task
+{
+  public:
+	AEWarmupTask(IlmThread::TaskGroup *group, AEWarmup &warmup, const AEWarmup::Job &job) :
+		IlmThread::Task(group),
+		_warmup(warmup),
+		_job(job)
+	{}
+	
+	virtual ~AEWarmupTask() {}
+	
+	virtual void execute() { _warmup.decode(_job); }
+	
+  private:
+	AEWarmup &_warmup;
+	const AEWarmup::Job _job;
+};
+
+AEWarmup::AEWarmup() :
+	_enabled(true),
+	_busy(false),
+	_last_draw(0),
+	_last_type(MoxFiles::UINT8),
+	_pool(NULL),
+	_task_group(NULL)
+{
+}
+
+void
+AEWarmup::noteDraw(MoxFiles::PixelType type)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	_last_draw = MoxMilliseconds();
+	_last_type = type;
+}
+
+bool
+AEWarmup::quiet()
+{
+	// AE hasn't asked for a frame in a while
+	const MoxMxf::UInt64 quiet_time = 1000;
+	
+	IlmThread::Lock lock(_mutex);
+	
+	return ((MoxMilliseconds() - _last_draw) > quiet_time);
+}
+
+void
+AEWarmup::idle()
+{
+	const MoxMxf::UInt64 budget = 3;
+	
+	const MoxMxf::UInt64 start = MoxMilliseconds();
+	
+	if(!_enabled || !quiet() || g_frame_cache.maxBytes() == 0)
+		return;
+	
+	// don't warm up what we'd only trim again
+	if(gMemoryHighWater > 0 && MoxMemory::bytes() > gMemoryTarget)
+		return;
+	
+	MoxFiles::PixelType default_type;
+	
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		if(_busy)
+			return;
+		
+		default_type = _last_type;
+	}
+	
+	std::vector<AEInputFile *> files;
+	
+	g_infiles.retainAll(files);
+	
+	// most recently used first
+	std::vector< std::pair<MoxMxf::UInt64, AEInputFile *> > by_time;
+	
+	for(std::vector<AEInputFile *>::const_iterator i = files.begin(); i != files.end(); ++i)
+		by_time.push_back( std::make_pair((*i)->lastTouch().time, *i) );
+	
+	std::sort(by_time.rbegin(), by_time.rend());
+	
+	Job job;
+	job.file = NULL;
+	
+	for(size_t i = 0; i < by_time.size() && job.file == NULL && (MoxMilliseconds() - start) <= budget; i++)
+	{
+		if( !findJob(by_time[i].second, default_type, job) )
+			job.file = NULL;
+	}
+	
+	for(std::vector<AEInputFile *>::const_iterator i = files.begin(); i != files.end(); ++i)
+	{
+		if(*i != job.file)
+			g_infiles.release(*i);
+	}
+	
+	if(job.file != NULL)
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		if(_pool == NULL)
+		{
+			_pool = new IlmThread::ThreadPool(1);
+			_task_group = new IlmThread::TaskGroup;
+		}
+		
+		_busy = true;
+		
+		_pool->addTask(new AEWarmupTask(_task_group, *this, job));
+	}
+}
+
+bool
+AEWarmup::findJob(AEInputFile *file, MoxFiles::PixelType default_type, Job &job)
+{
+	const AEInputFile::Touch touch = file->lastTouch();
+	
+	const MoxFiles::Header head = file->header();
+	
+	if(head.channels().size() == 0 || head.duration() < 1)
+		return false;
+	
+	job.file = file;
+	
+	// Draw it the way AE did last time.  Never drawn, figure full size.
+	if(touch.factor_x > 0 && touch.factor_y > 0)
+	{
+		job.width = touch.width;
+		job.height = touch.height;
+		job.factor_x = touch.factor_x;
+		job.factor_y = touch.factor_y;
+		job.type = touch.type;
+	}
+	else if(touch.frame < 0)
+	{
+		job.width = head.width();
+		job.height = head.height();
+		job.factor_x = job.factor_y = 1;
+		job.type = default_type;
+	}
+	else
+		return false;
+	
+	// won't fit without pushing something else out
+	const size_t frame_bytes = (size_t)job.width * (size_t)job.height * 4 * MoxFiles::PixelSize(job.type);
+	
+	if(g_frame_cache.stats().bytes + frame_bytes > g_frame_cache.maxBytes())
+		return false;
+	
+	// the last frame AE drew, then the poster frame
+	const int frames[2] = { touch.frame, 0 };
+	
+	for(int i = 0; i < 2; i++)
+	{
+		if(frames[i] >= 0 && frames[i] < head.duration())
+		{
+			job.frame = file->sourceFrame(frames[i]);
+			
+			const MoxFrameCache::Key key(file->id(), job.frame, job.type, job.width, job.height, "ARGB");
+			
+			if( !g_frame_cache.contains(key) )
+				return true;
+		}
+	}
+	
+	return false;
+}
+
+void
+AEWarmup::decode(const Job &job)
+{
+	try
+	{
+		// if AE started drawing since, leave the decoders to it
+		if( quiet() )
+		{
+			// the header has to come from the reader we decode with, in case the file was reloaded
+			AEReader reader(*job.file);
+			
+			const MoxFiles::Header &head = reader.file().header();
+			
+			MoxFrame full(head.width(), head.height(), job.type, "ARGB");
+			
+			{
+				MoxFiles::FrameBuffer frame_buffer(head.width(), head.height());
+				
+				full.insertSlices(frame_buffer);
+				
+				reader.file().getFrame(job.frame, frame_buffer);
+			}
+			
+			const MoxFrameCache::Key key(job.file->id(), job.frame, job.type, job.width, job.height, "ARGB");
+			
+			if(job.factor_x == 1 && job.factor_y == 1)
+			{
+				g_frame_cache.insert(key, full.data(), full.rowbytes());
+			}
+			else
+			{
+				MoxFrame small(job.width, job.height, job.type, "ARGB");
+				
+				MoxBoxDownsample(full.data(), full.rowbytes(), full.width(), full.height(),
+									small.data(), small.rowbytes(), small.width(), small.height(),
+									job.factor_x, job.factor_y, job.type);
+				
+				g_frame_cache.insert(key, small.data(), small.rowbytes());
+			}
+		}
+	}
+	catch(...) {}
+	
+	g_infiles.release(job.file);
+	
+	IlmThread::Lock lock(_mutex);
+	
+	_busy = false;
+}
+
+void
+AEWarmup::shutdown()
+{
+	delete _task_group; // waits for the task
+	delete _pool;
+	
+	_task_group = NULL;
+	_pool = NULL;
+}
+
+static AEWarmup g_warmup;
+
+
+class AEOutputFile
 {
   public:
-	AEInputFile(const A_PathType *file_pathZ);
-	~AEInputFile();
-
-	MoxFiles::InputFile & file();
+	AEOutputFile(const A_PathType *file_pathZ, const MoxFiles::Header &header, bool have_alpha, bool write_proxy);
+	~AEOutputFile();
+	
+	const MoxFiles::Header & header() const { return _file->header(); }
 	
-	void closeIfStale(int timeout);
+	// frames and audio go through here to the file
+	MoxEncodeQueue & queue() { return *_queue; }
+	
+	// wait for the queue, finalize and close the movie, then save the info next to it
+	void finish();
 	
   private:
-	A_PathType *_path;
-	static size_t pathLen(const A_PathType *path);
-  
-	PlatformIOStream *_stream;
-	MoxFiles::InputFile *_file;
+	MoxMxf::IOStream *_stream;
+	MoxFiles::OutputFile *_file;
+	
+	MoxProxyWriter *_proxy;
+	
+	MoxEncodeQueue *_queue;
 	
-	time_t _last_access;
-	void updateAccessTime();
-	double timeSinceAccess() const;
+	const std::string _path;
+	
+	MoxFrameInfo _info;
 };
 
-AEInputFile::AEInputFile(const A_PathType *file_pathZ) :
-	_stream(NULL),
-	_file(NULL),
-	_path(NULL)
+static std::string
+OutputPath(const A_PathType *file_pathZ)
 {
 	if(file_pathZ == NULL)
 		throw MoxMxf::NullExc("Null path");
-
-	const size_t len = pathLen(file_pathZ);
-	
-	if(len == 0)
-		throw MoxMxf::ArgExc("Empty path");
-	
-	_path = new A_PathType[len + 1];
-	
-	memcpy(_path, file_pathZ, sizeof(A_PathType) * (len + 1));
 	
+	return MoxUTF8Path(file_pathZ);
+}
+
+AEOutputFile::AEOutputFile(const A_PathType *file_pathZ, const MoxFiles::Header &header, bool have_alpha, bool write_proxy) :
+	_stream(NULL),
+	_file(NULL),
+	_proxy(NULL),
+	_queue(NULL),
+	_path( OutputPath(file_pathZ) )
+{
+	try
+	{
+		PlatformIOStream *file_stream = new PlatformIOStream(file_pathZ, PlatformIOStream::ReadWrite);
+		
+		// lots of small writes are slow on network drives, so gather them up
+		if(gWriteBehind)
+			_stream = new MoxWriteBehindStream(file_stream, gWriteBehindSettings); // deletes file_stream if it throws
+		else
+			_stream = file_stream;
+		
+		_file = new MoxFiles::OutputFile(*_stream, header);
+		
+		if(write_proxy && header.channels().size() > 0)
+			_proxy = new MoxProxyWriter(_path, header, have_alpha);
+		
+		_queue = new MoxEncodeQueue(*_file, _info, _proxy, have_alpha, gEncodeQueueSettings);
+	}
+	catch(...)
+	{
+		// the destructor won't run
+		delete _queue;
+		
+		delete _proxy;
+		
+		delete _file;
+		
+		delete _stream;
+		
+		throw;
+	}
+}
 
-	_stream = new PlatformIOStream(_path, PlatformIOStream::ReadOnly);
+AEOutputFile::~AEOutputFile()
+{
+	delete _queue; // before anything it writes to
 	
-	_file = new MoxFiles::InputFile(*_stream);
+	delete _proxy;
 	
-	updateAccessTime();
+	delete _file;
+	
+	delete _stream;
 }
 
-AEInputFile::~AEInputFile()
+void
+AEOutputFile::finish()
 {
+	_queue->finish();
+	
+	delete _queue;
+	_queue = NULL;
+	
+	_file->finalize();
+	
 	delete _file;
+	_file = NULL;
+	
+	_stream->FileFlush(); // so a failed write comes out here
 	
 	delete _stream;
+	_stream = NULL;
 	
-	delete [] _path;
+	if(_proxy != NULL)
+	{
+		_proxy->finish(_info);
+		
+		delete _proxy;
+		_proxy = NULL;
+	}
+	
+	if( !_info.empty() )
+		_info.write(_path);
 }
 
-MoxFiles::InputFile &
-AEInputFile::file()
+static std::map<AEIO_OutSpecH, AEOutputFile *> g_outfiles;
+
+
+// When AE asks for a frame at a different size than the file, we decode
+// full size into a temporary world.  Making a new one every time is slow,
+// so we hang on to them for a little while.
+class AEWorldPool
 {
-	if(_stream == NULL)
-	{
-		_stream = new PlatformIOStream(_path, PlatformIOStream::ReadOnly);
-	}
+  public:
+	AEWorldPool() {}
+	~AEWorldPool();
+	
+	PF_EffectWorld * get(AEGP_SuiteHandler &suites, A_long width, A_long height, PF_PixelFormat pixel_format);
+	void put(PF_EffectWorld *world);
 	
-	if(_file == NULL)
+	void disposeStale(AEGP_SuiteHandler &suites, MoxMxf::UInt64 timeout);
+	void disposeAll(AEGP_SuiteHandler &suites);
+	
+  private:
+	struct PoolWorld
 	{
-		_file = new MoxFiles::InputFile(*_stream);
-	}
+		PF_EffectWorld world;
+		PF_PixelFormat pixel_format;
+		bool in_use;
+		MoxMxf::UInt64 last_use;
+	};
 	
-	updateAccessTime();
+	typedef std::list<PoolWorld> PoolList;
+	PoolList _worlds;
 	
-	return *_file;
+	IlmThread::Mutex _mutex;
+	
+	void dispose(AEGP_SuiteHandler &suites, PoolList::iterator i);
+};
+
+AEWorldPool::~AEWorldPool()
+{
+	assert(_worlds.empty()); // should have called disposeAll()
 }
 
-void
-AEInputFile::closeIfStale(int timeout)
+PF_EffectWorld *
+AEWorldPool::get(AEGP_SuiteHandler &suites, A_long width, A_long height, PF_PixelFormat pixel_format)
 {
-	if(_file != NULL)
-	{
-		assert(_stream != NULL);
+	IlmThread::Lock lock(_mutex);
 	
-		if(timeSinceAccess() > timeout)
+	for(PoolList::iterator i = _worlds.begin(); i != _worlds.end(); ++i)
+	{
+		if(!i->in_use && i->world.width == width && i->world.height == height && i->pixel_format == pixel_format)
 		{
-			delete _file;
-			_file = NULL;
+			i->in_use = true;
 			
-			delete _stream;
-			_stream = NULL;
+			return &i->world;
 		}
 	}
-}
-
-size_t
-AEInputFile::pathLen(const A_PathType *path)
-{
-	const A_PathType *p = path;
 	
-	size_t len = 0;
+	PoolWorld pool_world;
 	
-	while(*p++ != '\0')
-		len++;
-		
-	return len;
+	ErrThrower err;
+	
+	err = suites.PFWorldSuite()->PF_NewWorld(NULL, width, height, FALSE,
+												pixel_format, &pool_world.world);
+	
+	pool_world.pixel_format = pixel_format;
+	pool_world.in_use = true;
+	pool_world.last_use = MoxMilliseconds();
+	
+	_worlds.push_front(pool_world);
+	
+	MoxMemory::add(MoxMemory::HOST_BUFFERS, pool_world.world.rowbytes * pool_world.world.height);
+	
+	return &_worlds.front().world;
 }
 
 void
-AEInputFile::updateAccessTime()
-{
-	_last_access = time(NULL);
-}
-
-double
-AEInputFile::timeSinceAccess() const
+AEWorldPool::put(PF_EffectWorld *world)
 {
-	return difftime(time(NULL), _last_access);
+	IlmThread::Lock lock(_mutex);
+	
+	for(PoolList::iterator i = _worlds.begin(); i != _worlds.end(); ++i)
+	{
+		if(&i->world == world)
+		{
+			assert(i->in_use);
+		
+			i->in_use = false;
+			i->last_use = MoxMilliseconds();
+			
+			return;
+		}
+	}
+	
+	assert(false); // not one of ours
 }
 
-static std::map<AEIO_InSpecH, AEInputFile *> g_infiles;
-
-
-class AEOutputFile
+void
+AEWorldPool::disposeStale(AEGP_SuiteHandler &suites, MoxMxf::UInt64 timeout)
 {
-  public:
-	AEOutputFile(const A_PathType *file_pathZ, const MoxFiles::Header &header);
-	~AEOutputFile();
+	IlmThread::Lock lock(_mutex);
 	
-	MoxFiles::OutputFile & file() { return *_file; }
+	PoolList::iterator i = _worlds.begin();
 	
-  private:
-	PlatformIOStream *_stream;
-	MoxFiles::OutputFile *_file;
-};
+	while(i != _worlds.end())
+	{
+		PoolList::iterator next = i;
+		++next;
+		
+		if(!i->in_use && (MoxMilliseconds() - i->last_use) > timeout)
+			dispose(suites, i);
+		
+		i = next;
+	}
+}
 
-AEOutputFile::AEOutputFile(const A_PathType *file_pathZ, const MoxFiles::Header &header) :
-	_stream(NULL),
-	_file(NULL)
+void
+AEWorldPool::disposeAll(AEGP_SuiteHandler &suites)
 {
-	if(file_pathZ == NULL)
-		throw MoxMxf::NullExc("Null path");
+	IlmThread::Lock lock(_mutex);
 	
-	_stream = new PlatformIOStream(file_pathZ, PlatformIOStream::ReadWrite);
+	PoolList::iterator i = _worlds.begin();
 	
-	_file = new MoxFiles::OutputFile(*_stream, header);
+	while(i != _worlds.end())
+	{
+		PoolList::iterator next = i;
+		++next;
+		
+		assert(!i->in_use);
+		
+		dispose(suites, i);
+		
+		i = next;
+	}
 }
 
-AEOutputFile::~AEOutputFile()
+void
+AEWorldPool::dispose(AEGP_SuiteHandler &suites, PoolList::iterator i)
 {
-	delete _file;
+	MoxMemory::remove(MoxMemory::HOST_BUFFERS, i->world.rowbytes * i->world.height);
 	
-	delete _stream;
+	suites.PFWorldSuite()->PF_DisposeWorld(NULL, &i->world);
+	
+	_worlds.erase(i);
 }
 
-static std::map<AEIO_OutSpecH, AEOutputFile *> g_outfiles;
+static AEWorldPool g_world_pool;
 
 
 #pragma mark-
@@ -339,53 +1828,245 @@ FlattenOptions(MOX_OutOptions *options)
 {
 	assert(options->flat == FALSE);
 	
-	options->flat = TRUE;
-}
-
-static void
-InflateOptions(MOX_InOptions *options)
-{
-	assert(options->flat == TRUE);
+	options->flat = TRUE;
+}
+
+static void
+InflateOptions(MOX_InOptions *options)
+{
+	assert(options->flat == TRUE);
+	
+	options->flat = FALSE;
+}
+
+static void
+InflateOptions(MOX_OutOptions *options)
+{
+	assert(options->flat == TRUE);
+	
+	options->flat = FALSE;
+}
+
+
+#pragma mark-
+
+
+static int gNumCPUs = 1;
+
+static struct SPBasicSuite *gPicaBasicP = NULL;
+
+
+#define MOX_PREFS_SECTION	"MOX Import"
+
+static A_long
+GetPref(AEGP_SuiteHandler &suites, const A_char *key, A_long default_value)
+{
+	// If the pref isn't there yet, AE adds it with the default value,
+	// so it shows up in the preferences file for anyone who wants to change it.
+	A_long value = default_value;
+	
+	try
+	{
+		ErrThrower err;
+		
+		AEGP_PersistentBlobH blobH = NULL;
+		
+		err = suites.PersistentDataSuite()->AEGP_GetApplicationBlob(&blobH);
+		
+		err = suites.PersistentDataSuite()->AEGP_GetLong(blobH, MOX_PREFS_SECTION, key, default_value, &value);
+	}
+	catch(...)
+	{
+		value = default_value;
+	}
+	
+	return value;
+}
+
+
+static void
+RelieveBufferPool(size_t bytes)
+{
+	// The buffer pool is at its cap.  This runs on whatever thread hit it,
+	// so only the cache and read-aheads are trimmed, they never allocate
+	// while holding their locks.  Cached frames go first.
+	const size_t cache_bytes = g_frame_cache.stats().bytes;
+	
+	const size_t freed = g_frame_cache.trim(cache_bytes > bytes ? cache_bytes - bytes : 0);
+	
+	if(freed < bytes)
+		MoxReadAhead::dropFrames();
+}
+
+
+static A_Err
+InitHook(struct SPBasicSuite *pica_basicP)
+{
+#ifdef MAC_ENV
+	// get number of CPUs using Mach calls
+	host_basic_info_data_t hostInfo;
+	mach_msg_type_number_t infoCount;
+	
+	infoCount = HOST_BASIC_INFO_COUNT;
+	host_info(mach_host_self(), HOST_BASIC_INFO, 
+			  (host_info_t)&hostInfo, &infoCount);
+	
+	gNumCPUs = hostInfo.max_cpus;
+#else // WIN_ENV
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+
+	gNumCPUs = systemInfo.dwNumberOfProcessors;
+#endif
+
+	gPicaBasicP = pica_basicP;
+
+	AEGP_SuiteHandler suites(pica_basicP);
+	
+	
+	// MoxFiles decoding threads, set up once for the whole session
+	const A_long decode_threads = GetPref(suites, "Decode Threads", gNumCPUs);
+	
+	MoxGlobalThreads::acquire(decode_threads);
+	
+	
+	const A_long read_ahead_frames = GetPref(suites, "Read-ahead Frames", gReadAheadSettings.depth);
+	const A_long read_ahead_megabytes = GetPref(suites, "Read-ahead Megabytes", gReadAheadSettings.max_bytes / (1024 * 1024));
+	const A_long read_ahead_decoders = GetPref(suites, "Read-ahead Decoders", gReadAheadSettings.decoders);
+	const A_long read_ahead_threads = GetPref(suites, "Read-ahead Threads", (gNumCPUs > 4 ? 4 : gNumCPUs));
+	
+	gReadAheadSettings.depth = (read_ahead_frames > 0 ? read_ahead_frames : 0);
+	gReadAheadSettings.max_bytes = (read_ahead_megabytes > 0 ? (size_t)read_ahead_megabytes * 1024 * 1024 : 0);
+	gReadAheadSettings.decoders = (read_ahead_decoders > 0 ? read_ahead_decoders : 0);
+	
+	MoxReadAhead::setThreadCount(read_ahead_threads);
+	
+	
+	// Samples per channel to read ahead during audio playback, 0 turns it off
+	const A_long audio_read_ahead_samples = GetPref(suites, "Audio Read-ahead Samples", gAudioAheadSettings.samples);
+	
+	gAudioAheadSettings.samples = (audio_read_ahead_samples > 0 ? audio_read_ahead_samples : 0);
+	
+	
+	// By default use 1/16 of RAM, but not more than a gig.
+	// AE keeps its own cache and we shouldn't fight it for memory.
+	const MoxMxf::UInt64 max_cache = (sizeof(void *) > 4 ? 1024 : 256);
+	const MoxMxf::UInt64 ram_megabytes = MoxPhysicalMemory() / (1024 * 1024);
+	const MoxMxf::UInt64 default_cache = (ram_megabytes > 0 && (ram_megabytes / 16) < max_cache ? (ram_megabytes / 16) : max_cache);
+	
+	const A_long cache_megabytes = GetPref(suites, "Frame Cache Megabytes", (A_long)default_cache);
+	
+	g_frame_cache.setMaxBytes(cache_megabytes > 0 ? (size_t)cache_megabytes * 1024 * 1024 : 0);
+	
+	
+	// Frames, read-ahead, decoders and all.  By default, room for a full
+	// frame cache plus one file's read-ahead, then trim back to half that.
+	const A_long default_high_water = (A_long)((g_frame_cache.maxBytes() + gReadAheadSettings.max_bytes) / (1024 * 1024));
+	
+	const A_long high_water_megabytes = GetPref(suites, "Memory High-water Megabytes", default_high_water);
+	const A_long target_megabytes = GetPref(suites, "Memory Target Megabytes", high_water_megabytes / 2);
+	
+	gMemoryHighWater = (high_water_megabytes > 0 ? (size_t)high_water_megabytes * 1024 * 1024 : 0);
+	gMemoryTarget = (target_megabytes > 0 ? (size_t)target_megabytes * 1024 * 1024 : 0);
+	
+	if(gMemoryTarget > gMemoryHighWater)
+		gMemoryTarget = gMemoryHighWater;
+	
+	
+	// Most files we'll keep open at once, based on the descriptor limit
+	const A_long max_open_files = GetPref(suites, "Max Open Files", MoxStreamPool::defaultMaxOpen());
+	
+	g_stream_pool.setMaxOpen(max_open_files);
+	
+	
+	// How many threads can decode from one file at the same time
+	const A_long readers_per_file = GetPref(suites, "Readers Per File", (gNumCPUs > 8 ? 8 : gNumCPUs));
+	
+	gReadersPerFile = (readers_per_file > 1 ? readers_per_file : 1);
+	
+	
+	// Saved headers and indexes, so big projects open without reading every file
+	const A_long index_cache_megabytes = GetPref(suites, "Index Cache Megabytes", g_index_cache.maxBytes() / (1024 * 1024));
+	
+	g_index_cache.setMaxBytes(index_cache_megabytes > 0 ? (size_t)index_cache_megabytes * 1024 * 1024 : 0);
+	
+	
+	// Decode first and last-drawn frames while AE is idle
+	const A_long idle_warmup = GetPref(suites, "Idle Warmup", 1);
+	
+	g_warmup.setEnabled(idle_warmup != 0);
+	
+	
+	// Quarter-size proxies for drafts, written next to exported movies
+	const A_long write_proxies = GetPref(suites, "Write Proxy Movies", 0);
+	
+	gWriteProxies = (write_proxies != 0);
+	
+	
+	// Frames to hold for the background encoder when exporting, 0 encodes as AE renders
+	const A_long encode_queue_frames = GetPref(suites, "Encode Queue Frames", gEncodeQueueSettings.depth);
+	const A_long encode_queue_megabytes = GetPref(suites, "Encode Queue Megabytes", gEncodeQueueSettings.max_bytes / (1024 * 1024));
+	
+	gEncodeQueueSettings.depth = (encode_queue_frames > 0 ? encode_queue_frames : 0);
+	gEncodeQueueSettings.max_bytes = (encode_queue_megabytes > 0 ? (size_t)encode_queue_megabytes * 1024 * 1024 : 0);
+	
+	
+	// Frame and audio buffers come from a pool that can't go over this
+	const A_long buffer_pool_megabytes = GetPref(suites, "Buffer Pool Megabytes", MoxBufferPool::defaultMaxBytes() / (1024 * 1024));
+	const A_long buffer_pool_spare_megabytes = GetPref(suites, "Buffer Pool Spare Megabytes", MoxBufferPool::maxSpareBytes() / (1024 * 1024));
+	
+	MoxBufferPool::setMaxBytes(buffer_pool_megabytes > 0 ? (size_t)buffer_pool_megabytes * 1024 * 1024 : 0);
+	MoxBufferPool::setMaxSpareBytes(buffer_pool_spare_megabytes > 0 ? (size_t)buffer_pool_spare_megabytes * 1024 * 1024 : 0);
+	
+	MoxBufferPool::setPressureHandler(RelieveBufferPool);
+	
+	
+	// Exports are written in chunks this big on a background thread, 0 writes them as they come
+	const A_long write_behind_megabytes = GetPref(suites, "Write-behind Megabytes", gWriteBehindSettings.chunk_size / (1024 * 1024));
+	const A_long write_behind_chunks = GetPref(suites, "Write-behind Chunks", gWriteBehindSettings.chunks);
 	
-	options->flat = FALSE;
-}
+	gWriteBehind = (write_behind_megabytes > 0);
+	gWriteBehindSettings.chunk_size = (write_behind_megabytes > 0 ? (size_t)write_behind_megabytes * 1024 * 1024 : gWriteBehindSettings.chunk_size);
+	gWriteBehindSettings.chunks = (write_behind_chunks > 0 ? write_behind_chunks : 0);
 
-static void
-InflateOptions(MOX_OutOptions *options)
-{
-	assert(options->flat == TRUE);
-	
-	options->flat = FALSE;
+	return A_Err_NONE;
 }
 
 
-#pragma mark-
-
-
-static int gNumCPUs = 1;
-
-
-static A_Err
-InitHook(struct SPBasicSuite *pica_basicP)
+static size_t
+TrimMemory(AEGP_SuiteHandler &suites, size_t target)
 {
-#ifdef MAC_ENV
-	// get number of CPUs using Mach calls
-	host_basic_info_data_t hostInfo;
-	mach_msg_type_number_t infoCount;
+	// Give back memory until we're down to target, cheapest things first.
+	// Returns the bytes freed.
+	const size_t before = MoxMemory::bytes();
 	
-	infoCount = HOST_BASIC_INFO_COUNT;
-	host_info(mach_host_self(), HOST_BASIC_INFO, 
-			  (host_info_t)&hostInfo, &infoCount);
+	if(before <= target)
+		return 0;
 	
-	gNumCPUs = hostInfo.max_cpus;
-#else // WIN_ENV
-	SYSTEM_INFO systemInfo;
-	GetSystemInfo(&systemInfo);
-
-	gNumCPUs = systemInfo.dwNumberOfProcessors;
-#endif
-
-	return A_Err_NONE;
+	// cached frames can be decoded again if they're wanted
+	const size_t excess = before - target;
+	const size_t cache_bytes = g_frame_cache.stats().bytes;
+	
+	g_frame_cache.trim(cache_bytes > excess ? cache_bytes - excess : 0);
+	
+	// read-ahead frames and decoders, plus extra readers, for files not in use
+	if(MoxMemory::bytes() > target)
+		g_infiles.idle(0);
+	
+	// temporary worlds
+	if(MoxMemory::bytes() > target)
+		g_world_pool.disposeStale(suites, 0);
+	
+	// buffers waiting to be reused, including the ones just given back
+	if(MoxMemory::bytes() > target)
+	{
+		const size_t over = MoxMemory::bytes() - target;
+		const size_t spare_bytes = MoxBufferPool::stats().spare;
+		
+		MoxBufferPool::trim(spare_bytes > over ? spare_bytes - over : 0);
+	}
+	
+	return MoxMemory::trimmed(before);
 }
 
 
@@ -397,12 +2078,36 @@ AEIO_Idle(
 {
 	// AE expects me to close after every call, but that seems slow.
 	// Instead I'll hang around for just a little
-	const int timeout = 10;
+	const MoxMxf::UInt64 timeout = 10 * 1000;
+	
+	g_stream_pool.closeIdle(timeout);
 
-	for(std::map<AEIO_InSpecH, AEInputFile *>::iterator i = g_infiles.begin(); i != g_infiles.end(); ++i)
+	g_infiles.idle(timeout);
+	
+	// each one opens the file, which is slow on a network drive
+	g_infiles.sampleTails(4);
+	
+	try
 	{
-		i->second->closeIfStale(timeout);
+		AEGP_SuiteHandler suites(basic_dataP->pica_basicP);
+	
+		g_world_pool.disposeStale(suites, timeout);
+		
+		// If the machine is running out of memory, give half of ours back
+		const MoxMxf::UInt64 available_memory = MoxAvailableMemory();
+		
+		if(available_memory > 0 && available_memory < (MoxPhysicalMemory() / 20))
+		{
+			TrimMemory(suites, MoxMemory::bytes() / 2);
+		}
+		else if(gMemoryHighWater > 0 && MoxMemory::bytes() > gMemoryHighWater)
+		{
+			TrimMemory(suites, gMemoryTarget);
+		}
 	}
+	catch(...) {}
+	
+	g_warmup.idle();
 
 	return A_Err_NONE; 
 }
@@ -413,11 +2118,30 @@ DeathHook(
 	AEGP_GlobalRefcon unused1,
 	AEGP_DeathRefcon unused2)
 {
+	g_warmup.shutdown(); // a warmup task may be holding a file
+
 	assert(g_infiles.size() == 0); // all files were closed, right?
 	assert(g_outfiles.size() == 0);
 
-	if( MoxFiles::supportsThreads() )
-		MoxFiles::setGlobalThreadCount(0);
+	try
+	{
+		AEGP_SuiteHandler suites(gPicaBasicP);
+		
+		g_world_pool.disposeAll(suites);
+	}
+	catch(...) {}
+
+	MoxBufferPool::setPressureHandler(NULL);
+	
+	MoxReadAhead::shutdown();
+	
+	MoxAudioAhead::shutdown();
+	
+	MoxBackgroundWriter::shutdown(); // encode queues and write-behind streams
+	
+	MoxBufferPool::trim();
+
+	MoxGlobalThreads::release();
 
 	return A_Err_NONE;
 }
@@ -433,9 +2157,17 @@ AEIO_VerifyFileImportable(
 	const A_PathType		*file_pathZ, 
 	A_Boolean				*importablePB)
 { 
-	// TODO: Come up with a quick way to check if the file is really importable
-	
-	*importablePB = TRUE;
+	// Just read the first few K instead of opening a whole InputFile
+	try
+	{
+		PlatformIOStream stream(file_pathZ, PlatformIOStream::ReadOnly);
+		
+		*importablePB = MoxProbe(stream);
+	}
+	catch(...)
+	{
+		*importablePB = FALSE;
+	}
 	
 	return A_Err_NONE; 
 }
@@ -467,6 +2199,26 @@ AEFrameRate(MoxFiles::Rational fps)
 }
 
 
+static int
+FrameForTime(const MoxFiles::Header &head, const A_Time &frame_time)
+{
+	using namespace MoxFiles;
+	
+	const Rational &fps = head.frameRate();
+	const Rational ae_fps = AEFrameRate(fps);
+	
+	const Rational frame_time_rat(frame_time.value, frame_time.scale);
+	const Rational frame_rat = frame_time_rat * ae_fps;
+	
+	assert(frame_rat.Numerator % frame_rat.Denominator == 0);
+	assert(frame_rat.Denominator == 1);
+	assert(frame_time.scale == ae_fps.Numerator || frame_time.value == 0);
+	
+	return (frame_rat.Denominator == 1 ? frame_rat.Numerator :
+			(double)frame_rat.Numerator / (double)frame_rat.Denominator);
+}
+
+
 static unsigned int
 AEBits(MoxFiles::PixelType type)
 {
@@ -515,10 +2267,12 @@ static int ConvertPath(const char * inPath, char * outPath, int outPathMaxLen)
 #endif // AE_HFS_PATHS
 
 
-static MoxFiles::InputFile &
-GetFile(AEGP_SuiteHandler &suites, AEIO_InSpecH specH, const A_PathType *file_pathZ)
+static AEInputFile &
+GetInputFile(AEGP_SuiteHandler &suites, AEIO_InSpecH specH, const A_PathType *file_pathZ)
 {
-	if(g_infiles.find(specH) == g_infiles.end())
+	AEInputFile *input_file = g_infiles.find(specH);
+	
+	if(input_file == NULL)
 	{
 	#ifdef AE_UNICODE_PATHS
 		AEGP_MemHandle pathH = NULL;
@@ -556,9 +2310,7 @@ GetFile(AEGP_SuiteHandler &suites, AEIO_InSpecH specH, const A_PathType *file_pa
 	#endif
 		
 		
-		AEInputFile *inputFile = new AEInputFile(pathZ);
-	
-		g_infiles[specH] = inputFile;
+		input_file = &g_infiles.open(specH, pathZ);
 		
 		
 	#ifdef AE_UNICODE_PATHS
@@ -567,10 +2319,17 @@ GetFile(AEGP_SuiteHandler &suites, AEIO_InSpecH specH, const A_PathType *file_pa
 	#endif
 	}
 
-	if(g_infiles[specH] == NULL)
+	if(input_file == NULL)
 		throw MoxMxf::NullExc("File is NULL");
 	
-	return g_infiles[specH]->file();
+	return *input_file;
+}
+
+
+static MoxFiles::Header
+GetHeader(AEGP_SuiteHandler &suites, AEIO_InSpecH specH, const A_PathType *file_pathZ)
+{
+	return GetInputFile(suites, specH, file_pathZ).header();
 }
 
 
@@ -620,13 +2379,7 @@ AEIO_InitInSpecFromFile(
 		
 		
 		// open file
-		if( supportsThreads() )
-			setGlobalThreadCount(gNumCPUs);
-
-		
-		InputFile &file = GetFile(suites, specH, file_pathZ);
-		
-		const Header &head = file.header();
+		const Header head = GetHeader(suites, specH, file_pathZ);
 		
 		const ChannelList &channels = head.channels();
 		
@@ -894,7 +2647,28 @@ AEIO_SynchInSpec(
 	AEIO_InSpecH	specH, 
 	A_Boolean		*changed0)
 { 
-	return AEIO_Err_USE_DFLT_CALLBACK;
+	// If the file was written over, reload it here and keep whatever
+	// cached frames are still good, instead of AE throwing it all out.
+	A_Err ae_err = A_Err_NONE;
+	
+	try
+	{
+		bool changed = false;
+		
+		if( g_infiles.synch(specH, &changed) )
+		{
+			if(changed0)
+				*changed0 = changed;
+		}
+		else
+			ae_err = AEIO_Err_USE_DFLT_CALLBACK; // haven't opened it yet
+	}
+	catch(...)
+	{
+		ae_err = AEIO_Err_USE_DFLT_CALLBACK;
+	}
+	
+	return ae_err;
 }
 
 
@@ -905,7 +2679,36 @@ AEIO_GetActiveExtent(
 	const A_Time	*tr,				/* >> */
 	A_LRect			*extent)			/* << */
 { 
-	return AEIO_Err_USE_DFLT_CALLBACK; 
+	// If we exported this file we know where the alpha is,
+	// so AE doesn't have to bother with the clear parts.
+	A_Err ae_err = AEIO_Err_USE_DFLT_CALLBACK;
+	
+	AEGP_SuiteHandler suites(basic_dataP->pica_basicP);
+	
+	try
+	{
+		AEInputFile &input_file = GetInputFile(suites, specH, NULL);
+		
+		const int frame = FrameForTime(input_file.header(), *tr);
+		
+		MoxRect bounds;
+		
+		if( input_file.getBounds(frame, bounds) )
+		{
+			extent->left = bounds.left;
+			extent->top = bounds.top;
+			extent->right = bounds.right;
+			extent->bottom = bounds.bottom;
+			
+			ae_err = A_Err_NONE;
+		}
+	}
+	catch(...)
+	{
+		ae_err = AEIO_Err_USE_DFLT_CALLBACK;
+	}
+	
+	return ae_err;
 }
 
 
@@ -962,6 +2765,76 @@ AEIO_InqNextFrameTime(
 }
 
 
+static bool
+DecodeFrame(AEInputFile &input_file, int frame, MoxFiles::PixelType pixel_type,
+			char *origin, ptrdiff_t rowbytes, int width, int height, const MoxRect &region)
+{
+	// Returns true if the whole frame was drawn, false if only the region.
+	// the read-ahead might already have it
+	if( input_file.readAhead().fetch(frame, width, height,
+										pixel_type, "ARGB", origin, rowbytes, &region) )
+	{
+		return region.contains( MoxRect(0, 0, width, height) );
+	}
+	else
+	{
+		// InputFile always decodes the whole thing
+		MoxFiles::FrameBuffer frame_buffer(width, height);
+		
+		MoxInsertSlices(frame_buffer, origin, rowbytes, pixel_type, "ARGB");
+		
+		AEReader reader(input_file);
+		
+		reader.file().getFrame(input_file.sourceFrame(frame), frame_buffer);
+		
+		return true;
+	}
+}
+
+
+static bool
+DecodeFrame(AEInputFile &input_file, int frame, MoxFiles::PixelType pixel_type, PF_EffectWorld *world,
+			const MoxRect &region)
+{
+	return DecodeFrame(input_file, frame, pixel_type, (char *)world->data, world->rowbytes,
+						world->width, world->height, region);
+}
+
+
+static bool
+BoxFactors(const AEIO_RationalScale &rs, A_long full_width, A_long full_height, const PF_EffectWorld *wP,
+			int *factor_x, int *factor_y)
+{
+	// We can do our own box filter when AE wants 1/2, 1/3, 1/4 etc.
+	// and the destination is the size we expect.
+	if(rs.x.num <= 0 || rs.y.num <= 0)
+		return false;
+	
+	const A_long x_num = rs.x.num, x_den = rs.x.den;
+	const A_long y_num = rs.y.num, y_den = rs.y.den;
+	
+	if(x_den % x_num != 0 || y_den % y_num != 0)
+		return false;
+	
+	const int fx = x_den / x_num;
+	const int fy = y_den / y_num;
+	
+	if(fx < 1 || fy < 1)
+		return false;
+	
+	const bool width_ok = (wP->width == (full_width / fx) || wP->width == (full_width + fx - 1) / fx);
+	const bool height_ok = (wP->height == (full_height / fy) || wP->height == (full_height + fy - 1) / fy);
+	
+	if(!width_ok || !height_ok)
+		return false;
+	
+	*factor_x = fx;
+	*factor_y = fy;
+	
+	return true;
+}
+
+
 static A_Err	
 AEIO_DrawSparseFrame(
 	AEIO_BasicData					*basic_dataP,
@@ -980,90 +2853,129 @@ AEIO_DrawSparseFrame(
 	
 		using namespace MoxFiles;
 	
-		if( supportsThreads() )
-			setGlobalThreadCount(gNumCPUs);
-		
+		AEInputFile &input_file = GetInputFile(suites, specH, NULL);
 		
-		InputFile &file = GetFile(suites, specH, NULL);
-		
-		const Header &head = file.header();
+		const Header head = input_file.header();
 		
 		
 		PF_PixelFormat pixel_format;
 		err = suites.PFWorldSuite()->PF_GetPixelFormat(wP, &pixel_format);
 		
+		const MoxFiles::PixelType pixel_type = (pixel_format == PF_PixelFormat_ARGB32 ? MoxFiles::UINT8 :
+												pixel_format == PF_PixelFormat_ARGB64 ? MoxFiles::UINT16A :
+												pixel_format == PF_PixelFormat_ARGB128 ? MoxFiles::FLOAT :
+												MoxFiles::UINT8);
+		
+		
+		const int frame = FrameForTime(head, sparse_framePPB->tr);
+		
 		
-		PF_EffectWorld temp_World_data;
-		PF_EffectWorld *temp_World = &temp_World_data;
+		// remember how AE drew this, so idle time can warm it back up
+		g_warmup.noteDraw(pixel_type);
 		
-		PF_EffectWorld *active_World = NULL;
+		AEInputFile::Touch touch;
+		
+		touch.time = MoxMilliseconds();
+		touch.frame = frame;
+		touch.width = wP->width;
+		touch.height = wP->height;
+		touch.type = pixel_type;
 		
 		if(wP->width == head.width() && wP->height == head.height())
 		{
-			active_World = wP;
-			
-			temp_World = NULL;
+			touch.factor_x = touch.factor_y = 1;
 		}
-		else
+		else if( !BoxFactors(sparse_framePPB->rs, head.width(), head.height(), wP, &touch.factor_x, &touch.factor_y) )
 		{
-			// make our own PF_EffectWorld
-			err = suites.PFWorldSuite()->PF_NewWorld(NULL, head.width(), head.height(), FALSE,
-														pixel_format, temp_World);
-													
-			active_World = temp_World;
+			touch.factor_x = touch.factor_y = 0;
 		}
 		
+		input_file.touch(touch);
 		
-		const MoxFiles::PixelType pixel_type = (pixel_format == PF_PixelFormat_ARGB32 ? MoxFiles::UINT8 :
-												pixel_format == PF_PixelFormat_ARGB64 ? MoxFiles::UINT16A :
-												pixel_format == PF_PixelFormat_ARGB128 ? MoxFiles::FLOAT :
-												MoxFiles::UINT8);
-		
-		const size_t subpixel_size = PixelSize(pixel_type);
-		const size_t pixel_size = 4 * subpixel_size;
-		const ptrdiff_t rowbytes = active_World->rowbytes;
-		
-		const double rgb_fill = 0;
-		const double alpha_fill = (pixel_type == MoxFiles::UINT8 ? 255 :
-									pixel_type == MoxFiles::UINT16A ? 32768 :
-									pixel_type == MoxFiles::FLOAT ? 1.0 :
-									0);
-		
-		char *origin = (char *)active_World->data;
-		
-		FrameBuffer frame_buffer(active_World->width, active_World->height);
 		
-		frame_buffer.insert("A", Slice(pixel_type, origin + (subpixel_size * 0), pixel_size, rowbytes, 1, 1, alpha_fill));
-		frame_buffer.insert("R", Slice(pixel_type, origin + (subpixel_size * 1), pixel_size, rowbytes, 1, 1, rgb_fill));
-		frame_buffer.insert("G", Slice(pixel_type, origin + (subpixel_size * 2), pixel_size, rowbytes, 1, 1, rgb_fill));
-		frame_buffer.insert("B", Slice(pixel_type, origin + (subpixel_size * 3), pixel_size, rowbytes, 1, 1, rgb_fill));
+		// When a layer is masked or partly off-screen, AE only needs part of the frame.
+		// The rect is in wP's coordinates and all zeros means the whole thing.
+		const A_LRect &required_region = sparse_framePPB->required_region0;
 		
+		MoxRect region(0, 0, wP->width, wP->height);
 		
-		const Rational &fps = head.frameRate();
-		const Rational ae_fps = AEFrameRate(fps);
-		
-		const A_Time &frame_time = sparse_framePPB->tr;
-		const Rational frame_time_rat(frame_time.value, frame_time.scale);
-		const Rational frame_rat = frame_time_rat * ae_fps;
+		if(required_region.left != 0 || required_region.top != 0 ||
+			required_region.right != 0 || required_region.bottom != 0)
+		{
+			region = region.intersect( MoxRect(required_region.left, required_region.top,
+												required_region.right, required_region.bottom) );
+		}
 		
-		assert(frame_rat.Numerator % frame_rat.Denominator == 0);
-		assert(frame_rat.Denominator == 1);
-		assert(frame_time.scale == ae_fps.Numerator || frame_time.value == 0);
 		
-		const int frame = (frame_rat.Denominator == 1 ? frame_rat.Numerator :
-							(double)frame_rat.Numerator / (double)frame_rat.Denominator);
+		// The cache keeps frames at the size AE asked for.  Held frames are
+		// all cached as the first frame that looks like them.
+		const int source_frame = input_file.sourceFrame(frame);
 		
-		file.getFrame(frame, frame_buffer);
+		const MoxFrameCache::Key cache_key(input_file.id(), source_frame, pixel_type, wP->width, wP->height, "ARGB");
 		
+		// In draft, anything no bigger than the proxy can come from it.
+		const bool from_proxy = (sparse_framePPB->qual == AEIO_Qual_DRAFT && !region.empty() &&
+									input_file.drawProxy(source_frame, (char *)wP->data, wP->rowbytes,
+															wP->width, wP->height, pixel_type, region));
 		
-		if(temp_World != NULL)
+		if( !from_proxy && !region.empty() && !g_frame_cache.fetch(cache_key, (char *)wP->data, wP->rowbytes, &region) )
 		{
-			if(sparse_framePPB->qual == AEIO_Qual_HIGH)
-				err = suites.PFWorldTransformSuite()->copy_hq(NULL, temp_World, wP, NULL, NULL);
+			bool whole_frame = true;
+			
+			if(wP->width == head.width() && wP->height == head.height())
+			{
+				whole_frame = DecodeFrame(input_file, frame, pixel_type, wP, region);
+			}
 			else
-				err = suites.PFWorldTransformSuite()->copy(NULL, temp_World, wP, NULL, NULL);
+			{
+				int factor_x, factor_y;
+			
+				if( BoxFactors(sparse_framePPB->rs, head.width(), head.height(), wP, &factor_x, &factor_y) )
+				{
+					// We do the filtering, so the full-size frame doesn't have to be
+					// an AE world.  The buffer comes from the pool.
+					MoxFrame temp_frame(head.width(), head.height(), pixel_type, "ARGB");
+					
+					// only filter the pixels that are needed
+					const MoxRect source_region(region.left * factor_x, region.top * factor_y,
+												region.right * factor_x, region.bottom * factor_y);
+					
+					DecodeFrame(input_file, frame, pixel_type, temp_frame.data(), temp_frame.rowbytes(),
+									temp_frame.width(), temp_frame.height(), source_region);
+					
+					MoxBoxDownsample(temp_frame.data(), temp_frame.rowbytes(), temp_frame.width(), temp_frame.height(),
+										(char *)wP->data, wP->rowbytes, wP->width, wP->height,
+										factor_x, factor_y, pixel_type, &region);
+					
+					whole_frame = region.contains( MoxRect(0, 0, wP->width, wP->height) );
+				}
+				else
+				{
+					// AE scales this one, so it needs a world
+					PF_EffectWorld *temp_World = g_world_pool.get(suites, head.width(), head.height(), pixel_format);
+				
+					try
+					{
+						DecodeFrame(input_file, frame, pixel_type, temp_World, MoxRect(0, 0, temp_World->width, temp_World->height));
+						
+						if(sparse_framePPB->qual == AEIO_Qual_HIGH)
+							err = suites.PFWorldTransformSuite()->copy_hq(NULL, temp_World, wP, NULL, NULL);
+						else
+							err = suites.PFWorldTransformSuite()->copy(NULL, temp_World, wP, NULL, NULL);
+					}
+					catch(...)
+					{
+						g_world_pool.put(temp_World);
+					
+						throw;
+					}
 				
-			err = suites.PFWorldSuite()->PF_DisposeWorld(NULL, temp_World);
+					g_world_pool.put(temp_World);
+				}
+			}
+		
+			if(whole_frame)
+				g_frame_cache.insert(cache_key, (const char *)wP->data, wP->rowbytes);
 		}
 	}
 	catch(ErrThrower &err)
@@ -1102,7 +3014,7 @@ AEIO_GetSound(
 		using namespace MoxFiles;
 	
 		
-		InputFile &file = GetFile(suites, specH, NULL);
+		AEInputFile &input_file = GetInputFile(suites, specH, NULL);
 		
 		
 		A_FpLong sample_rate;
@@ -1142,25 +3054,43 @@ AEIO_GetSound(
 		char *origin = (char *)dataPV;
 		
 		
-		AudioBuffer audio_buffer(num_samplesLu);
+		MoxAudioAhead::ChannelList channels;
 		
 		if(num_channels == AEIO_SndChannels_MONO)
 		{
-			audio_buffer.insert("Mono", AudioSlice(sample_type, origin + (channel_size * 0), stride));
+			channels.push_back( MoxAudioAhead::Channel("Mono", origin + (channel_size * 0), stride) );
 		}
 		else
 		{
-			audio_buffer.insert("Left", AudioSlice(sample_type, origin + (channel_size * 0), stride));
-			audio_buffer.insert("Right", AudioSlice(sample_type, origin + (channel_size * 1), stride));
+			channels.push_back( MoxAudioAhead::Channel("Left", origin + (channel_size * 0), stride) );
+			channels.push_back( MoxAudioAhead::Channel("Right", origin + (channel_size * 1), stride) );
 		}
 		
 		
 		assert(start_sampLu == (A_u_long)((double)sample_rate * (double)startPT->value / (double)startPT->scale));
 		assert(num_samplesLu == (A_u_long)((double)sample_rate * (double)durPT->value / (double)durPT->scale));
 		
-		file.seekAudio(start_sampLu);
+		// During playback this is usually already read.  AE asks for
+		// AEIO_SndQuality_APPROX to draw waveforms, but AEIO has no way to
+		// hand it peaks, so those decode the real samples too.  The saved
+		// peaks are only used by Premiere.
+		MoxAudioAhead *audio_ahead = input_file.audioAhead();
 		
-		file.readAudio(num_samplesLu, audio_buffer);
+		if(audio_ahead == NULL || !audio_ahead->read(start_sampLu, num_samplesLu, sample_type, channels))
+		{
+			AudioBuffer audio_buffer(num_samplesLu);
+			
+			for(MoxAudioAhead::ChannelList::const_iterator i = channels.begin(); i != channels.end(); ++i)
+				audio_buffer.insert(i->name, AudioSlice(sample_type, i->base, i->stride));
+			
+			AEReader reader(input_file);
+			
+			InputFile &file = reader.file();
+			
+			file.seekAudio(start_sampLu);
+			
+			file.readAudio(num_samplesLu, audio_buffer);
+		}
 	}
 	catch(ErrThrower &err)
 	{
@@ -1186,15 +3116,7 @@ AEIO_DisposeInSpec(
 
 	try
 	{
-		std::map<AEIO_InSpecH, AEInputFile *>::iterator file = g_infiles.find(specH);
-	
-		if(file != g_infiles.end())
-		{
-			delete file->second;
-		
-			g_infiles.erase(file);
-		}
-		else
+		if( !g_infiles.close(specH) )
 			assert(false); // where's the file?
 		
 		
@@ -1229,6 +3151,17 @@ AEIO_CloseSourceFiles(
 	AEIO_BasicData	*basic_dataP,
 	AEIO_InSpecH			seqH)
 { 
+	// AE wants its memory back, so let go of what we can
+	try
+	{
+		AEGP_SuiteHandler suites(basic_dataP->pica_basicP);
+		
+		g_stream_pool.closeIdle(0);
+		
+		TrimMemory(suites, gMemoryTarget);
+	}
+	catch(...) {}
+
 	return A_Err_NONE; 
 }		// TRUE for close, FALSE for unclose
 
@@ -1762,9 +3695,6 @@ AEIO_StartAdding(
 		
 		using namespace MoxFiles;
 	
-		if( supportsThreads() )
-			setGlobalThreadCount(gNumCPUs);
-		
 
 		// get file path
 	#ifdef AE_UNICODE_PATHS
@@ -1961,7 +3891,7 @@ AEIO_StartAdding(
 		
 		if(g_outfiles.find(outH) == g_outfiles.end())
 		{
-			AEOutputFile *outputFile = new AEOutputFile(file_pathZ, head);
+			AEOutputFile *outputFile = new AEOutputFile(file_pathZ, head, (depth > 0 && have_alpha), gWriteProxies);
 		
 			g_outfiles[outH] = outputFile;
 		}
@@ -2042,34 +3972,17 @@ AEIO_AddFrame(
 												pixel_format == PF_PixelFormat_ARGB128 ? MoxFiles::FLOAT :
 												MoxFiles::UINT8);
 		
-		const size_t subpixel_size = PixelSize(pixel_type);
-		const size_t pixel_size = 4 * subpixel_size;
-		const ptrdiff_t rowbytes = wP->rowbytes;
-		
-		const double rgb_fill = 0;
-		const double alpha_fill = (pixel_type == MoxFiles::UINT8 ? 255 :
-									pixel_type == MoxFiles::UINT16A ? 32768 :
-									pixel_type == MoxFiles::FLOAT ? 1.0 :
-									0);
-		
-		char *origin = (char *)wP->data;
-		
+		AEOutputFile &output_file = *g_outfiles[outH];
 		
-		FrameBuffer frame_buffer(wP->width, wP->height);
+		assert(wP->width == output_file.header().width());
+		assert(wP->height == output_file.header().height());
 		
-		frame_buffer.insert("A", Slice(pixel_type, origin + (subpixel_size * 0), pixel_size, rowbytes, 1, 1, alpha_fill));
-		frame_buffer.insert("R", Slice(pixel_type, origin + (subpixel_size * 1), pixel_size, rowbytes, 1, 1, rgb_fill));
-		frame_buffer.insert("G", Slice(pixel_type, origin + (subpixel_size * 2), pixel_size, rowbytes, 1, 1, rgb_fill));
-		frame_buffer.insert("B", Slice(pixel_type, origin + (subpixel_size * 3), pixel_size, rowbytes, 1, 1, rgb_fill));
+		// AE hands us a held frame once with the number of frames it's held for.
+		// The queue copies it and gets back to AE, the encoding happens later.
+		const int repeats = (frames > 1 ? frames : 1);
 		
-		
-		OutputFile &file = g_outfiles[outH]->file();
-		
-		assert(wP->width == file.header().width());
-		assert(wP->height == file.header().height());
-		assert(frames == 1);
-		
-		file.pushFrame(frame_buffer);
+		output_file.queue().pushFrame(frame_index, repeats, (const char *)wP->data, wP->rowbytes,
+										wP->width, wP->height, pixel_type, "ARGB");
 	}
 	catch(ErrThrower &err)
 	{
@@ -2155,32 +4068,21 @@ AEIO_AddSoundChunk(
 			assert(sound_encoding == AEIO_E_SIGNED_PCM);
 		
 		
-		const int number_channels = (num_channels == AEIO_SndChannels_MONO ? 1 : 2);
-		const size_t channel_size = (sample_size == AEIO_SS_1 ? 1 :
-										sample_size == AEIO_SS_2 ? 2 :
-										sample_size == AEIO_SS_4 ? 4 :
-										1);
-		const ptrdiff_t stride = number_channels * channel_size;
-		
-		char *origin = (char *)dataPV;
-		
-		
-		AudioBuffer audio_buffer(num_samplesLu);
+		// interleaved, in the order they were put in the header
+		std::vector<std::string> names;
 		
 		if(num_channels == AEIO_SndChannels_MONO)
 		{
-			audio_buffer.insert("Mono", AudioSlice(sample_type, origin + (channel_size * 0), stride));
+			names.push_back("Mono");
 		}
 		else
 		{
-			audio_buffer.insert("Left", AudioSlice(sample_type, origin + (channel_size * 0), stride));
-			audio_buffer.insert("Right", AudioSlice(sample_type, origin + (channel_size * 1), stride));
+			names.push_back("Left");
+			names.push_back("Right");
 		}
 		
 		
-		OutputFile &file = g_outfiles[outH]->file();
-		
-		file.pushAudio(audio_buffer);
+		g_outfiles[outH]->queue().pushAudio(num_samplesLu, sample_type, (const char *)dataPV, names);
 	}
 	catch(ErrThrower &err)
 	{
@@ -2225,15 +4127,30 @@ AEIO_EndAdding(
 	
 		if(file != g_outfiles.end())
 		{
-			file->second->file().finalize();
-		
-			delete file->second;
-		
+			AEOutputFile *output_file = file->second;
+			
 			g_outfiles.erase(file);
+			
+			try
+			{
+				output_file->finish(); // the queue throws here if a background write failed
+			}
+			catch(...)
+			{
+				delete output_file;
+				
+				throw;
+			}
+		
+			delete output_file;
 		}
 		else
 			assert(false); // where is the file?
 	}
+	catch(MoxMxf::IoExc &e)
+	{
+		ae_err = AEIO_Err_DISK_FULL;
+	}
 	catch(...)
 	{
 		ae_err = AEIO_Err_PARSING;
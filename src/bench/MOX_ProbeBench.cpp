@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in benchmarks
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+// How long MoxProbe takes to say yes or no to a file, next to opening the
+// same file as an InputFile, which is what AEIO_VerifyFileImportable used
+// to leave to AEIO_InitInSpecFromFile.  Both open the file each time, so
+// that's counted too.  Each is repeated in batches for at least a quarter
+// second, the clock only counts milliseconds.
+//
+// MOX_ProbeBench [-n iterations] file...
+
+#include "MOX_Probe.h"
+#include "MOX_Platform.h"
+
+#include <MoxFiles/InputFile.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const MoxMxf::UInt64 MinimumMilliseconds = 250;
+
+
+static double
+Microseconds(MoxMxf::UInt64 start, int calls)
+{
+	return (double)(MoxMilliseconds() - start) * 1000.0 / (double)calls;
+}
+
+
+static void
+BenchFile(const std::string &path, int iterations)
+{
+	bool probed = false;
+	int calls = 0;
+	
+	MoxMxf::UInt64 start = MoxMilliseconds();
+	
+	do{
+		for(int i = 0; i < iterations; i++)
+		{
+			MoxFileStream stream(path, false);
+			
+			probed = MoxProbe(stream);
+		}
+		
+		calls += iterations;
+		
+	}while(MoxMilliseconds() - start < MinimumMilliseconds);
+	
+	const double probe_us = Microseconds(start, calls);
+	
+	
+	bool opened = true;
+	calls = 0;
+	
+	start = MoxMilliseconds();
+	
+	do{
+		for(int i = 0; i < iterations && opened; i++)
+		{
+			try
+			{
+				MoxFileStream stream(path, false);
+				
+				MoxFiles::InputFile file(stream);
+			}
+			catch(...)
+			{
+				opened = false;
+			}
+		}
+		
+		calls += iterations;
+		
+	}while(opened && MoxMilliseconds() - start < MinimumMilliseconds);
+	
+	const double open_us = Microseconds(start, calls);
+	
+	
+	printf("%s\n", path.c_str());
+	printf("  probe  %10.2f us  %s\n", probe_us, probed ? "yes" : "no");
+	
+	if(opened)
+		printf("  open   %10.2f us  (%.0fx the probe)\n", open_us, open_us / probe_us);
+	else
+		printf("  open   failed\n");
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	int iterations = 200;
+	int first_file = 1;
+	
+	if(argc > 2 && strcmp(argv[1], "-n") == 0)
+	{
+		iterations = atoi(argv[2]);
+		first_file = 3;
+	}
+	
+	if(first_file >= argc || iterations < 1)
+	{
+		fprintf(stderr, "usage: %s [-n iterations] file...\n", argv[0]);
+		
+		return 1;
+	}
+	
+	for(int i = first_file; i < argc; i++)
+	{
+		try
+		{
+			BenchFile(argv[i], iterations);
+		}
+		catch(...)
+		{
+			printf("%s\n  couldn't open\n", argv[i]);
+		}
+	}
+	
+	return 0;
+}
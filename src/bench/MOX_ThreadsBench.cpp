@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in benchmarks
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+// What the thread count costs at each entry point.  Before MoxGlobalThreads,
+// every open, draw and export called setGlobalThreadCount, and every close
+// set it back to 0, so the pool could be torn down and started again
+// between one frame and the next.  This times a call the old ways and the
+// way it's done now, with the count set once at load.
+//
+// MOX_ThreadsBench [-n calls] [-t threads]
+
+#include "MOX_Threads.h"
+#include "MOX_Platform.h"
+
+#include <MoxFiles/Thread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static void
+Report(const char *name, MoxMxf::UInt64 start, int calls)
+{
+	const double us = (double)(MoxMilliseconds() - start) * 1000.0 / (double)calls;
+	
+	printf("  %-28s %10.2f us per call\n", name, us);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	int calls = 1000;
+	int threads = 8;
+	
+	for(int i = 1; i + 1 < argc; i += 2)
+	{
+		if(strcmp(argv[i], "-n") == 0)
+			calls = atoi(argv[i + 1]);
+		else if(strcmp(argv[i], "-t") == 0)
+			threads = atoi(argv[i + 1]);
+	}
+	
+	if(calls < 1 || threads < 1 || !MoxFiles::supportsThreads())
+	{
+		fprintf(stderr, "usage: %s [-n calls] [-t threads]\n", argv[0]);
+		
+		return 1;
+	}
+	
+	printf("%d calls, %d threads\n", calls, threads);
+	
+	
+	// every draw
+	MoxMxf::UInt64 start = MoxMilliseconds();
+	
+	for(int i = 0; i < calls; i++)
+		MoxFiles::setGlobalThreadCount(threads);
+	
+	Report("set on every call", start, calls);
+	
+	MoxFiles::setGlobalThreadCount(0);
+	
+	
+	// every open and close
+	start = MoxMilliseconds();
+	
+	for(int i = 0; i < calls; i++)
+	{
+		MoxFiles::setGlobalThreadCount(threads);
+		MoxFiles::setGlobalThreadCount(0);
+	}
+	
+	Report("set, then 0 on close", start, calls);
+	
+	
+	// Now it's set once at load and the entry points leave it alone.
+	// Setting the same count again, like a prefs reload, changes nothing.
+	start = MoxMilliseconds();
+	
+	MoxGlobalThreads::acquire(threads);
+	
+	for(int i = 0; i < calls; i++)
+		MoxGlobalThreads::setThreadCount(threads);
+	
+	MoxGlobalThreads::release();
+	
+	Report("set once at load", start, calls);
+	
+	return 0;
+}
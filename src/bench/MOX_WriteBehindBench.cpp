@@ -0,0 +1,315 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in benchmarks
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+// Export throughput with and without MoxWriteBehindStream, on a file
+// stream slowed down to look like a network drive.  Every write call
+// waits out a round trip, and the bytes go no faster than the bandwidth
+// allows.  The writes look like a movie being exported: small KLV keys
+// and lengths, one frame of essence, a little index, and finally a seek
+// back to patch the header.  The two files are compared at the end.
+//
+// MOX_WriteBehindBench [-l latency_us] [-b megabytes_per_second]
+//                      [-s megabytes] [-f frame_kilobytes] [-c chunk_megabytes] path
+
+#include "MOX_WriteBehind.h"
+#include "MOX_Platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+
+static void
+SleepMilliseconds(unsigned int ms)
+{
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	usleep(ms * 1000);
+#endif
+}
+
+
+class ThrottledStream : public MoxMxf::IOStream
+{
+  public:
+	ThrottledStream(MoxMxf::IOStream *stream, unsigned int latency_us, double bytes_per_us) :
+		_stream(stream),
+		_latency_us(latency_us),
+		_bytes_per_us(bytes_per_us),
+		_owed_us(0),
+		_writes(0)
+	{}
+	
+	virtual ~ThrottledStream() { delete _stream; }
+	
+	virtual int FileSeek(MoxMxf::UInt64 offset) { return _stream->FileSeek(offset); }
+	virtual MoxMxf::UInt64 FileRead(unsigned char *dest, MoxMxf::UInt64 size) { return _stream->FileRead(dest, size); }
+	virtual MoxMxf::UInt64 FileTell() { return _stream->FileTell(); }
+	virtual void FileFlush() { _stream->FileFlush(); }
+	virtual void FileTruncate(MoxMxf::Int64 newsize) { _stream->FileTruncate(newsize); }
+	virtual MoxMxf::Int64 FileSize() { return _stream->FileSize(); }
+	
+	virtual MoxMxf::UInt64 FileWrite(const unsigned char *source, MoxMxf::UInt64 size)
+	{
+		_writes++;
+		
+		// sleeps are in whole milliseconds, so keep the change for next time
+		_owed_us += _latency_us + (MoxMxf::UInt64)((double)size / _bytes_per_us);
+		
+		if(_owed_us >= 1000)
+		{
+			SleepMilliseconds((unsigned int)(_owed_us / 1000));
+			
+			_owed_us %= 1000;
+		}
+		
+		return _stream->FileWrite(source, size);
+	}
+	
+	unsigned long writes() const { return _writes; }
+	
+  private:
+	MoxMxf::IOStream *_stream;
+	const unsigned int _latency_us;
+	const double _bytes_per_us;
+	MoxMxf::UInt64 _owed_us;
+	unsigned long _writes;
+};
+
+
+struct Options
+{
+	unsigned int latency_us;
+	double megabytes_per_second;
+	size_t total_bytes;
+	size_t frame_bytes;
+	size_t chunk_bytes;
+	
+	Options() : latency_us(500), megabytes_per_second(100.0), total_bytes(256 * 1024 * 1024),
+				frame_bytes(512 * 1024), chunk_bytes(8 * 1024 * 1024) {}
+};
+
+
+static void
+WriteMovie(MoxMxf::IOStream &stream, const Options &options)
+{
+	const size_t header_bytes = 64 * 1024;
+	
+	std::vector<unsigned char> data(options.frame_bytes > header_bytes ? options.frame_bytes : header_bytes);
+	
+	for(size_t i = 0; i < data.size(); i++)
+		data[i] = (unsigned char)((i * 7) ^ (i >> 8));
+	
+	// header, written once now and patched at the end
+	stream.FileWrite(&data[0], header_bytes);
+	
+	size_t written = header_bytes;
+	int frame = 0;
+	
+	while(written < options.total_bytes)
+	{
+		unsigned char key[16];
+		unsigned char length[4];
+		unsigned char index[48];
+		
+		memset(key, frame & 0xff, sizeof(key));
+		memset(length, 0x83, sizeof(length));
+		memset(index, (frame * 3) & 0xff, sizeof(index));
+		
+		data[0] = (unsigned char)frame;
+		
+		stream.FileWrite(key, sizeof(key));
+		stream.FileWrite(length, sizeof(length));
+		stream.FileWrite(&data[0], options.frame_bytes);
+		stream.FileWrite(key, sizeof(key));
+		stream.FileWrite(index, sizeof(index));
+		
+		written += sizeof(key) + sizeof(length) + options.frame_bytes + sizeof(key) + sizeof(index);
+		frame++;
+	}
+	
+	// finalize patches the header and footer
+	memset(&data[0], 0xee, 256);
+	
+	stream.FileSeek(0);
+	stream.FileWrite(&data[0], 256);
+	
+	stream.FileFlush();
+}
+
+
+static double
+WriteFile(const std::string &path, const Options &options, bool write_behind, unsigned long *writes)
+{
+	const MoxMxf::UInt64 start = MoxMilliseconds();
+	
+	ThrottledStream *throttled = new ThrottledStream(new MoxFileStream(path, true), options.latency_us,
+														options.megabytes_per_second * 1024.0 * 1024.0 / 1000000.0);
+	
+	if(write_behind)
+	{
+		MoxWriteBehindStream::Settings settings;
+		
+		settings.chunk_size = options.chunk_bytes;
+		
+		MoxWriteBehindStream stream(throttled, settings);
+		
+		WriteMovie(stream, options);
+		
+		*writes = throttled->writes(); // the flush waited for all of it
+	}
+	else
+	{
+		WriteMovie(*throttled, options);
+		
+		*writes = throttled->writes();
+		
+		delete throttled;
+	}
+	
+	const MoxMxf::UInt64 elapsed = MoxMilliseconds() - start;
+	
+	return (double)options.total_bytes / (1024.0 * 1024.0) / ((double)(elapsed > 0 ? elapsed : 1) / 1000.0);
+}
+
+
+static bool
+SameFiles(const std::string &a, const std::string &b)
+{
+	MoxFileStream stream_a(a, false);
+	MoxFileStream stream_b(b, false);
+	
+	if(stream_a.FileSize() != stream_b.FileSize())
+		return false;
+	
+	std::vector<unsigned char> buffer_a(1024 * 1024), buffer_b(1024 * 1024);
+	
+	while(true)
+	{
+		const MoxMxf::UInt64 got_a = stream_a.FileRead(&buffer_a[0], buffer_a.size());
+		const MoxMxf::UInt64 got_b = stream_b.FileRead(&buffer_b[0], buffer_b.size());
+		
+		if(got_a != got_b || memcmp(&buffer_a[0], &buffer_b[0], (size_t)got_a) != 0)
+			return false;
+		
+		if(got_a < buffer_a.size())
+			return true;
+	}
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	Options options;
+	
+	int i = 1;
+	
+	for( ; i + 1 < argc && argv[i][0] == '-'; i += 2)
+	{
+		const double value = atof(argv[i + 1]);
+		
+		if(strcmp(argv[i], "-l") == 0)
+			options.latency_us = (unsigned int)value;
+		else if(strcmp(argv[i], "-b") == 0)
+			options.megabytes_per_second = value;
+		else if(strcmp(argv[i], "-s") == 0)
+			options.total_bytes = (size_t)(value * 1024 * 1024);
+		else if(strcmp(argv[i], "-f") == 0)
+			options.frame_bytes = (size_t)(value * 1024);
+		else if(strcmp(argv[i], "-c") == 0)
+			options.chunk_bytes = (size_t)(value * 1024 * 1024);
+	}
+	
+	if(i + 1 != argc || options.megabytes_per_second <= 0 || options.frame_bytes == 0 || options.chunk_bytes == 0)
+	{
+		fprintf(stderr, "usage: %s [-l latency_us] [-b megabytes_per_second] [-s megabytes] "
+						"[-f frame_kilobytes] [-c chunk_megabytes] path\n", argv[0]);
+		
+		return 1;
+	}
+	
+	const std::string direct_path = std::string(argv[i]) + ".direct";
+	const std::string behind_path = std::string(argv[i]) + ".behind";
+	
+	printf("%u us per write, %.0f MB/s, %.0f MB in %.0f KB frames, %.0f MB chunks\n",
+			options.latency_us, options.megabytes_per_second, (double)options.total_bytes / (1024 * 1024),
+			(double)options.frame_bytes / 1024, (double)options.chunk_bytes / (1024 * 1024));
+	
+	int result = 0;
+	
+	try
+	{
+		unsigned long writes = 0;
+		
+		const double direct = WriteFile(direct_path, options, false, &writes);
+		
+		printf("  direct        %8.1f MB/s  %8lu writes\n", direct, writes);
+		
+		const double behind = WriteFile(behind_path, options, true, &writes);
+		
+		printf("  write-behind  %8.1f MB/s  %8lu writes\n", behind, writes);
+		
+		if( !SameFiles(direct_path, behind_path) )
+		{
+			printf("  the files are different!\n");
+			
+			result = 1;
+		}
+	}
+	catch(...)
+	{
+		printf("  couldn't write %s\n", argv[i]);
+		
+		result = 1;
+	}
+	
+	MoxFileDelete(direct_path);
+	MoxFileDelete(behind_path);
+	
+	return result;
+}
@@ -0,0 +1,463 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_AudioAhead.h"
+
+#include "MOX_Memory.h"
+#include "MOX_BufferPool.h"
+
+#include <algorithm>
+
+#include <string.h>
+#include <assert.h>
+
+
+MoxWorkerPool MoxAudioAhead::_pool(1);
+
+static const MoxMxf::UInt64 NO_POSITION = (MoxMxf::UInt64)-1;
+
+
+MoxAudioAhead::MoxAudioAhead(MoxStreamSource *source, MoxMxf::UInt64 length, const Settings &settings) :
+	MoxBackgroundWriter(_pool, settings.samples > 0 && settings.chunk > 0),
+	_source(source),
+	_length(length),
+	_settings(settings),
+	_capacity(0),
+	_shutting_down(false),
+	_type(MoxFiles::AFLOAT),
+	_sample_size(0),
+	_start(0),
+	_end(0),
+	_cursor(NO_POSITION),
+	_stop(false),
+	_stream(NULL),
+	_file(NULL),
+	_file_position(NO_POSITION)
+{
+	if(source == NULL)
+		throw MoxMxf::NullExc("Null source");
+	
+	// whole chunks, so a read never wraps around the end
+	if( threaded() )
+		_capacity = ((_settings.samples + _settings.chunk - 1) / _settings.chunk) * _settings.chunk;
+}
+
+
+MoxAudioAhead::~MoxAudioAhead()
+{
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		_shutting_down = true;
+	}
+	
+	stopWriter();
+	
+	freeRing();
+	
+	closeDecoder();
+	
+	delete _source;
+}
+
+
+bool
+MoxAudioAhead::read(MoxMxf::UInt64 position, MoxMxf::UInt64 count, MoxFiles::SampleType type, const ChannelList &channels)
+{
+	if(!threaded() || count == 0 || count > _capacity || channels.empty())
+		return false;
+	
+	IlmThread::Lock lock(_mutex);
+	
+	if( !matches(type, channels) )
+	{
+		waitForRefill(lock);
+		
+		// the caller can still read the file itself
+		if( !setFormat(type, channels) )
+			return false;
+	}
+	
+	const bool sequential = (position == _cursor);
+	
+	_cursor = position + count;
+	
+	bool hit = false;
+	
+	if(position >= _start && (position < _end || (position == _end && busy())))
+	{
+		// done with what came before, so the ring can move up
+		_start = position;
+		
+		// the rest might be on the way
+		while(position + count > _end && busy())
+			waitForWriter(lock);
+		
+		if(position + count <= _end)
+		{
+			copyOut(position, count, channels);
+			
+			hit = true;
+		}
+	}
+	
+	if(!hit)
+	{
+		// the caller is reading this part, we'll start after it
+		waitForRefill(lock);
+		
+		_start = _end = _cursor;
+	}
+	
+	const bool refill = (hit || sequential) && startRefill();
+	
+	lock.release();
+	
+	if(refill)
+		start();
+	
+	return hit;
+}
+
+
+void
+MoxAudioAhead::reset(MoxMxf::UInt64 length)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	waitForRefill(lock);
+	
+	_length = length;
+	
+	_start = _end = 0;
+	_cursor = NO_POSITION;
+	
+	closeDecoder();
+}
+
+
+bool
+MoxAudioAhead::release(bool wait)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	if(wait)
+	{
+		waitForRefill(lock);
+	}
+	else if( busy() )
+	{
+		_stop = true;
+		
+		return false;
+	}
+	
+	freeRing();
+	
+	closeDecoder();
+	
+	_start = _end = 0;
+	_cursor = NO_POSITION;
+	
+	return true;
+}
+
+
+MoxMxf::UInt64
+MoxAudioAhead::audioLength(const MoxFiles::Header &head)
+{
+	const MoxFiles::Rational &frame_rate = head.frameRate();
+	const MoxFiles::Rational &sample_rate = head.sampleRate();
+	
+	if(frame_rate.Numerator <= 0 || sample_rate.Denominator <= 0)
+		return 0;
+	
+	return ((MoxMxf::UInt64)head.duration() * (MoxMxf::UInt64)sample_rate.Numerator * (MoxMxf::UInt64)frame_rate.Denominator) /
+			((MoxMxf::UInt64)sample_rate.Denominator * (MoxMxf::UInt64)frame_rate.Numerator);
+}
+
+
+void
+MoxAudioAhead::shutdown()
+{
+	_pool.shutdown();
+}
+
+
+bool
+MoxAudioAhead::matches(MoxFiles::SampleType type, const ChannelList &channels) const
+{
+	if(_ring.empty() || type != _type || channels.size() != _names.size())
+		return false;
+	
+	for(size_t c = 0; c < channels.size(); c++)
+	{
+		if(channels[c].name != _names[c])
+			return false;
+	}
+	
+	return true;
+}
+
+
+bool
+MoxAudioAhead::setFormat(MoxFiles::SampleType type, const ChannelList &channels)
+{
+	assert( !busy() );
+
+	freeRing();
+	
+	_type = type;
+	_sample_size = MoxFiles::SampleBits(type) / 8;
+	
+	_start = _end = 0;
+	
+	try
+	{
+		// so push_back can't throw after a buffer is allocated
+		_ring.reserve( channels.size() );
+		
+		for(ChannelList::const_iterator i = channels.begin(); i != channels.end(); ++i)
+		{
+			_ring.push_back( (char *)MoxBufferPool::allocate(_capacity * _sample_size) );
+			
+			MoxMemory::add(MoxMemory::AUDIO, _capacity * _sample_size);
+			
+			_names.push_back(i->name);
+		}
+	}
+	catch(...)
+	{
+		// probably the buffer pool's limit
+		freeRing();
+		
+		return false;
+	}
+	
+	return true;
+}
+
+
+void
+MoxAudioAhead::freeRing()
+{
+	for(std::vector<char *>::iterator i = _ring.begin(); i != _ring.end(); ++i)
+	{
+		MoxBufferPool::release(*i, _capacity * _sample_size);
+		
+		MoxMemory::remove(MoxMemory::AUDIO, _capacity * _sample_size);
+	}
+	
+	_ring.clear();
+	_names.clear();
+}
+
+
+void
+MoxAudioAhead::copyOut(MoxMxf::UInt64 position, MoxMxf::UInt64 count, const ChannelList &channels) const
+{
+	assert(position >= _start && position + count <= _end);
+
+	for(size_t c = 0; c < channels.size(); c++)
+	{
+		const Channel &channel = channels[c];
+		
+		MoxMxf::UInt64 done = 0;
+		
+		// at most two runs, one before the end of the ring and one after
+		while(done < count)
+		{
+			const size_t index = (position + done) % _capacity;
+			const size_t run = (size_t)std::min<MoxMxf::UInt64>(count - done, _capacity - index);
+			
+			const char *in = _ring[c] + (index * _sample_size);
+			char *out = channel.base + ((ptrdiff_t)done * channel.stride);
+			
+			if(channel.stride == (ptrdiff_t)_sample_size)
+			{
+				memcpy(out, in, run * _sample_size);
+			}
+			else
+			{
+				for(size_t i = 0; i < run; i++)
+				{
+					memcpy(out, in, _sample_size);
+					
+					in += _sample_size;
+					out += channel.stride;
+				}
+			}
+			
+			done += run;
+		}
+	}
+}
+
+
+bool
+MoxAudioAhead::startRefill()
+{
+	if(busy() || _shutting_down || _ring.empty())
+		return false;
+	
+	const MoxMxf::UInt64 limit = std::min<MoxMxf::UInt64>(_length, _start + _capacity);
+	
+	if(_end >= limit)
+		return false;
+	
+	_stop = false;
+	
+	return markBusy();
+}
+
+
+void
+MoxAudioAhead::waitForRefill(IlmThread::Lock &lock)
+{
+	// stops after the read it's doing now
+	_stop = true;
+	
+	waitUntilIdle(lock);
+	
+	_stop = false;
+}
+
+
+void
+MoxAudioAhead::closeDecoder()
+{
+	assert( !busy() );
+
+	if(_file != NULL)
+	{
+		MoxMemory::remove(MoxMemory::DECODERS, MoxMemory::decoderBytes(_file->header()));
+		
+		delete _file;
+		_file = NULL;
+	}
+	
+	delete _stream;
+	_stream = NULL;
+	
+	_file_position = NO_POSITION;
+}
+
+
+void
+MoxAudioAhead::writeLoop()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	assert( busy() );
+	
+	while(!_stop && !_shutting_down)
+	{
+		const MoxMxf::UInt64 limit = std::min<MoxMxf::UInt64>(_length, _start + _capacity);
+		
+		if(_end >= limit)
+			break;
+		
+		// read up to the next chunk boundary
+		const MoxMxf::UInt64 from = _end;
+		const MoxMxf::UInt64 to = std::min<MoxMxf::UInt64>(limit, ((from / _settings.chunk) + 1) * _settings.chunk);
+		
+		const size_t index = from % _capacity;
+		
+		assert(index + (to - from) <= _capacity);
+		
+		const bool seek = (_file_position != from);
+		
+		// nobody touches the ring past _end or the decoder while we're busy
+		lock.release();
+		
+		
+		bool success = true;
+		
+		try
+		{
+			if(_file == NULL)
+			{
+				if(_stream == NULL)
+					_stream = _source->openStream();
+				
+				_file = new MoxFiles::InputFile(*_stream);
+				
+				_source->fileOpened(*_stream);
+				
+				MoxMemory::add(MoxMemory::DECODERS, MoxMemory::decoderBytes(_file->header()));
+			}
+			
+			if(seek)
+				_file->seekAudio(from);
+			
+			MoxFiles::AudioBuffer buffer(to - from);
+			
+			for(size_t c = 0; c < _ring.size(); c++)
+			{
+				buffer.insert(_names[c], MoxFiles::AudioSlice(_type, _ring[c] + (index * _sample_size), _sample_size));
+			}
+			
+			_file->readAudio(to - from, buffer);
+		}
+		catch(...)
+		{
+			success = false;
+		}
+		
+		
+		lock.acquire();
+		
+		if(success)
+		{
+			_file_position = to;
+			
+			_end = to;
+		}
+		else
+		{
+			// the host will read it itself
+			_file_position = NO_POSITION;
+			
+			break;
+		}
+		
+		wakeWaiters();
+	}
+	
+	writerDone();
+}
@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_AUDIOAHEAD_H
+#define MOX_AUDIOAHEAD_H
+
+#include "MOX_StreamPool.h"
+#include "MOX_BackgroundWriter.h"
+
+#include <MoxFiles/InputFile.h>
+
+#include <string>
+#include <vector>
+
+// Hosts play audio by asking for one chunk after another.  Once a request
+// picks up where the last one ended, MoxAudioAhead keeps reading past it
+// on a background thread into a ring of samples, so the following requests
+// are copied out without a seek.  It has its own InputFile for this, and
+// the ring holds samples exactly as the host last asked for them.
+// The refill is the background writer, writing into the ring.
+
+class MoxAudioAhead : private MoxBackgroundWriter
+{
+  public:
+	struct Settings
+	{
+		size_t samples;	// ring length per channel, 0 turns it off
+		size_t chunk;	// samples per background read, the ring is a multiple of this
+		
+		Settings() : samples(1 << 19), chunk(1 << 15) {}
+	};
+	
+	struct Channel
+	{
+		std::string name;
+		char *base;
+		ptrdiff_t stride;
+		
+		Channel(const std::string &n, char *b, ptrdiff_t s) : name(n), base(b), stride(s) {}
+	};
+	
+	typedef std::vector<Channel> ChannelList;
+	
+	// length is the number of samples in the file
+	MoxAudioAhead(MoxStreamSource *source, MoxMxf::UInt64 length, const Settings &settings); // takes ownership of source
+	~MoxAudioAhead();
+	
+	// Call this for every audio request.  Returns true if the samples were
+	// in the ring and have been copied out, otherwise the caller reads them.
+	bool read(MoxMxf::UInt64 position, MoxMxf::UInt64 count, MoxFiles::SampleType type, const ChannelList &channels);
+	
+	// The file has been written over.
+	void reset(MoxMxf::UInt64 length);
+	
+	// Free the ring and close the decoder.  Returns false if a read is
+	// still running, unless we wait for it.
+	bool release(bool wait = false);
+	
+	// samples in a file, going by the video duration
+	static MoxMxf::UInt64 audioLength(const MoxFiles::Header &head);
+	
+	static void shutdown();
+	
+  private:
+	MoxStreamSource *_source;
+	MoxMxf::UInt64 _length;
+	const Settings _settings;
+	size_t _capacity;
+	
+	bool _shutting_down;
+	
+	MoxFiles::SampleType _type;
+	std::vector<std::string> _names;
+	std::vector<char *> _ring;
+	size_t _sample_size;
+	
+	MoxMxf::UInt64 _start; // samples in the ring
+	MoxMxf::UInt64 _end;
+	MoxMxf::UInt64 _cursor; // where the last request ended
+	
+	bool _stop;
+	
+	MoxMxf::IOStream *_stream;
+	MoxFiles::InputFile *_file;
+	MoxMxf::UInt64 _file_position;
+	
+	bool matches(MoxFiles::SampleType type, const ChannelList &channels) const;
+	bool setFormat(MoxFiles::SampleType type, const ChannelList &channels); // false if there wasn't memory
+	void freeRing();
+	void copyOut(MoxMxf::UInt64 position, MoxMxf::UInt64 count, const ChannelList &channels) const;
+	bool startRefill(); // true means start() once the lock is released
+	void waitForRefill(IlmThread::Lock &lock);
+	void closeDecoder();
+	
+	virtual void writeLoop(); // the refill
+	
+	static MoxWorkerPool _pool; // every file shares one thread
+	
+	MoxAudioAhead(const MoxAudioAhead &);
+	MoxAudioAhead & operator = (const MoxAudioAhead &);
+};
+
+#endif // MOX_AUDIOAHEAD_H
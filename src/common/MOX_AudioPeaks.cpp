@@ -0,0 +1,266 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_AudioPeaks.h"
+
+#include "MOX_Bytes.h"
+
+#include <assert.h>
+
+
+static short
+PeakValue(float value)
+{
+	const float scaled = value * 32767.f;
+
+	return (scaled >= 32767.f ? 32767 :
+			scaled <= -32767.f ? -32767 :
+			(short)(scaled + (scaled >= 0.f ? 0.5f : -0.5f)));
+}
+
+
+MoxAudioPeaks::MoxAudioPeaks(int samples_per_peak) :
+	_samples_per_peak(samples_per_peak > 0 ? samples_per_peak : 256),
+	_channels(0),
+	_length(0),
+	_bad(false),
+	_pending(0)
+{
+}
+
+
+void
+MoxAudioPeaks::add(MoxMxf::UInt64 count, MoxFiles::SampleType type, const std::vector<const char *> &channels, ptrdiff_t stride)
+{
+	if(_bad || count == 0 || channels.empty())
+		return;
+	
+	if(_channels == 0)
+	{
+		_channels = channels.size();
+		
+		_low.assign(_channels, 0.f);
+		_high.assign(_channels, 0.f);
+	}
+	
+	if(_channels != (int)channels.size() ||
+		(type != MoxFiles::UNSIGNED8 && type != MoxFiles::SIGNED16 && type != MoxFiles::AFLOAT))
+	{
+		clear();
+		
+		_bad = true;
+		
+		return;
+	}
+	
+	for(MoxMxf::UInt64 i = 0; i < count; i++)
+	{
+		for(int c = 0; c < _channels; c++)
+		{
+			const char *in = channels[c] + ((ptrdiff_t)i * stride);
+			
+			const float value = (type == MoxFiles::UNSIGNED8 ? ((float)*(const unsigned char *)in - 128.f) / 128.f :
+									type == MoxFiles::SIGNED16 ? (float)*(const short *)in / 32768.f :
+									*(const float *)in);
+			
+			if(_pending == 0)
+			{
+				_low[c] = _high[c] = value;
+			}
+			else if(value < _low[c])
+			{
+				_low[c] = value;
+			}
+			else if(value > _high[c])
+			{
+				_high[c] = value;
+			}
+		}
+		
+		_pending++;
+		
+		if(_pending == _samples_per_peak)
+			finishPeak();
+	}
+	
+	_length += count;
+}
+
+
+void
+MoxAudioPeaks::clear()
+{
+	_channels = 0;
+	_length = 0;
+	_bad = false;
+	
+	_peaks.clear();
+	_low.clear();
+	_high.clear();
+	_pending = 0;
+}
+
+
+void
+MoxAudioPeaks::finishPeak()
+{
+	for(int c = 0; c < _channels; c++)
+	{
+		_peaks.push_back( PeakValue(_low[c]) );
+		_peaks.push_back( PeakValue(_high[c]) );
+	}
+	
+	_pending = 0;
+}
+
+
+short
+MoxAudioPeaks::peak(MoxMxf::UInt64 p, int channel, bool high) const
+{
+	const MoxMxf::UInt64 finished = _peaks.size() / (2 * _channels);
+	
+	if(p < finished)
+		return _peaks[(size_t)((p * _channels + channel) * 2) + (high ? 1 : 0)];
+	else if(p == finished && _pending > 0)
+		return PeakValue(high ? _high[channel] : _low[channel]);
+	else
+		return 0;
+}
+
+
+bool
+MoxAudioPeaks::get(int channel, MoxMxf::UInt64 position, MoxMxf::UInt64 samples_per_peak, int count,
+					float *maxima, float *minima) const
+{
+	if(channel < 0 || channel >= _channels || samples_per_peak == 0)
+		return false;
+	
+	for(int i = 0; i < count; i++)
+	{
+		const MoxMxf::UInt64 start = position + (i * samples_per_peak);
+		const MoxMxf::UInt64 end = start + samples_per_peak;
+		
+		short low = 0, high = 0;
+		
+		if(start < _length)
+		{
+			const MoxMxf::UInt64 first = start / _samples_per_peak;
+			const MoxMxf::UInt64 last = ((end < _length ? end : _length) - 1) / _samples_per_peak;
+			
+			low = peak(first, channel, false);
+			high = peak(first, channel, true);
+			
+			for(MoxMxf::UInt64 p = first + 1; p <= last; p++)
+			{
+				const short l = peak(p, channel, false);
+				const short h = peak(p, channel, true);
+				
+				if(l < low)
+					low = l;
+				
+				if(h > high)
+					high = h;
+			}
+		}
+		
+		maxima[i] = (float)high / 32767.f;
+		minima[i] = (float)low / 32767.f;
+	}
+	
+	return true;
+}
+
+
+void
+MoxAudioPeaks::write(MoxByteWriter &writer) const
+{
+	const MoxMxf::UInt64 peaks = (_length + _samples_per_peak - 1) / _samples_per_peak;
+
+	writer.putInt(_samples_per_peak, 4);
+	writer.putInt(_channels, 4);
+	writer.putInt(_length, 8);
+	
+	for(MoxMxf::UInt64 p = 0; p < peaks; p++)
+	{
+		for(int c = 0; c < _channels; c++)
+		{
+			writer.putInt((unsigned short)peak(p, c, false), 2);
+			writer.putInt((unsigned short)peak(p, c, true), 2);
+		}
+	}
+}
+
+
+bool
+MoxAudioPeaks::read(MoxByteReader &reader, MoxMxf::UInt64 size)
+{
+	clear();
+
+	if(size < 16)
+		return false;
+	
+	const MoxMxf::UInt64 samples_per_peak = reader.getInt(4);
+	const MoxMxf::UInt64 channels = reader.getInt(4);
+	const MoxMxf::UInt64 length = reader.getInt(8);
+	
+	if(!reader.ok() || samples_per_peak == 0 || samples_per_peak > 0x7fffffff || channels == 0 || channels > 1024)
+		return false;
+	
+	const MoxMxf::UInt64 peaks = (length + samples_per_peak - 1) / samples_per_peak;
+	
+	if(size != 16 + (peaks * channels * 4))
+		return false;
+	
+	std::vector<short> values((size_t)(peaks * channels * 2));
+	
+	for(std::vector<short>::iterator i = values.begin(); i != values.end(); ++i)
+		*i = (short)(unsigned short)reader.getInt(2);
+	
+	if(!reader.ok())
+		return false;
+	
+	_samples_per_peak = (int)samples_per_peak;
+	_channels = (int)channels;
+	_length = length;
+	_peaks.swap(values);
+	
+	_low.assign(_channels, 0.f);
+	_high.assign(_channels, 0.f);
+	
+	return true;
+}
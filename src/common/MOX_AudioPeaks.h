@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_AUDIOPEAKS_H
+#define MOX_AUDIOPEAKS_H
+
+#include <MoxFiles/InputFile.h>
+
+#include <vector>
+
+class MoxByteWriter;
+class MoxByteReader;
+
+// The lowest and highest sample in every few hundred, for each channel.
+// Exporters collect these as they write so a waveform can be drawn
+// without decoding all of a file's audio.
+class MoxAudioPeaks
+{
+  public:
+	MoxAudioPeaks(int samples_per_peak = 256);
+	~MoxAudioPeaks() {}
+	
+	// Exporters call this with every sample in order.  The channels must
+	// stay the same.  Only 8 and 16-bit integer and float samples work,
+	// anything else throws out the peaks.
+	void add(MoxMxf::UInt64 count, MoxFiles::SampleType type, const std::vector<const char *> &channels, ptrdiff_t stride);
+	
+	bool empty() const { return (_length == 0); }
+	void clear();
+	
+	int channels() const { return _channels; }
+	MoxMxf::UInt64 length() const { return _length; } // samples seen
+	
+	// Lowest and highest sample in each of count runs of samples_per_peak
+	// samples, starting at position.  With fewer samples per peak than we
+	// have, neighbours will get the same peak.  Past the end is silent.
+	bool get(int channel, MoxMxf::UInt64 position, MoxMxf::UInt64 samples_per_peak, int count,
+				float *maxima, float *minima) const;
+	
+	void write(MoxByteWriter &writer) const;
+	bool read(MoxByteReader &reader, MoxMxf::UInt64 size);
+	
+  private:
+	int _samples_per_peak;
+	int _channels;
+	MoxMxf::UInt64 _length;
+	bool _bad;
+	
+	std::vector<short> _peaks; // low and high for each channel, then the next peak
+	
+	// the peak still being filled
+	std::vector<float> _low;
+	std::vector<float> _high;
+	int _pending;
+	
+	void finishPeak();
+	short peak(MoxMxf::UInt64 peak, int channel, bool high) const;
+};
+
+#endif // MOX_AUDIOPEAKS_H
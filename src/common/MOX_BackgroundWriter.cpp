@@ -0,0 +1,188 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_BackgroundWriter.h"
+
+#include <IlmThread.h>
+
+#include <assert.h>
+
+
+MoxWorkerPool MoxBackgroundWriter::_writer_pool(0);
+
+
+class MoxBackgroundTask : public IlmThread::Task
+{
+  public:
+	MoxBackgroundTask(IlmThread::TaskGroup *group, MoxBackgroundWriter &writer) :
+		IlmThread::Task(group),
+		_writer(writer)
+	{}
+	
+	virtual ~MoxBackgroundTask() {}
+	
+	virtual void execute() { _writer.writeLoop(); }
+	
+  private:
+	MoxBackgroundWriter &_writer;
+};
+
+
+MoxBackgroundWriter::MoxBackgroundWriter(bool threaded) :
+	_pool(_writer_pool),
+	_own_thread(true),
+	_task_group(NULL),
+	_wake(0),
+	_waiters(0),
+	_busy(false)
+{
+	if(threaded && IlmThread::supportsThreads())
+	{
+		_task_group = new IlmThread::TaskGroup;
+		
+		_pool.reserveThread();
+	}
+}
+
+
+MoxBackgroundWriter::MoxBackgroundWriter(MoxWorkerPool &pool, bool threaded) :
+	_pool(pool),
+	_own_thread(false),
+	_task_group(NULL),
+	_wake(0),
+	_waiters(0),
+	_busy(false)
+{
+	if(threaded && IlmThread::supportsThreads())
+		_task_group = new IlmThread::TaskGroup;
+}
+
+
+MoxBackgroundWriter::~MoxBackgroundWriter()
+{
+	stopWriter();
+	
+	assert(_waiters == 0);
+}
+
+
+void
+MoxBackgroundWriter::shutdown()
+{
+	_writer_pool.shutdown();
+}
+
+
+bool
+MoxBackgroundWriter::markBusy()
+{
+	assert(threaded());
+	
+	if(_busy)
+		return false;
+	
+	_busy = true;
+	
+	return true;
+}
+
+
+void
+MoxBackgroundWriter::start()
+{
+	_pool.addTask(new MoxBackgroundTask(_task_group, *this));
+}
+
+
+void
+MoxBackgroundWriter::waitForWriter(IlmThread::Lock &lock)
+{
+	_waiters++;
+	
+	lock.release();
+	
+	_wake.wait();
+	
+	lock.acquire();
+}
+
+
+void
+MoxBackgroundWriter::waitUntilIdle(IlmThread::Lock &lock)
+{
+	while(_busy)
+		waitForWriter(lock);
+}
+
+
+void
+MoxBackgroundWriter::wakeWaiters()
+{
+	while(_waiters > 0)
+	{
+		_waiters--;
+		
+		_wake.post();
+	}
+}
+
+
+void
+MoxBackgroundWriter::writerDone()
+{
+	assert(_busy);
+	
+	_busy = false;
+	
+	wakeWaiters();
+}
+
+
+void
+MoxBackgroundWriter::stopWriter()
+{
+	if(_task_group != NULL)
+	{
+		delete _task_group; // waits for writeLoop()
+		
+		_task_group = NULL;
+		
+		if(_own_thread)
+			_pool.releaseThread();
+	}
+}
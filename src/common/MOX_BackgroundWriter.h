@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_BACKGROUNDWRITER_H
+#define MOX_BACKGROUNDWRITER_H
+
+#include "MOX_WorkerPool.h"
+
+#include <IlmThreadMutex.h>
+#include <IlmThreadSemaphore.h>
+#include <IlmThreadPool.h>
+
+#include <stddef.h>
+
+// The part of a write queue that isn't the queue: a thread that runs
+// writeLoop() whenever there's something queued, and a way for callers
+// to wait on it.  Every writer gets a thread of its own from a shared
+// pool, so one export never waits for another to finish writing, unless
+// it's given a pool to share with others of its kind.
+// Everything except start() and stopWriter() is called with _mutex held.
+
+class MoxBackgroundWriter
+{
+  public:
+	static void shutdown(); // after every writer is gone
+	
+  protected:
+	MoxBackgroundWriter(bool threaded); // false means the caller writes
+	MoxBackgroundWriter(MoxWorkerPool &pool, bool threaded);
+	virtual ~MoxBackgroundWriter();
+	
+	bool threaded() const { return (_task_group != NULL); }
+	bool busy() const { return _busy; }
+	
+	// After queuing something.  If it returns true, call start() once
+	// the lock has been released.
+	bool markBusy();
+	void start();
+	
+	// Releases the lock until the writer finishes something.
+	void waitForWriter(IlmThread::Lock &lock);
+	void waitUntilIdle(IlmThread::Lock &lock);
+	
+	// for writeLoop()
+	void wakeWaiters();
+	void writerDone(); // nothing left, about to return
+	
+	// Subclass destructors have to call this before anything
+	// writeLoop() uses goes away.
+	void stopWriter();
+	
+	virtual void writeLoop() = 0;
+	
+	IlmThread::Mutex _mutex;
+	
+  private:
+	MoxWorkerPool &_pool;
+	const bool _own_thread;
+	IlmThread::TaskGroup *_task_group;
+	IlmThread::Semaphore _wake;
+	int _waiters;
+	bool _busy;
+	
+	friend class MoxBackgroundTask;
+	
+	static MoxWorkerPool _writer_pool; // one thread for each writer
+	
+	MoxBackgroundWriter(const MoxBackgroundWriter &);
+	MoxBackgroundWriter & operator = (const MoxBackgroundWriter &);
+};
+
+#endif // MOX_BACKGROUNDWRITER_H
@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_BoundStream.h"
+
+
+MoxBoundStream::MoxBoundStream(MoxMxf::IOStream *stream) :
+	_stream(stream),
+	_position(stream != NULL ? stream->FileTell() : 0)
+{
+
+}
+
+
+MoxBoundStream::~MoxBoundStream()
+{
+	delete _stream;
+}
+
+
+int
+MoxBoundStream::FileSeek(MoxMxf::UInt64 offset)
+{
+	const int result = stream().FileSeek(offset);
+	
+	_position = offset;
+	
+	return result;
+}
+
+
+MoxMxf::UInt64
+MoxBoundStream::FileRead(unsigned char *dest, MoxMxf::UInt64 size)
+{
+	const MoxMxf::UInt64 bytes = stream().FileRead(dest, size);
+	
+	_position += bytes;
+	
+	return bytes;
+}
+
+
+MoxMxf::UInt64
+MoxBoundStream::FileWrite(const unsigned char *source, MoxMxf::UInt64 size)
+{
+	const MoxMxf::UInt64 bytes = stream().FileWrite(source, size);
+	
+	_position += bytes;
+	
+	return bytes;
+}
+
+
+MoxMxf::UInt64
+MoxBoundStream::FileTell()
+{
+	return _position;
+}
+
+
+void
+MoxBoundStream::FileFlush()
+{
+	if(_stream != NULL)
+		_stream->FileFlush();
+}
+
+
+void
+MoxBoundStream::FileTruncate(MoxMxf::Int64 newsize)
+{
+	stream().FileTruncate(newsize);
+}
+
+
+MoxMxf::Int64
+MoxBoundStream::FileSize()
+{
+	return stream().FileSize();
+}
+
+
+void
+MoxBoundStream::bind(MoxMxf::IOStream *stream)
+{
+	if(stream == NULL)
+		throw MoxMxf::NullExc("Null stream");
+	
+	if(stream != _stream)
+	{
+		delete _stream;
+		
+		_stream = stream;
+	}
+	
+	_stream->FileSeek(_position);
+}
+
+
+void
+MoxBoundStream::unbind()
+{
+	if(_stream != NULL)
+	{
+		_stream->FileFlush();
+		
+		delete _stream;
+		
+		_stream = NULL;
+	}
+}
+
+
+MoxMxf::IOStream &
+MoxBoundStream::stream()
+{
+	if(_stream == NULL)
+		throw MoxMxf::IoExc("File is closed");
+	
+	return *_stream;
+}
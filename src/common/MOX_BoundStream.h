@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_BOUNDSTREAM_H
+#define MOX_BOUNDSTREAM_H
+
+#include <MoxMxf/PlatformIOStream.h>
+
+// An IOStream that passes everything through to a file handle that can be
+// taken away and given back.  An InputFile sitting on top keeps its parsed
+// header and index while the handle is gone, so getting the file back
+// only costs the open.
+class MoxBoundStream : public MoxMxf::IOStream
+{
+  public:
+	MoxBoundStream(MoxMxf::IOStream *stream = NULL); // we own the stream
+	virtual ~MoxBoundStream();
+	
+	virtual int FileSeek(MoxMxf::UInt64 offset);
+	virtual MoxMxf::UInt64 FileRead(unsigned char *dest, MoxMxf::UInt64 size);
+	virtual MoxMxf::UInt64 FileWrite(const unsigned char *source, MoxMxf::UInt64 size);
+	virtual MoxMxf::UInt64 FileTell();
+	virtual void FileFlush();
+	virtual void FileTruncate(MoxMxf::Int64 newsize);
+	virtual MoxMxf::Int64 FileSize();
+	
+	// take a new handle and seek it to where the last one left off
+	void bind(MoxMxf::IOStream *stream);
+	
+	// close the handle, remembering the position
+	void unbind();
+	
+	bool isBound() const { return (_stream != NULL); }
+	
+  private:
+	MoxMxf::IOStream *_stream;
+	MoxMxf::UInt64 _position;
+	
+	MoxMxf::IOStream & stream();
+	
+	MoxBoundStream(const MoxBoundStream &);
+	MoxBoundStream & operator = (const MoxBoundStream &);
+};
+
+#endif // MOX_BOUNDSTREAM_H
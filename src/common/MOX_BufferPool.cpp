@@ -0,0 +1,376 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_BufferPool.h"
+
+#include "MOX_Memory.h"
+#include "MOX_Platform.h"
+
+#include <IlmThreadMutex.h>
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <new>
+
+#include <assert.h>
+
+
+// Buffers get released by other globals when those are destroyed, which
+// might be after anything here would be, so these are never deleted.
+static IlmThread::Mutex *g_mutex = new IlmThread::Mutex;
+
+typedef std::map<size_t, std::vector<void *> > SpareMap;
+static SpareMap *g_spares = new SpareMap;
+
+typedef std::vector<std::pair<void *, size_t> > BufferList;
+
+static size_t g_max_bytes = 0;
+static size_t g_max_spare_bytes = 512 * 1024 * 1024;
+
+static MoxBufferPool::Stats g_stats = { 0, 0, 0, 0, 0, 0 };
+
+static MoxBufferPool::PressureHandler g_pressure_handler = NULL;
+
+
+static size_t
+SizeClass(size_t bytes)
+{
+	// Small ones go up to the next 64 bytes.  Past that, four classes for
+	// each power of two, so a buffer is never more than 25% too big.
+	if(bytes <= 4096)
+		return (bytes + 63) & ~(size_t)63;
+	
+	size_t power = 4096;
+	
+	while(power * 2 < bytes)
+		power *= 2;
+	
+	const size_t step = power / 4;
+	
+	return (bytes + step - 1) / step * step;
+}
+
+
+static void *
+TakeSpare(size_t size_class)
+{
+	SpareMap::iterator spares = g_spares->find(size_class);
+	
+	if(spares == g_spares->end() || spares->second.empty())
+		return NULL;
+	
+	void *buffer = spares->second.back();
+	
+	spares->second.pop_back();
+	
+	g_stats.spare -= size_class;
+	g_stats.in_use += size_class;
+	g_stats.hits++;
+	
+	MoxMemory::remove(MoxMemory::SPARE_BUFFERS, size_class);
+	
+	return buffer;
+}
+
+
+static void
+TakeSpares(size_t target, BufferList &freed)
+{
+	// Biggest first, so the fewest buffers go.  They're given back to the
+	// OS by FreeBuffers() once the lock is released, munmap can take a while.
+	SpareMap::reverse_iterator i = g_spares->rbegin();
+	
+	while(g_stats.spare > target && i != g_spares->rend())
+	{
+		std::vector<void *> &buffers = i->second;
+		
+		while(g_stats.spare > target && !buffers.empty())
+		{
+			try
+			{
+				freed.push_back( std::make_pair(buffers.back(), i->first) );
+			}
+			catch(...)
+			{
+				return; // then it stays a spare
+			}
+			
+			buffers.pop_back();
+			
+			g_stats.spare -= i->first;
+			
+			MoxMemory::remove(MoxMemory::SPARE_BUFFERS, i->first);
+		}
+		
+		++i;
+	}
+}
+
+
+static void
+FreeBuffers(const BufferList &freed)
+{
+	for(BufferList::const_iterator i = freed.begin(); i != freed.end(); ++i)
+		MoxPageFree(i->first, i->second);
+}
+
+
+void *
+MoxBufferPool::allocate(size_t bytes)
+{
+	const size_t size_class = SizeClass(bytes > 0 ? bytes : 1);
+	
+	BufferList freed;
+	
+	{
+		IlmThread::Lock lock(*g_mutex);
+		
+		void *buffer = TakeSpare(size_class);
+		
+		if(buffer != NULL)
+			return buffer;
+		
+		size_t max_bytes = (g_max_bytes > 0 ? g_max_bytes : defaultMaxBytes());
+		
+		if(g_stats.in_use + size_class > max_bytes && g_pressure_handler != NULL)
+		{
+			// whatever the handler frees comes back through release()
+			const PressureHandler handler = g_pressure_handler;
+			const size_t needed = g_stats.in_use + size_class - max_bytes;
+			
+			lock.release();
+			
+			try
+			{
+				handler(needed);
+			}
+			catch(...) {}
+			
+			lock.acquire();
+			
+			buffer = TakeSpare(size_class);
+			
+			if(buffer != NULL)
+				return buffer;
+			
+			max_bytes = (g_max_bytes > 0 ? g_max_bytes : defaultMaxBytes());
+		}
+		
+		if(g_stats.in_use + size_class > max_bytes)
+		{
+			g_stats.refusals++;
+			
+			throw std::bad_alloc();
+		}
+		
+		// spares of other sizes make room for this one
+		if(g_stats.in_use + g_stats.spare + size_class > max_bytes)
+			TakeSpares(max_bytes - g_stats.in_use - size_class, freed);
+		
+		// count it now so nobody else takes the room while we're out
+		g_stats.in_use += size_class;
+		g_stats.misses++;
+		
+		if(g_stats.in_use + g_stats.spare > g_stats.peak)
+			g_stats.peak = g_stats.in_use + g_stats.spare;
+	}
+	
+	FreeBuffers(freed);
+	
+	// a new buffer gets faulted in here instead of wherever it's first used
+	void *buffer = MoxPageAlloc(size_class, true);
+	
+	if(buffer == NULL)
+	{
+		IlmThread::Lock lock(*g_mutex);
+		
+		g_stats.in_use -= size_class;
+		
+		throw std::bad_alloc();
+	}
+	
+	return buffer;
+}
+
+
+void
+MoxBufferPool::release(void *buffer, size_t bytes)
+{
+	if(buffer == NULL)
+		return;
+	
+	const size_t size_class = SizeClass(bytes > 0 ? bytes : 1);
+	
+	IlmThread::Lock lock(*g_mutex);
+	
+	assert(g_stats.in_use >= size_class);
+	
+	g_stats.in_use -= size_class;
+	
+	if(g_stats.spare + size_class <= g_max_spare_bytes)
+	{
+		(*g_spares)[size_class].push_back(buffer);
+		
+		g_stats.spare += size_class;
+		
+		MoxMemory::add(MoxMemory::SPARE_BUFFERS, size_class);
+	}
+	else
+	{
+		lock.release();
+		
+		MoxPageFree(buffer, size_class);
+	}
+}
+
+
+void
+MoxBufferPool::setMaxBytes(size_t max_bytes)
+{
+	BufferList freed;
+	
+	{
+		IlmThread::Lock lock(*g_mutex);
+		
+		g_max_bytes = max_bytes;
+		
+		const size_t cap = (g_max_bytes > 0 ? g_max_bytes : defaultMaxBytes());
+		
+		if(g_stats.in_use + g_stats.spare > cap)
+			TakeSpares(cap > g_stats.in_use ? cap - g_stats.in_use : 0, freed);
+	}
+	
+	FreeBuffers(freed);
+}
+
+
+size_t
+MoxBufferPool::maxBytes()
+{
+	IlmThread::Lock lock(*g_mutex);
+	
+	return (g_max_bytes > 0 ? g_max_bytes : defaultMaxBytes());
+}
+
+
+size_t
+MoxBufferPool::defaultMaxBytes()
+{
+	static size_t default_max = 0;
+	
+	if(default_max == 0)
+	{
+		const MoxMxf::UInt64 ram = MoxPhysicalMemory();
+		
+		// a 32-bit host can't address much anyway
+		const MoxMxf::UInt64 address_limit = (sizeof(void *) > 4 ? (MoxMxf::UInt64)-1 : (MoxMxf::UInt64)1536 * 1024 * 1024);
+		
+		const MoxMxf::UInt64 max_bytes = (ram > 0 ? (ram / 4) * 3 : address_limit);
+		
+		default_max = (size_t)(max_bytes < address_limit ? max_bytes : address_limit);
+	}
+	
+	return default_max;
+}
+
+
+void
+MoxBufferPool::setMaxSpareBytes(size_t max_spare_bytes)
+{
+	BufferList freed;
+	
+	{
+		IlmThread::Lock lock(*g_mutex);
+		
+		g_max_spare_bytes = max_spare_bytes;
+		
+		TakeSpares(g_max_spare_bytes, freed);
+	}
+	
+	FreeBuffers(freed);
+}
+
+
+size_t
+MoxBufferPool::maxSpareBytes()
+{
+	IlmThread::Lock lock(*g_mutex);
+	
+	return g_max_spare_bytes;
+}
+
+
+size_t
+MoxBufferPool::trim(size_t target)
+{
+	BufferList freed;
+	size_t freed_bytes = 0;
+	
+	{
+		IlmThread::Lock lock(*g_mutex);
+		
+		const size_t before = g_stats.spare;
+		
+		TakeSpares(target, freed);
+		
+		freed_bytes = before - g_stats.spare;
+	}
+	
+	FreeBuffers(freed);
+	
+	return freed_bytes;
+}
+
+
+void
+MoxBufferPool::setPressureHandler(PressureHandler handler)
+{
+	IlmThread::Lock lock(*g_mutex);
+	
+	g_pressure_handler = handler;
+}
+
+
+MoxBufferPool::Stats
+MoxBufferPool::stats()
+{
+	IlmThread::Lock lock(*g_mutex);
+	
+	return g_stats;
+}
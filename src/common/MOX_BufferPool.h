@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_BUFFERPOOL_H
+#define MOX_BUFFERPOOL_H
+
+#include <stddef.h>
+
+// Frames at 8K float are hundreds of megabytes, and we go through a lot of
+// them.  Getting that much from malloc and faulting it in every time is slow,
+// so buffers are handed out in size classes and kept around to be reused.
+// They come from MoxPageAlloc, so they're aligned for SIMD and get huge pages
+// where the OS has them.
+// Everything handed out plus the spares is kept under a hard cap.  Before
+// an allocation is refused, the pressure handler gets a chance to give
+// buffers back.
+
+class MoxBufferPool
+{
+  public:
+	// Throws std::bad_alloc if it would still go over the cap after
+	// the pressure handler has been called.
+	static void * allocate(size_t bytes);
+	
+	// bytes must be what was asked for
+	static void release(void *buffer, size_t bytes);
+	
+	// 0 goes back to the default
+	static void setMaxBytes(size_t max_bytes);
+	static size_t maxBytes();
+	
+	static size_t defaultMaxBytes(); // 3/4 of RAM
+	
+	// spares past this are given back to the OS right away
+	static void setMaxSpareBytes(size_t max_spare_bytes);
+	static size_t maxSpareBytes();
+	
+	// give spares back until there are no more than target, returns bytes freed
+	static size_t trim(size_t target = 0);
+	
+	// Called with no lock held, on whatever thread hit the cap, to release
+	// at least bytes worth of buffers if it can.  It mustn't allocate from
+	// the pool or take a lock that's held while allocating.
+	typedef void (*PressureHandler)(size_t bytes);
+	
+	static void setPressureHandler(PressureHandler handler); // NULL for none
+	
+	struct Stats
+	{
+		size_t in_use;				// bytes handed out, by size class
+		size_t spare;				// bytes waiting to be reused
+		size_t peak;				// most in_use + spare ever
+		unsigned long hits;			// allocations that got a spare
+		unsigned long misses;		// allocations that went to the OS
+		unsigned long refusals;		// allocations over the cap
+	};
+	
+	static Stats stats();
+};
+
+#endif // MOX_BUFFERPOOL_H
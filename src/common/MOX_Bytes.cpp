@@ -0,0 +1,305 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_Bytes.h"
+
+#include "MOX_Platform.h"
+
+#include <string.h>
+
+
+void
+MoxByteWriter::putInt(MoxMxf::UInt64 value, int bytes)
+{
+	for(int i=0; i < bytes; i++)
+		_buf += (char)((value >> (i * 8)) & 0xff);
+}
+
+
+void
+MoxByteWriter::putBytes(const void *data, size_t len)
+{
+	_buf.append((const char *)data, len);
+}
+
+
+void
+MoxByteWriter::putChecksum()
+{
+	putInt(MoxChecksum(_buf.data(), _buf.size()), 8);
+}
+
+
+MoxMxf::UInt64
+MoxByteReader::getInt(int bytes)
+{
+	if(!_ok || _pos + bytes > _buf.size())
+	{
+		_ok = false;
+		return 0;
+	}
+
+	MoxMxf::UInt64 value = 0;
+	
+	for(int i=0; i < bytes; i++)
+		value |= (MoxMxf::UInt64)(unsigned char)_buf[_pos++] << (i * 8);
+	
+	return value;
+}
+
+
+std::string
+MoxByteReader::getBytes(size_t len)
+{
+	if(!_ok || len > _buf.size() - _pos)
+	{
+		_ok = false;
+		return std::string();
+	}
+	
+	const size_t pos = _pos;
+	
+	_pos += len;
+	
+	return _buf.substr(pos, len);
+}
+
+
+void
+MoxByteReader::skip(size_t len)
+{
+	if(!_ok || len > _buf.size() - _pos)
+		_ok = false;
+	else
+		_pos += len;
+}
+
+
+bool
+MoxByteReader::checksumOK() const
+{
+	if(_buf.size() < 8)
+		return false;
+	
+	const size_t body_size = _buf.size() - 8;
+	
+	MoxMxf::UInt64 stored = 0;
+	
+	for(int i=0; i < 8; i++)
+		stored |= (MoxMxf::UInt64)(unsigned char)_buf[body_size + i] << (i * 8);
+	
+	return (stored == MoxChecksum(_buf.data(), body_size));
+}
+
+
+MoxMxf::UInt64
+MoxChecksum(const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	
+	MoxMxf::UInt64 hash = 0xcbf29ce484222325ULL;
+	
+	for(size_t i=0; i < len; i++)
+	{
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+	
+	return hash;
+}
+
+
+static const MoxMxf::UInt64 kPrime1 = 11400714785074694791ULL;
+static const MoxMxf::UInt64 kPrime2 = 14029467366897019727ULL;
+static const MoxMxf::UInt64 kPrime3 = 1609587929392839161ULL;
+static const MoxMxf::UInt64 kPrime4 = 9650029242287828579ULL;
+static const MoxMxf::UInt64 kPrime5 = 2870177450012600261ULL;
+
+static inline MoxMxf::UInt64
+Rotate(MoxMxf::UInt64 x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline MoxMxf::UInt64
+Read64(const unsigned char *p)
+{
+	MoxMxf::UInt64 v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline MoxMxf::UInt64
+Read32(const unsigned char *p)
+{
+	MoxMxf::UInt32 v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline MoxMxf::UInt64
+Round(MoxMxf::UInt64 acc, MoxMxf::UInt64 input)
+{
+	acc += input * kPrime2;
+	acc = Rotate(acc, 31);
+	return acc * kPrime1;
+}
+
+static inline MoxMxf::UInt64
+MergeRound(MoxMxf::UInt64 acc, MoxMxf::UInt64 val)
+{
+	acc ^= Round(0, val);
+	return acc * kPrime1 + kPrime4;
+}
+
+
+MoxMxf::UInt64
+MoxHash64(const void *data, size_t len, MoxMxf::UInt64 seed)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	const unsigned char *end = p + len;
+	
+	MoxMxf::UInt64 hash;
+	
+	if(len >= 32)
+	{
+		const unsigned char *limit = end - 32;
+		
+		MoxMxf::UInt64 v1 = seed + kPrime1 + kPrime2;
+		MoxMxf::UInt64 v2 = seed + kPrime2;
+		MoxMxf::UInt64 v3 = seed;
+		MoxMxf::UInt64 v4 = seed - kPrime1;
+		
+		do{
+			v1 = Round(v1, Read64(p)); p += 8;
+			v2 = Round(v2, Read64(p)); p += 8;
+			v3 = Round(v3, Read64(p)); p += 8;
+			v4 = Round(v4, Read64(p)); p += 8;
+		}while(p <= limit);
+		
+		hash = Rotate(v1, 1) + Rotate(v2, 7) + Rotate(v3, 12) + Rotate(v4, 18);
+		
+		hash = MergeRound(hash, v1);
+		hash = MergeRound(hash, v2);
+		hash = MergeRound(hash, v3);
+		hash = MergeRound(hash, v4);
+	}
+	else
+		hash = seed + kPrime5;
+	
+	hash += (MoxMxf::UInt64)len;
+	
+	while(p + 8 <= end)
+	{
+		hash ^= Round(0, Read64(p));
+		hash = Rotate(hash, 27) * kPrime1 + kPrime4;
+		p += 8;
+	}
+	
+	if(p + 4 <= end)
+	{
+		hash ^= Read32(p) * kPrime1;
+		hash = Rotate(hash, 23) * kPrime2 + kPrime3;
+		p += 4;
+	}
+	
+	while(p < end)
+	{
+		hash ^= (*p) * kPrime5;
+		hash = Rotate(hash, 11) * kPrime1;
+		p++;
+	}
+	
+	hash ^= hash >> 33;
+	hash *= kPrime2;
+	hash ^= hash >> 29;
+	hash *= kPrime3;
+	hash ^= hash >> 32;
+	
+	return hash;
+}
+
+
+bool
+MoxReadFile(const std::string &path, std::string &buf, size_t max_size)
+{
+	MoxMxf::UInt64 size = 0;
+	
+	if( !MoxFileStat(path, &size, NULL) || size > max_size )
+		return false;
+	
+	buf.assign((size_t)size, '\0');
+	
+	if(size == 0)
+		return true;
+	
+	FILE *f = MoxFileOpen(path, "rb");
+	
+	if(f == NULL)
+		return false;
+	
+	const size_t got = fread(&buf[0], 1, buf.size(), f);
+	
+	fclose(f);
+	
+	return (got == buf.size());
+}
+
+
+bool
+MoxWriteFile(const std::string &path, const std::string &buf)
+{
+	// write it off to the side so nobody ever sees half a file
+	const std::string temp_path = path + ".tmp";
+	
+	FILE *f = MoxFileOpen(temp_path, "wb");
+	
+	if(f == NULL)
+		return false;
+	
+	const size_t wrote = fwrite(buf.data(), 1, buf.size(), f);
+	
+	const bool closed = (fclose(f) == 0);
+	
+	if(wrote == buf.size() && closed && MoxFileRename(temp_path, path))
+		return true;
+	
+	MoxFileDelete(temp_path);
+	
+	return false;
+}
@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_BYTES_H
+#define MOX_BYTES_H
+
+#include <MoxMxf/PlatformIOStream.h>
+
+#include <string>
+
+// For the little files we save for ourselves.  Everything is little-endian
+// so they work on any machine.
+
+class MoxByteWriter
+{
+  public:
+	MoxByteWriter() {}
+	
+	void putInt(MoxMxf::UInt64 value, int bytes);
+	void putBytes(const void *data, size_t len);
+	void putBytes(const std::string &data) { _buf += data; }
+	
+	// checksum of everything so far, tacked onto the end
+	void putChecksum();
+	
+	const std::string & data() const { return _buf; }
+	size_t size() const { return _buf.size(); }
+	
+  private:
+	std::string _buf;
+};
+
+
+class MoxByteReader
+{
+  public:
+	MoxByteReader(const std::string &buf) : _buf(buf), _pos(0), _ok(true) {}
+	
+	MoxMxf::UInt64 getInt(int bytes);
+	std::string getBytes(size_t len);
+	void skip(size_t len);
+	
+	// checks the checksum at the end, which you then shouldn't read past
+	bool checksumOK() const;
+	
+	bool ok() const { return _ok; }
+	bool atEnd() const { return (_pos + 8 >= _buf.size()); }
+	
+  private:
+	const std::string &_buf;
+	size_t _pos;
+	bool _ok;
+};
+
+
+MoxMxf::UInt64 MoxChecksum(const void *data, size_t len); // 64-bit FNV-1a
+
+// Much faster than MoxChecksum, for hashing whole frames.  This is
+// xxHash64, except words are read in the machine's own byte order, so
+// only compare hashes that were made on the same machine.
+MoxMxf::UInt64 MoxHash64(const void *data, size_t len, MoxMxf::UInt64 seed = 0);
+
+bool MoxReadFile(const std::string &path, std::string &buf, size_t max_size);
+bool MoxWriteFile(const std::string &path, const std::string &buf); // through a temp file
+
+#endif // MOX_BYTES_H
@@ -0,0 +1,254 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_Downsample.h"
+
+#include <vector>
+
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define MOX_USE_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+
+// One pixel is four channels, which fits nicely in one SSE register.
+// Sum up every source pixel that lands in a destination pixel,
+// then multiply by 1/count.
+
+#ifdef MOX_USE_SSE2
+
+static inline __m128
+LoadPixel(const unsigned char *p)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i pix8 = _mm_cvtsi32_si128(*(const int *)p);
+	const __m128i pix16 = _mm_unpacklo_epi8(pix8, zero);
+	
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(pix16, zero));
+}
+
+static inline __m128
+LoadPixel(const unsigned short *p)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i pix16 = _mm_loadl_epi64((const __m128i *)p);
+	
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(pix16, zero));
+}
+
+static inline __m128
+LoadPixel(const float *p)
+{
+	return _mm_loadu_ps(p);
+}
+
+static inline void
+StorePixel(unsigned char *p, __m128 v)
+{
+	const __m128i i32 = _mm_cvtps_epi32(v); // rounds
+	const __m128i i16 = _mm_packs_epi32(i32, i32);
+	const __m128i i8 = _mm_packus_epi16(i16, i16);
+	
+	*(int *)p = _mm_cvtsi128_si32(i8);
+}
+
+static inline void
+StorePixel(unsigned short *p, __m128 v)
+{
+	// no unsigned 32->16 pack in SSE2, but AE's 16-bit only goes up to 32768
+	const __m128i i32 = _mm_cvtps_epi32(v);
+	const __m128i offset = _mm_set1_epi32(32768);
+	const __m128i i16 = _mm_packs_epi32(_mm_sub_epi32(i32, offset), _mm_sub_epi32(i32, offset));
+	
+	_mm_storel_epi64((__m128i *)p, _mm_xor_si128(i16, _mm_set1_epi16((short)0x8000)));
+}
+
+static inline void
+StorePixel(float *p, __m128 v)
+{
+	_mm_storeu_ps(p, v);
+}
+
+template <typename T>
+static void
+DownsampleRow(const char *source, ptrdiff_t source_rowbytes, int source_width, int rows,
+				T *dest, int dest_left, int dest_right, int factor_x)
+{
+	for(int x = dest_left; x < dest_right; x++)
+	{
+		const int start_x = x * factor_x;
+		const int end_x = (start_x + factor_x < source_width ? start_x + factor_x : source_width);
+		
+		__m128 sum = _mm_setzero_ps();
+		
+		const char *row = source;
+		
+		for(int y = 0; y < rows; y++)
+		{
+			const T *pix = (const T *)row + (4 * start_x);
+			
+			for(int sx = start_x; sx < end_x; sx++)
+			{
+				sum = _mm_add_ps(sum, LoadPixel(pix));
+				
+				pix += 4;
+			}
+			
+			row += source_rowbytes;
+		}
+		
+		const int count = (end_x - start_x) * rows;
+		
+		StorePixel(dest + (4 * x), _mm_mul_ps(sum, _mm_set1_ps(1.f / (float)count)));
+	}
+}
+
+#else // !MOX_USE_SSE2
+
+static inline unsigned char Round(float v, unsigned char *) { return (unsigned char)(v + 0.5f); }
+static inline unsigned short Round(float v, unsigned short *) { return (unsigned short)(v + 0.5f); }
+static inline float Round(float v, float *) { return v; }
+
+template <typename T>
+static void
+DownsampleRow(const char *source, ptrdiff_t source_rowbytes, int source_width, int rows,
+				T *dest, int dest_left, int dest_right, int factor_x)
+{
+	for(int x = dest_left; x < dest_right; x++)
+	{
+		const int start_x = x * factor_x;
+		const int end_x = (start_x + factor_x < source_width ? start_x + factor_x : source_width);
+		
+		float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+		
+		const char *row = source;
+		
+		for(int y = 0; y < rows; y++)
+		{
+			const T *pix = (const T *)row + (4 * start_x);
+			
+			for(int sx = start_x; sx < end_x; sx++)
+			{
+				sum[0] += pix[0];
+				sum[1] += pix[1];
+				sum[2] += pix[2];
+				sum[3] += pix[3];
+				
+				pix += 4;
+			}
+			
+			row += source_rowbytes;
+		}
+		
+		const float mult = 1.f / (float)((end_x - start_x) * rows);
+		
+		T *out = dest + (4 * x);
+		
+		for(int c = 0; c < 4; c++)
+			out[c] = Round(sum[c] * mult, out);
+	}
+}
+
+#endif // MOX_USE_SSE2
+
+
+template <typename T>
+static void
+Downsample(const char *source, ptrdiff_t source_rowbytes, int source_width, int source_height,
+			char *dest, ptrdiff_t dest_rowbytes, const MoxRect &dest_region,
+			int factor_x, int factor_y)
+{
+	for(int y = dest_region.top; y < dest_region.bottom; y++)
+	{
+		const int start_y = y * factor_y;
+		const int end_y = (start_y + factor_y < source_height ? start_y + factor_y : source_height);
+		
+		if(end_y <= start_y)
+			break;
+		
+		DownsampleRow<T>(source + (start_y * source_rowbytes), source_rowbytes, source_width, end_y - start_y,
+							(T *)(dest + (y * dest_rowbytes)), dest_region.left, dest_region.right, factor_x);
+	}
+}
+
+
+void
+MoxBoxDownsample(const char *source, ptrdiff_t source_rowbytes, int source_width, int source_height,
+					char *dest, ptrdiff_t dest_rowbytes, int dest_width, int dest_height,
+					int factor_x, int factor_y, MoxFiles::PixelType type,
+					const MoxRect *dest_region)
+{
+	if(factor_x < 1 || factor_y < 1)
+		throw MoxMxf::ArgExc("Invalid downsample factor");
+	
+	// don't read past the edge of the source
+	if(dest_width > (source_width + factor_x - 1) / factor_x)
+		dest_width = (source_width + factor_x - 1) / factor_x;
+	
+	if(dest_height > (source_height + factor_y - 1) / factor_y)
+		dest_height = (source_height + factor_y - 1) / factor_y;
+	
+	MoxRect region(0, 0, dest_width, dest_height);
+	
+	if(dest_region != NULL)
+		region = region.intersect(*dest_region);
+	
+	switch(type)
+	{
+		case MoxFiles::UINT8:
+			Downsample<unsigned char>(source, source_rowbytes, source_width, source_height,
+										dest, dest_rowbytes, region, factor_x, factor_y);
+		break;
+		
+		case MoxFiles::UINT16A:
+		case MoxFiles::UINT16:
+			Downsample<unsigned short>(source, source_rowbytes, source_width, source_height,
+										dest, dest_rowbytes, region, factor_x, factor_y);
+		break;
+		
+		case MoxFiles::FLOAT:
+			Downsample<float>(source, source_rowbytes, source_width, source_height,
+								dest, dest_rowbytes, region, factor_x, factor_y);
+		break;
+		
+		default:
+			throw MoxMxf::ArgExc("Can't downsample this pixel type");
+	}
+}
@@ -0,0 +1,420 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_EncodeQueue.h"
+
+#include <string.h>
+
+
+class MoxPrepareTask : public IlmThread::Task
+{
+  public:
+	MoxPrepareTask(IlmThread::TaskGroup *group, const MoxEncodeQueue &queue, MoxEncodeQueue::Item &item) :
+		IlmThread::Task(group),
+		_queue(queue),
+		_item(item)
+	{}
+	
+	virtual ~MoxPrepareTask() {}
+	
+	virtual void execute();
+	
+  private:
+	const MoxEncodeQueue &_queue;
+	MoxEncodeQueue::Item &_item;
+};
+
+
+void
+MoxPrepareTask::execute()
+{
+	try
+	{
+		_queue.prepare(_item);
+	}
+	catch(...) {}
+	
+	_item.ready.post();
+}
+
+
+MoxEncodeQueue::MoxEncodeQueue(MoxFiles::OutputFile &file, MoxFrameInfo &info, MoxProxyWriter *proxy,
+								bool have_alpha, const Settings &settings) :
+	MoxBackgroundWriter(settings.depth > 0),
+	_file(file),
+	_info(info),
+	_proxy(proxy),
+	_have_alpha(have_alpha),
+	_settings(settings),
+	_prepare_pool(NULL),
+	_prepare_group(NULL),
+	_queued_frames(0),
+	_queued_bytes(0),
+	_error(ERROR_NONE)
+{
+	if( threaded() )
+	{
+		_prepare_pool = new IlmThread::ThreadPool(1);
+		_prepare_group = new IlmThread::TaskGroup;
+	}
+}
+
+
+MoxEncodeQueue::~MoxEncodeQueue()
+{
+	stopWriter();
+	
+	delete _prepare_group; // frames still being looked at after an error
+	
+	delete _prepare_pool;
+	
+	// anything left after an error
+	for(std::deque<Item *>::iterator i = _queue.begin(); i != _queue.end(); ++i)
+	{
+		delete (*i)->frame;
+		delete *i;
+	}
+	
+	for(std::vector<MoxFrame *>::iterator i = _spare.begin(); i != _spare.end(); ++i)
+		delete *i;
+}
+
+
+void
+MoxEncodeQueue::pushFrame(int frame_index, int repeats, const char *origin, ptrdiff_t rowbytes,
+							int width, int height, MoxFiles::PixelType type, const char *order)
+{
+	Item *item = new Item;
+	
+	item->frame_index = frame_index;
+	item->repeats = (repeats > 1 ? repeats : 1);
+	
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		for(std::vector<MoxFrame *>::iterator i = _spare.begin(); i != _spare.end(); ++i)
+		{
+			if( (*i)->matches(width, height, type, order) )
+			{
+				item->frame = *i;
+				
+				_spare.erase(i);
+				
+				break;
+			}
+		}
+	}
+	
+	try
+	{
+		if(item->frame == NULL)
+			item->frame = new MoxFrame(width, height, type, order);
+		
+		item->frame->copyFrom(origin, rowbytes);
+	}
+	catch(...)
+	{
+		delete item->frame;
+		delete item;
+		
+		throw;
+	}
+	
+	add(item);
+}
+
+
+void
+MoxEncodeQueue::pushAudio(MoxMxf::UInt64 samples, MoxFiles::SampleType type, const char *data,
+							const std::vector<std::string> &names)
+{
+	const size_t bytes = (size_t)samples * names.size() * (MoxFiles::SampleBits(type) / 8);
+	
+	Item *item = new Item;
+	
+	try
+	{
+		item->audio.resize(bytes);
+		
+		if(bytes > 0)
+			memcpy(&item->audio[0], data, bytes);
+	}
+	catch(...)
+	{
+		delete item;
+		
+		throw;
+	}
+	
+	item->samples = samples;
+	item->sample_type = type;
+	item->names = names;
+	
+	add(item);
+}
+
+
+void
+MoxEncodeQueue::finish()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	waitUntilIdle(lock);
+	
+	throwError();
+}
+
+
+void
+MoxEncodeQueue::add(Item *item)
+{
+	if( !threaded() )
+	{
+		// no queue, write it right here
+		try
+		{
+			write(*item);
+		}
+		catch(...)
+		{
+			IlmThread::Lock lock(_mutex);
+			
+			recycle(item);
+			
+			throw;
+		}
+		
+		IlmThread::Lock lock(_mutex);
+		
+		recycle(item);
+		
+		return;
+	}
+	
+	IlmThread::Lock lock(_mutex);
+	
+	const size_t bytes = (item->frame != NULL ? item->frame->size() : item->audio.size());
+	
+	// Audio is small, so it never waits.  Frames wait for room.
+	while(item->frame != NULL && _error == ERROR_NONE && _queued_frames > 0 &&
+			(_queued_frames >= _settings.depth || _queued_bytes + bytes > _settings.max_bytes))
+	{
+		waitForWriter(lock);
+	}
+	
+	if(_error != ERROR_NONE)
+	{
+		recycle(item);
+		
+		throwError();
+	}
+	
+	// Look at the frame while the writer is busy with the ones ahead.
+	// The writer won't touch it until it's ready, so the task can be added
+	// after the lock is gone, along with the writer if it isn't running.
+	const bool prepare = (item->frame != NULL);
+	
+	item->preparing = prepare;
+	
+	_queue.push_back(item);
+	
+	if(item->frame != NULL)
+		_queued_frames++;
+	
+	_queued_bytes += bytes;
+	
+	const bool start_writer = markBusy();
+	
+	lock.release();
+	
+	if(prepare)
+		_prepare_pool->addTask(new MoxPrepareTask(_prepare_group, *this, *item));
+	
+	if(start_writer)
+		start();
+}
+
+
+void
+MoxEncodeQueue::prepare(Item &item) const
+{
+	const MoxFrame &frame = *item.frame;
+	
+	if(_have_alpha)
+	{
+		item.bounds = MoxAlphaBounds(frame.data(), frame.rowbytes(), frame.width(), frame.height(),
+										frame.type(), frame.order());
+	}
+	
+	item.hash = MoxFrameHash(frame.data(), frame.rowbytes(), frame.width(), frame.height(), frame.type());
+}
+
+
+void
+MoxEncodeQueue::write(Item &item)
+{
+	if(item.frame != NULL)
+	{
+		const MoxFrame &frame = *item.frame;
+		
+		if(item.preparing)
+		{
+			item.ready.wait();
+			
+			item.preparing = false;
+		}
+		else
+			prepare(item);
+		
+		for(int i = 0; i < item.repeats; i++)
+		{
+			// the importer can tell the host to skip the clear parts
+			if(_have_alpha)
+				_info.setBounds(item.frame_index + i, item.bounds);
+			
+			// so the importer can decode held frames once
+			_info.setHash(item.frame_index + i, item.hash);
+		}
+		
+		MoxFiles::FrameBuffer frame_buffer(frame.width(), frame.height());
+		
+		item.frame->insertSlices(frame_buffer);
+		
+		for(int i = 0; i < item.repeats; i++)
+			_file.pushFrame(frame_buffer);
+		
+		if(_proxy != NULL)
+			_proxy->pushFrame(frame.data(), frame.rowbytes(), frame.type(), frame.order(), item.repeats);
+	}
+	else if(item.samples > 0 && !item.names.empty())
+	{
+		const size_t sample_size = MoxFiles::SampleBits(item.sample_type) / 8;
+		const ptrdiff_t stride = item.names.size() * sample_size;
+		
+		MoxFiles::AudioBuffer audio_buffer(item.samples);
+		
+		std::vector<const char *> peak_channels;
+		
+		for(size_t c = 0; c < item.names.size(); c++)
+		{
+			char *base = &item.audio[0] + (c * sample_size);
+			
+			audio_buffer.insert(item.names[c], MoxFiles::AudioSlice(item.sample_type, base, stride));
+			
+			peak_channels.push_back(base);
+		}
+		
+		_file.pushAudio(audio_buffer);
+		
+		// for the importer to draw waveforms with
+		_info.peaks().add(item.samples, item.sample_type, peak_channels, stride);
+	}
+}
+
+
+void
+MoxEncodeQueue::recycle(Item *item)
+{
+	// hang on to enough frames to fill the queue again
+	if(item->frame != NULL)
+	{
+		if((int)_spare.size() <= _settings.depth)
+			_spare.push_back(item->frame);
+		else
+			delete item->frame;
+	}
+	
+	delete item;
+}
+
+
+void
+MoxEncodeQueue::throwError() const
+{
+	if(_error == ERROR_IO)
+		throw MoxMxf::IoExc("Error writing movie");
+	else if(_error == ERROR_OTHER)
+		throw MoxMxf::LogicExc("Error encoding movie");
+}
+
+
+void
+MoxEncodeQueue::writeLoop()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	while(!_queue.empty() && _error == ERROR_NONE)
+	{
+		Item *item = _queue.front();
+		
+		_queue.pop_front();
+		
+		lock.release();
+		
+		Error error = ERROR_NONE;
+		
+		try
+		{
+			write(*item);
+		}
+		catch(MoxMxf::IoExc &e)
+		{
+			error = ERROR_IO;
+		}
+		catch(...)
+		{
+			error = ERROR_OTHER;
+		}
+		
+		lock.acquire();
+		
+		if(item->frame != NULL)
+			_queued_frames--;
+		
+		_queued_bytes -= (item->frame != NULL ? item->frame->size() : item->audio.size());
+		
+		if(error != ERROR_NONE)
+			_error = error;
+		
+		recycle(item);
+		
+		wakeWaiters();
+	}
+	
+	writerDone();
+}
@@ -0,0 +1,158 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_ENCODEQUEUE_H
+#define MOX_ENCODEQUEUE_H
+
+#include "MOX_BackgroundWriter.h"
+#include "MOX_Frame.h"
+#include "MOX_FrameInfo.h"
+#include "MOX_Proxy.h"
+
+#include <MoxFiles/OutputFile.h>
+
+#include <IlmThreadMutex.h>
+#include <IlmThreadSemaphore.h>
+#include <IlmThreadPool.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// Encoding a frame can take a lot longer than rendering it.  Instead of
+// making the host wait, frames and audio get copied into a queue and a
+// background thread pushes them to the OutputFile in order.  The things
+// we work out about each frame for the .moxinfo are done back there too.
+// Errors come out of the next call after they happen.
+//
+// MoxFiles compresses inside OutputFile::pushFrame, so the frames have to
+// go in one at a time.  Encoding several at once, with a reorder buffer to
+// keep them in order, would need a way to compress a frame outside
+// pushFrame, and there isn't one, so that isn't done.  What we can do is
+// work out the bounds and hash of the waiting frames on a thread of our
+// own, so the writer only has to compress.  It's not the global pool,
+// because the codecs use that.
+
+class MoxEncodeQueue : private MoxBackgroundWriter
+{
+  public:
+	struct Settings
+	{
+		int depth;			// frames waiting to be written, 0 writes them right away
+		size_t max_bytes;	// but always room for one
+		
+		Settings() : depth(4), max_bytes(512 * 1024 * 1024) {}
+	};
+	
+	// None of these are ours.  proxy can be NULL.
+	MoxEncodeQueue(MoxFiles::OutputFile &file, MoxFrameInfo &info, MoxProxyWriter *proxy,
+					bool have_alpha, const Settings &settings);
+	~MoxEncodeQueue(); // waits, but any error is lost
+	
+	// Copies the pixels, waiting if the queue is full.
+	// The frame is written repeats times, like AE's held frames.
+	void pushFrame(int frame_index, int repeats, const char *origin, ptrdiff_t rowbytes,
+					int width, int height, MoxFiles::PixelType type, const char *order);
+	
+	// interleaved samples, one name per channel
+	void pushAudio(MoxMxf::UInt64 samples, MoxFiles::SampleType type, const char *data,
+					const std::vector<std::string> &names);
+	
+	// wait for everything to be written
+	void finish();
+	
+  private:
+	MoxFiles::OutputFile &_file;
+	MoxFrameInfo &_info;
+	MoxProxyWriter *_proxy;
+	const bool _have_alpha;
+	const Settings _settings;
+	
+	struct Item
+	{
+		MoxFrame *frame; // NULL for audio
+		int frame_index;
+		int repeats;
+		
+		std::vector<char> audio;
+		MoxMxf::UInt64 samples;
+		MoxFiles::SampleType sample_type;
+		std::vector<std::string> names;
+		
+		bool preparing; // wait for ready before writing
+		IlmThread::Semaphore ready;
+		MoxRect bounds;
+		MoxMxf::UInt64 hash;
+		
+		Item() : frame(NULL), frame_index(0), repeats(1), samples(0), sample_type(MoxFiles::AFLOAT),
+					preparing(false), ready(0), hash(0) {}
+	};
+	
+	IlmThread::ThreadPool *_prepare_pool;
+	IlmThread::TaskGroup *_prepare_group;
+	
+	std::deque<Item *> _queue;
+	int _queued_frames;
+	size_t _queued_bytes;
+	
+	std::vector<MoxFrame *> _spare; // frames to reuse
+	
+	enum Error
+	{
+		ERROR_NONE,
+		ERROR_IO,
+		ERROR_OTHER
+	};
+	
+	Error _error;
+	
+	void add(Item *item);
+	void prepare(Item &item) const;
+	void write(Item &item);
+	void recycle(Item *item);
+	void throwError() const;
+	
+	virtual void writeLoop();
+	
+	friend class MoxPrepareTask;
+	
+	MoxEncodeQueue(const MoxEncodeQueue &);
+	MoxEncodeQueue & operator = (const MoxEncodeQueue &);
+};
+
+#endif // MOX_ENCODEQUEUE_H
@@ -0,0 +1,414 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_Frame.h"
+
+#include "MOX_Bytes.h"
+#include "MOX_Memory.h"
+#include "MOX_BufferPool.h"
+
+#include <string.h>
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define MOX_USE_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+
+double
+MoxAlphaFill(MoxFiles::PixelType type)
+{
+	return (type == MoxFiles::UINT8 ? 255 :
+			type == MoxFiles::UINT16A ? 32768 :
+			type == MoxFiles::HALF ? 1.0 :
+			type == MoxFiles::FLOAT ? 1.0 :
+			0);
+}
+
+
+void
+MoxInsertSlices(MoxFiles::FrameBuffer &frame_buffer, char *origin, ptrdiff_t rowbytes,
+					MoxFiles::PixelType type, const char *order)
+{
+	using namespace MoxFiles;
+
+	assert(order != NULL && strlen(order) == 4);
+
+	const size_t subpixel_size = PixelSize(type);
+	const size_t pixel_size = 4 * subpixel_size;
+	
+	const double rgb_fill = 0;
+	const double alpha_fill = MoxAlphaFill(type);
+	
+	for(int c = 0; c < 4; c++)
+	{
+		const char name[2] = { order[c], '\0' };
+		
+		frame_buffer.insert(name, Slice(type, origin + (subpixel_size * c), pixel_size, rowbytes, 1, 1,
+										(order[c] == 'A' ? alpha_fill : rgb_fill)));
+	}
+}
+
+
+// Most of an exported frame's alpha tends to be empty, so skip over it
+// four whole pixels at a time, then look at single pixels where it isn't.
+
+#ifdef MOX_USE_SSE2
+
+static inline bool
+AnyAlpha4(const unsigned char *pix, int alpha_channel)
+{
+	const __m128i mask = _mm_set1_epi32((int)(0xffu << (8 * alpha_channel)));
+	const __m128i alpha = _mm_and_si128(_mm_loadu_si128((const __m128i *)pix), mask);
+	
+	return (_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, _mm_setzero_si128())) != 0xffff);
+}
+
+static inline bool
+AnyAlpha4(const unsigned short *pix, int alpha_channel)
+{
+	const short a0 = (alpha_channel == 0 ? -1 : 0);
+	const short a1 = (alpha_channel == 1 ? -1 : 0);
+	const short a2 = (alpha_channel == 2 ? -1 : 0);
+	const short a3 = (alpha_channel == 3 ? -1 : 0);
+	
+	const __m128i mask = _mm_set_epi16(a3, a2, a1, a0, a3, a2, a1, a0);
+	const __m128i alpha = _mm_or_si128(_mm_and_si128(_mm_loadu_si128((const __m128i *)pix), mask),
+										_mm_and_si128(_mm_loadu_si128((const __m128i *)(pix + 8)), mask));
+	
+	return (_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, _mm_setzero_si128())) != 0xffff);
+}
+
+static inline bool
+AnyAlpha4(const float *pix, int alpha_channel)
+{
+	const __m128 zero = _mm_setzero_ps();
+	
+	const int nonzero = _mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(pix), zero)) |
+						_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(pix + 4), zero)) |
+						_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(pix + 8), zero)) |
+						_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(pix + 12), zero));
+	
+	return ((nonzero & (1 << alpha_channel)) != 0);
+}
+
+#else
+
+template <typename T>
+static inline bool
+AnyAlpha4(const T *pix, int alpha_channel)
+{
+	return (pix[alpha_channel] != 0 || pix[4 + alpha_channel] != 0 ||
+			pix[8 + alpha_channel] != 0 || pix[12 + alpha_channel] != 0);
+}
+
+#endif // MOX_USE_SSE2
+
+
+// first pixel in [begin, end) with some alpha, or -1
+template <typename T>
+static int
+FirstAlpha(const T *row, int begin, int end, int alpha_channel)
+{
+	int x = begin;
+	
+	while(x + 4 <= end && !AnyAlpha4(row + (x * 4), alpha_channel))
+		x += 4;
+	
+	for(; x < end; x++)
+	{
+		if(row[(x * 4) + alpha_channel] != 0)
+			return x;
+	}
+	
+	return -1;
+}
+
+// last pixel in [begin, end) with some alpha, or -1
+template <typename T>
+static int
+LastAlpha(const T *row, int begin, int end, int alpha_channel)
+{
+	int x = end;
+	
+	while(x - 4 >= begin && !AnyAlpha4(row + ((x - 4) * 4), alpha_channel))
+		x -= 4;
+	
+	for(x = x - 1; x >= begin; x--)
+	{
+		if(row[(x * 4) + alpha_channel] != 0)
+			return x;
+	}
+	
+	return -1;
+}
+
+
+template <typename T>
+static MoxRect
+AlphaBounds(const char *origin, ptrdiff_t rowbytes, int width, int height, int alpha_channel)
+{
+	int left = width, top = height, right = 0, bottom = 0;
+	
+	for(int y=0; y < height; y++)
+	{
+		const T *row = (const T *)(origin + (rowbytes * y));
+		
+		// only have to look outside what we've already found
+		const int first = FirstAlpha(row, 0, left, alpha_channel);
+		
+		bool found = (first >= 0);
+		
+		if(found)
+			left = first;
+		
+		const int last = LastAlpha(row, right, width, alpha_channel);
+		
+		if(last >= 0)
+		{
+			right = last + 1;
+			found = true;
+		}
+		
+		// still need to know if the row counts for top and bottom
+		if(!found)
+			found = (FirstAlpha(row, left, right, alpha_channel) >= 0);
+		
+		if(found)
+		{
+			if(y < top)
+				top = y;
+			
+			bottom = y + 1;
+		}
+	}
+	
+	if(right <= left)
+		return MoxRect();
+	
+	return MoxRect(left, top, right, bottom);
+}
+
+
+MoxRect
+MoxAlphaBounds(const char *origin, ptrdiff_t rowbytes, int width, int height,
+				MoxFiles::PixelType type, const char *order)
+{
+	using namespace MoxFiles;
+
+	assert(order != NULL && strlen(order) == 4);
+	
+	const char *alpha = strchr(order, 'A');
+	
+	if(alpha == NULL)
+		return MoxRect(0, 0, width, height);
+	
+	const int alpha_channel = alpha - order;
+	
+	switch(type)
+	{
+		case UINT8:
+			return AlphaBounds<unsigned char>(origin, rowbytes, width, height, alpha_channel);
+		
+		case UINT16:
+		case UINT16A:
+			return AlphaBounds<unsigned short>(origin, rowbytes, width, height, alpha_channel);
+		
+		case FLOAT:
+			return AlphaBounds<float>(origin, rowbytes, width, height, alpha_channel);
+		
+		default:
+			return MoxRect(0, 0, width, height);
+	}
+}
+
+
+MoxMxf::UInt64
+MoxFrameHash(const char *origin, ptrdiff_t rowbytes, int width, int height, MoxFiles::PixelType type)
+{
+	const size_t row_size = (size_t)width * 4 * MoxFiles::PixelSize(type);
+	
+	// each row is seeded with the hash so far
+	MoxMxf::UInt64 hash = ((MoxMxf::UInt64)width << 32) | (MoxMxf::UInt32)height;
+	
+	const char *row = origin;
+	
+	for(int y = 0; y < height; y++)
+	{
+		hash = MoxHash64(row, row_size, hash);
+		
+		row += rowbytes;
+	}
+	
+	return hash;
+}
+
+
+MoxRect
+MoxRect::intersect(const MoxRect &other) const
+{
+	MoxRect result(left > other.left ? left : other.left,
+					top > other.top ? top : other.top,
+					right < other.right ? right : other.right,
+					bottom < other.bottom ? bottom : other.bottom);
+	
+	if(result.empty())
+		return MoxRect();
+	else
+		return result;
+}
+
+
+bool
+MoxRect::contains(const MoxRect &other) const
+{
+	return (other.left >= left && other.top >= top && other.right <= right && other.bottom <= bottom);
+}
+
+
+MoxFrame::MoxFrame(int width, int height, MoxFiles::PixelType type, const char *order) :
+	_width(width),
+	_height(height),
+	_type(type),
+	_rowbytes(0),
+	_data(NULL)
+{
+	if(width <= 0 || height <= 0)
+		throw MoxMxf::ArgExc("Invalid frame size");
+
+	if(order == NULL || strlen(order) != 4)
+		throw MoxMxf::ArgExc("Invalid channel order");
+	
+	strncpy(_order, order, 5);
+	
+	_rowbytes = pixelSize() * _width;
+	
+	_data = (char *)MoxBufferPool::allocate( size() );
+	
+	MoxMemory::add(MoxMemory::FRAMES, size());
+}
+
+
+MoxFrame::~MoxFrame()
+{
+	MoxBufferPool::release(_data, size());
+	
+	MoxMemory::remove(MoxMemory::FRAMES, size());
+}
+
+
+size_t
+MoxFrame::pixelSize() const
+{
+	return 4 * MoxFiles::PixelSize(_type);
+}
+
+
+bool
+MoxFrame::matches(int width, int height, MoxFiles::PixelType type, const char *order) const
+{
+	return (width == _width && height == _height && type == _type && strcmp(order, _order) == 0);
+}
+
+
+void
+MoxFrame::insertSlices(MoxFiles::FrameBuffer &frame_buffer)
+{
+	MoxInsertSlices(frame_buffer, _data, _rowbytes, _type, _order);
+}
+
+
+void
+MoxFrame::copyTo(char *dest, ptrdiff_t dest_rowbytes, const MoxRect *region) const
+{
+	if(region != NULL && !region->contains(MoxRect(0, 0, _width, _height)))
+	{
+		const MoxRect copy_region = region->intersect(MoxRect(0, 0, _width, _height));
+		
+		const size_t pixel_size = pixelSize();
+		const size_t copy_bytes = copy_region.width() * pixel_size;
+		
+		for(int y = copy_region.top; y < copy_region.bottom; y++)
+		{
+			memcpy(dest + (y * dest_rowbytes) + (copy_region.left * pixel_size),
+					_data + (y * _rowbytes) + (copy_region.left * pixel_size),
+					copy_bytes);
+		}
+	}
+	else if(dest_rowbytes == _rowbytes)
+	{
+		memcpy(dest, _data, size());
+	}
+	else
+	{
+		const char *src_row = _data;
+		char *dest_row = dest;
+		
+		for(int y = 0; y < _height; y++)
+		{
+			memcpy(dest_row, src_row, _rowbytes);
+			
+			src_row += _rowbytes;
+			dest_row += dest_rowbytes;
+		}
+	}
+}
+
+
+void
+MoxFrame::copyFrom(const char *source, ptrdiff_t source_rowbytes)
+{
+	if(source_rowbytes == _rowbytes)
+	{
+		memcpy(_data, source, size());
+	}
+	else
+	{
+		const char *src_row = source;
+		char *dest_row = _data;
+		
+		for(int y = 0; y < _height; y++)
+		{
+			memcpy(dest_row, src_row, _rowbytes);
+			
+			src_row += source_rowbytes;
+			dest_row += _rowbytes;
+		}
+	}
+}
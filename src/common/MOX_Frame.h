@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_FRAME_H
+#define MOX_FRAME_H
+
+#include <MoxFiles/InputFile.h>
+
+#include <stddef.h>
+
+// The hosts want 4-channel interleaved pixels, but in different orders.
+// After Effects is ARGB, Premiere is BGRA.
+// Channel order is passed around as a 4-character string like "ARGB".
+
+double MoxAlphaFill(MoxFiles::PixelType type);
+
+
+// Pixel rectangle, right and bottom are not included
+struct MoxRect
+{
+	int left;
+	int top;
+	int right;
+	int bottom;
+	
+	MoxRect() : left(0), top(0), right(0), bottom(0) {}
+	MoxRect(int l, int t, int r, int b) : left(l), top(t), right(r), bottom(b) {}
+	
+	int width() const { return right - left; }
+	int height() const { return bottom - top; }
+	bool empty() const { return (right <= left || bottom <= top); }
+	
+	MoxRect intersect(const MoxRect &other) const;
+	bool contains(const MoxRect &other) const;
+};
+
+// Four slices, one per channel in order, all interleaved in one pixel.
+// MoxFiles::FrameBuffer does the conversion to and from the codec,
+// one slice at a time.  A whole-pixel path for this case would have to
+// go into MoxFiles, which isn't part of this tree.
+void MoxInsertSlices(MoxFiles::FrameBuffer &frame_buffer, char *origin, ptrdiff_t rowbytes,
+						MoxFiles::PixelType type, const char *order);
+
+// Smallest rect holding every pixel with some alpha, empty if it's all clear.
+// Pixel types we don't know how to look at get the whole frame.
+MoxRect MoxAlphaBounds(const char *origin, ptrdiff_t rowbytes, int width, int height,
+						MoxFiles::PixelType type, const char *order);
+
+// Hash of the pixels (4 channels), ignoring any padding at the ends of the rows.
+MoxMxf::UInt64 MoxFrameHash(const char *origin, ptrdiff_t rowbytes, int width, int height,
+							MoxFiles::PixelType type);
+
+
+// A decoded frame held in our own memory, in the host's interleaved layout.
+class MoxFrame
+{
+  public:
+	MoxFrame(int width, int height, MoxFiles::PixelType type, const char *order);
+	~MoxFrame();
+	
+	int width() const { return _width; }
+	int height() const { return _height; }
+	MoxFiles::PixelType type() const { return _type; }
+	const char * order() const { return _order; }
+	
+	size_t pixelSize() const;
+	ptrdiff_t rowbytes() const { return _rowbytes; }
+	size_t size() const { return _rowbytes * _height; }
+	
+	char * data() { return _data; }
+	const char * data() const { return _data; }
+	
+	bool matches(int width, int height, MoxFiles::PixelType type, const char *order) const;
+	
+	void insertSlices(MoxFiles::FrameBuffer &frame_buffer);
+	
+	// dest_rowbytes can be negative for bottom-up buffers
+	// If region is not NULL, only those pixels are copied.
+	void copyTo(char *dest, ptrdiff_t dest_rowbytes, const MoxRect *region = NULL) const;
+	void copyFrom(const char *source, ptrdiff_t source_rowbytes);
+	
+  private:
+	const int _width;
+	const int _height;
+	const MoxFiles::PixelType _type;
+	char _order[5];
+	
+	ptrdiff_t _rowbytes;
+	char *_data;
+	
+	MoxFrame(const MoxFrame &);
+	MoxFrame & operator = (const MoxFrame &);
+};
+
+#endif // MOX_FRAME_H
@@ -0,0 +1,322 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_FrameCache.h"
+
+#include <string.h>
+#include <assert.h>
+
+
+IlmThread::Mutex MoxFrameCache::_id_mutex;
+unsigned int MoxFrameCache::_next_id = 1;
+
+
+MoxFrameCache::Key::Key(unsigned int f, int fr, MoxFiles::PixelType t, int w, int h, const char *o) :
+	file_id(f),
+	frame(fr),
+	type(t),
+	width(w),
+	height(h)
+{
+	strncpy(order, o, 5);
+	order[4] = '\0';
+}
+
+
+bool
+MoxFrameCache::Key::operator < (const Key &other) const
+{
+	if(file_id != other.file_id)
+		return file_id < other.file_id;
+	else if(frame != other.frame)
+		return frame < other.frame;
+	else if(type != other.type)
+		return type < other.type;
+	else if(width != other.width)
+		return width < other.width;
+	else if(height != other.height)
+		return height < other.height;
+	else
+		return strcmp(order, other.order) < 0;
+}
+
+
+MoxFrameCache::MoxFrameCache(size_t max_bytes) :
+	_max_bytes(max_bytes),
+	_bytes(0),
+	_hits(0),
+	_misses(0),
+	_evictions(0)
+{
+
+}
+
+
+MoxFrameCache::~MoxFrameCache()
+{
+	for(EntryList::iterator i = _entries.begin(); i != _entries.end(); ++i)
+		delete i->frame;
+}
+
+
+unsigned int
+MoxFrameCache::newFileID()
+{
+	IlmThread::Lock lock(_id_mutex);
+	
+	return _next_id++;
+}
+
+
+bool
+MoxFrameCache::fetch(const Key &key, char *dest, ptrdiff_t rowbytes, const MoxRect *region)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	EntryMap::iterator i = _map.find(key);
+	
+	if(i == _map.end())
+	{
+		_misses++;
+		
+		return false;
+	}
+	
+	_hits++;
+	
+	EntryList::iterator entry = i->second;
+	
+	entry->frame->copyTo(dest, rowbytes, region);
+	
+	_entries.splice(_entries.begin(), _entries, entry);
+	
+	return true;
+}
+
+
+bool
+MoxFrameCache::contains(const Key &key) const
+{
+	IlmThread::Lock lock(_mutex);
+	
+	return (_map.find(key) != _map.end());
+}
+
+
+void
+MoxFrameCache::insert(const Key &key, const char *source, ptrdiff_t rowbytes)
+{
+	const size_t frame_bytes = (size_t)key.width * (size_t)key.height * 4 * MoxFiles::PixelSize(key.type);
+	
+	IlmThread::Lock lock(_mutex);
+	
+	if(frame_bytes > _max_bytes)
+		return;
+	
+	EntryMap::iterator i = _map.find(key);
+	
+	if(i != _map.end())
+	{
+		// already have it, call it used
+		_entries.splice(_entries.begin(), _entries, i->second);
+		
+		return;
+	}
+	
+	trimLocked(_max_bytes - frame_bytes);
+	
+	lock.release();
+	
+	MoxFrame *frame = NULL;
+	
+	try
+	{
+		frame = new MoxFrame(key.width, key.height, key.type, key.order);
+	}
+	catch(...)
+	{
+		return; // out of memory isn't worth failing the draw over
+	}
+	
+	frame->copyFrom(source, rowbytes);
+	
+	lock.acquire();
+	
+	if(_map.find(key) != _map.end())
+	{
+		delete frame; // somebody beat us to it
+		
+		return;
+	}
+	
+	_entries.push_front(Entry(key, frame));
+	
+	_map[key] = _entries.begin();
+	
+	_bytes += frame->size();
+	
+	trimLocked(_max_bytes);
+}
+
+
+void
+MoxFrameCache::invalidate(unsigned int file_id)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	const Key low(file_id, -2147483647 - 1, MoxFiles::UINT8, 0, 0, "");
+	
+	EntryMap::iterator i = _map.lower_bound(low);
+	
+	while(i != _map.end() && i->first.file_id == file_id)
+	{
+		EntryMap::iterator next = i;
+		++next;
+		
+		erase(i);
+		
+		i = next;
+	}
+}
+
+
+void
+MoxFrameCache::invalidateChanged(unsigned int file_id, const std::vector<bool> &unchanged)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	const Key low(file_id, -2147483647 - 1, MoxFiles::UINT8, 0, 0, "");
+	
+	EntryMap::iterator i = _map.lower_bound(low);
+	
+	while(i != _map.end() && i->first.file_id == file_id)
+	{
+		EntryMap::iterator next = i;
+		++next;
+		
+		const int frame = i->first.frame;
+		
+		if(frame < 0 || frame >= (int)unchanged.size() || !unchanged[frame])
+			erase(i);
+		
+		i = next;
+	}
+}
+
+
+size_t
+MoxFrameCache::trim(size_t max_bytes)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	return trimLocked(max_bytes);
+}
+
+
+void
+MoxFrameCache::setMaxBytes(size_t max_bytes)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	_max_bytes = max_bytes;
+	
+	trimLocked(_max_bytes);
+}
+
+
+size_t
+MoxFrameCache::maxBytes() const
+{
+	IlmThread::Lock lock(_mutex);
+	
+	return _max_bytes;
+}
+
+
+MoxFrameCache::Stats
+MoxFrameCache::stats() const
+{
+	IlmThread::Lock lock(_mutex);
+	
+	Stats stats;
+	
+	stats.hits = _hits;
+	stats.misses = _misses;
+	stats.evictions = _evictions;
+	stats.bytes = _bytes;
+	stats.frames = _entries.size();
+	
+	return stats;
+}
+
+
+void
+MoxFrameCache::erase(EntryMap::iterator i)
+{
+	EntryList::iterator entry = i->second;
+	
+	assert(_bytes >= entry->frame->size());
+	
+	_bytes -= entry->frame->size();
+	
+	delete entry->frame;
+	
+	_entries.erase(entry);
+	
+	_map.erase(i);
+}
+
+
+size_t
+MoxFrameCache::trimLocked(size_t max_bytes)
+{
+	const size_t start_bytes = _bytes;
+
+	while(_bytes > max_bytes && !_entries.empty())
+	{
+		EntryMap::iterator i = _map.find(_entries.back().key);
+		
+		assert(i != _map.end());
+		
+		erase(i);
+		
+		_evictions++;
+	}
+	
+	return (start_bytes - _bytes);
+}
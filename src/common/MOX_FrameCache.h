@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_FRAMECACHE_H
+#define MOX_FRAMECACHE_H
+
+#include "MOX_Frame.h"
+
+#include <IlmThreadMutex.h>
+
+#include <list>
+#include <map>
+#include <vector>
+
+// Decoded frames, shared by every open file and thrown out
+// least-recently-used first when we go over the byte budget.
+
+class MoxFrameCache
+{
+  public:
+	MoxFrameCache(size_t max_bytes = 0);
+	~MoxFrameCache();
+	
+	struct Key
+	{
+		unsigned int file_id;
+		int frame;
+		MoxFiles::PixelType type;
+		int width;
+		int height;
+		char order[5];
+		
+		Key(unsigned int file_id, int frame, MoxFiles::PixelType type, int width, int height, const char *order);
+		
+		bool operator < (const Key &other) const;
+	};
+	
+	// Every file needs an ID that is never used again, so frames from
+	// a closed file can't be mistaken for frames from a new one.
+	static unsigned int newFileID();
+	
+	// copies the frame (or just the region) into dest if we have it
+	bool fetch(const Key &key, char *dest, ptrdiff_t rowbytes, const MoxRect *region = NULL);
+	
+	void insert(const Key &key, const char *source, ptrdiff_t rowbytes);
+	
+	// doesn't count as a hit or miss, or as using the frame
+	bool contains(const Key &key) const;
+	
+	void invalidate(unsigned int file_id);
+	
+	// When a file has been written over, throw out its frames
+	// except the ones marked as unchanged.
+	void invalidateChanged(unsigned int file_id, const std::vector<bool> &unchanged);
+	
+	// Throw out frames until we're using no more than max_bytes.
+	// Returns the number of bytes freed.
+	size_t trim(size_t max_bytes);
+	
+	void setMaxBytes(size_t max_bytes);
+	size_t maxBytes() const;
+	
+	struct Stats
+	{
+		unsigned long hits;
+		unsigned long misses;
+		unsigned long evictions;
+		size_t bytes;
+		size_t frames;
+	};
+	
+	Stats stats() const;
+	
+  private:
+	size_t _max_bytes;
+	size_t _bytes;
+	
+	struct Entry
+	{
+		Key key;
+		MoxFrame *frame;
+		
+		Entry(const Key &k, MoxFrame *f) : key(k), frame(f) {}
+	};
+	
+	typedef std::list<Entry> EntryList;
+	typedef std::map<Key, EntryList::iterator> EntryMap;
+	
+	EntryList _entries; // front is most recently used
+	EntryMap _map;
+	
+	unsigned long _hits;
+	unsigned long _misses;
+	unsigned long _evictions;
+	
+	IlmThread::Mutex _mutex;
+	
+	void erase(EntryMap::iterator i);
+	size_t trimLocked(size_t max_bytes);
+	
+	static IlmThread::Mutex _id_mutex;
+	static unsigned int _next_id;
+	
+	MoxFrameCache(const MoxFrameCache &);
+	MoxFrameCache & operator = (const MoxFrameCache &);
+};
+
+#endif // MOX_FRAMECACHE_H
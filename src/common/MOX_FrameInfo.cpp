@@ -0,0 +1,354 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_FrameInfo.h"
+
+#include "MOX_Bytes.h"
+#include "MOX_Platform.h"
+
+#include <assert.h>
+
+
+static const char kInfoMagic[8] = { 'M', 'O', 'X', 'I', 'N', 'F', 'O', '\0' };
+static const MoxMxf::UInt32 kInfoVersion = 1;
+
+static const size_t kMaxInfoSize = 256 * 1024 * 1024;
+
+// Each kind of info gets its own section, so older plug-ins can skip
+// the ones they don't know about.
+static const MoxMxf::UInt32 kBoundsSection = 0x534e4442; // 'BDNS'
+static const MoxMxf::UInt32 kHashSection = 0x48534148; // 'HASH'
+static const MoxMxf::UInt32 kPeakSection = 0x4b414550; // 'PEAK'
+static const MoxMxf::UInt32 kProxySection = 0x59585250; // 'PRXY'
+
+
+MoxFrameInfo::Frame &
+MoxFrameInfo::frame(int frame)
+{
+	assert(frame >= 0);
+	
+	if(frame >= (int)_frames.size())
+		_frames.resize(frame + 1);
+	
+	return _frames[frame];
+}
+
+
+void
+MoxFrameInfo::setBounds(int frame_num, const MoxRect &bounds)
+{
+	if(frame_num < 0)
+		return;
+	
+	Frame &f = frame(frame_num);
+	
+	f.has_bounds = true;
+	f.bounds = bounds;
+}
+
+
+bool
+MoxFrameInfo::getBounds(int frame, MoxRect &bounds) const
+{
+	if(frame < 0 || frame >= (int)_frames.size() || !_frames[frame].has_bounds)
+		return false;
+	
+	bounds = _frames[frame].bounds;
+	
+	return true;
+}
+
+
+void
+MoxFrameInfo::setHash(int frame_num, MoxMxf::UInt64 hash)
+{
+	if(frame_num < 0)
+		return;
+	
+	Frame &f = frame(frame_num);
+	
+	f.has_hash = true;
+	f.hash = hash;
+	
+	FirstMap::iterator first = _first.find(hash);
+	
+	if(first == _first.end() || frame_num < first->second)
+		_first[hash] = frame_num;
+}
+
+
+bool
+MoxFrameInfo::getHash(int frame, MoxMxf::UInt64 &hash) const
+{
+	if(frame < 0 || frame >= (int)_frames.size() || !_frames[frame].has_hash)
+		return false;
+	
+	hash = _frames[frame].hash;
+	
+	return true;
+}
+
+
+int
+MoxFrameInfo::sourceFrame(int frame) const
+{
+	MoxMxf::UInt64 hash = 0;
+	
+	if( !getHash(frame, hash) )
+		return frame;
+	
+	FirstMap::const_iterator first = _first.find(hash);
+	
+	return (first != _first.end() ? first->second : frame);
+}
+
+
+void
+MoxFrameInfo::setProxy(MoxMxf::UInt64 size, MoxMxf::UInt64 modified)
+{
+	_has_proxy = true;
+	_proxy_size = size;
+	_proxy_modified = modified;
+}
+
+
+bool
+MoxFrameInfo::getProxy(MoxMxf::UInt64 &size, MoxMxf::UInt64 &modified) const
+{
+	if(!_has_proxy)
+		return false;
+	
+	size = _proxy_size;
+	modified = _proxy_modified;
+	
+	return true;
+}
+
+
+void
+MoxFrameInfo::findFirsts()
+{
+	_first.clear();
+	
+	for(int i = (int)_frames.size() - 1; i >= 0; i--)
+	{
+		if(_frames[i].has_hash)
+			_first[ _frames[i].hash ] = i;
+	}
+}
+
+
+std::string
+MoxFrameInfo::sidecarPath(const std::string &movie_path)
+{
+	return movie_path + ".moxinfo";
+}
+
+
+bool
+MoxFrameInfo::write(const std::string &movie_path) const
+{
+	MoxMxf::UInt64 movie_size = 0, movie_modified = 0;
+	
+	if(empty() || !MoxFileStat(movie_path, &movie_size, &movie_modified))
+		return false;
+	
+	MoxByteWriter writer;
+	
+	writer.putBytes(kInfoMagic, sizeof(kInfoMagic));
+	writer.putInt(kInfoVersion, 4);
+	
+	writer.putInt(movie_size, 8);
+	writer.putInt(movie_modified, 8);
+	
+	writer.putInt(_frames.size(), 4);
+	
+	
+	MoxByteWriter bounds, hashes;
+	bool have_bounds = false, have_hashes = false;
+	
+	for(std::vector<Frame>::const_iterator i = _frames.begin(); i != _frames.end(); ++i)
+	{
+		bounds.putInt(i->has_bounds ? 1 : 0, 1);
+		bounds.putInt(i->bounds.left, 4);
+		bounds.putInt(i->bounds.top, 4);
+		bounds.putInt(i->bounds.right, 4);
+		bounds.putInt(i->bounds.bottom, 4);
+		
+		hashes.putInt(i->has_hash ? 1 : 0, 1);
+		hashes.putInt(i->hash, 8);
+		
+		have_bounds = (have_bounds || i->has_bounds);
+		have_hashes = (have_hashes || i->has_hash);
+	}
+	
+	if(have_bounds)
+	{
+		writer.putInt(kBoundsSection, 4);
+		writer.putInt(bounds.size(), 4);
+		writer.putBytes(bounds.data());
+	}
+	
+	if(have_hashes)
+	{
+		writer.putInt(kHashSection, 4);
+		writer.putInt(hashes.size(), 4);
+		writer.putBytes(hashes.data());
+	}
+	
+	if( !_peaks.empty() )
+	{
+		MoxByteWriter peaks;
+		
+		_peaks.write(peaks);
+		
+		writer.putInt(kPeakSection, 4);
+		writer.putInt(peaks.size(), 4);
+		writer.putBytes(peaks.data());
+	}
+	
+	if(_has_proxy)
+	{
+		writer.putInt(kProxySection, 4);
+		writer.putInt(16, 4);
+		writer.putInt(_proxy_size, 8);
+		writer.putInt(_proxy_modified, 8);
+	}
+	
+	
+	writer.putChecksum();
+	
+	return MoxWriteFile(sidecarPath(movie_path), writer.data());
+}
+
+
+bool
+MoxFrameInfo::read(const std::string &movie_path)
+{
+	clear();
+
+	MoxMxf::UInt64 movie_size = 0, movie_modified = 0;
+	
+	if( !MoxFileStat(movie_path, &movie_size, &movie_modified) )
+		return false;
+	
+	std::string buf;
+	
+	if( !MoxReadFile(sidecarPath(movie_path), buf, kMaxInfoSize) )
+		return false;
+	
+	MoxByteReader reader(buf);
+	
+	const std::string magic = reader.getBytes(sizeof(kInfoMagic));
+	
+	if(magic != std::string(kInfoMagic, sizeof(kInfoMagic)) || reader.getInt(4) != kInfoVersion || !reader.checksumOK())
+		return false;
+	
+	if(reader.getInt(8) != movie_size || reader.getInt(8) != movie_modified)
+		return false; // movie has changed since
+	
+	const MoxMxf::UInt64 frame_count = reader.getInt(4);
+	
+	if(!reader.ok() || frame_count > buf.size())
+		return false;
+	
+	std::vector<Frame> frames((size_t)frame_count);
+	
+	MoxAudioPeaks peaks;
+	
+	bool has_proxy = false;
+	MoxMxf::UInt64 proxy_size = 0, proxy_modified = 0;
+	
+	while(reader.ok() && !reader.atEnd())
+	{
+		const MoxMxf::UInt64 section = reader.getInt(4);
+		const MoxMxf::UInt64 section_size = reader.getInt(4);
+		
+		if(section == kBoundsSection && section_size == frame_count * 17)
+		{
+			for(std::vector<Frame>::iterator i = frames.begin(); i != frames.end(); ++i)
+			{
+				i->has_bounds = (reader.getInt(1) != 0);
+				i->bounds.left = (MoxMxf::UInt32)reader.getInt(4);
+				i->bounds.top = (MoxMxf::UInt32)reader.getInt(4);
+				i->bounds.right = (MoxMxf::UInt32)reader.getInt(4);
+				i->bounds.bottom = (MoxMxf::UInt32)reader.getInt(4);
+			}
+		}
+		else if(section == kHashSection && section_size == frame_count * 9)
+		{
+			for(std::vector<Frame>::iterator i = frames.begin(); i != frames.end(); ++i)
+			{
+				i->has_hash = (reader.getInt(1) != 0);
+				i->hash = reader.getInt(8);
+			}
+		}
+		else if(section == kPeakSection)
+		{
+			const std::string section_data = reader.getBytes((size_t)section_size);
+			
+			MoxByteReader section_reader(section_data);
+			
+			if(reader.ok() && !peaks.read(section_reader, section_size))
+				peaks.clear();
+		}
+		else if(section == kProxySection && section_size == 16)
+		{
+			proxy_size = reader.getInt(8);
+			proxy_modified = reader.getInt(8);
+			
+			has_proxy = true;
+		}
+		else
+			reader.skip((size_t)section_size);
+	}
+	
+	if(!reader.ok())
+		return false;
+	
+	_frames.swap(frames);
+	_peaks = peaks;
+	
+	_has_proxy = has_proxy;
+	_proxy_size = proxy_size;
+	_proxy_modified = proxy_modified;
+	
+	findFirsts();
+	
+	return true;
+}
@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_FRAMEINFO_H
+#define MOX_FRAMEINFO_H
+
+#include "MOX_Frame.h"
+#include "MOX_AudioPeaks.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Things the exporters learn about each frame that would be expensive
+// to figure out again when importing, like where the alpha is.
+// MoxFiles doesn't have anywhere to put these in the movie itself, so they
+// go in a file next to it: movie.mxf -> movie.mxf.moxinfo
+class MoxFrameInfo
+{
+  public:
+	MoxFrameInfo() : _has_proxy(false), _proxy_size(0), _proxy_modified(0) {}
+	~MoxFrameInfo() {}
+	
+	void setBounds(int frame, const MoxRect &bounds);
+	bool getBounds(int frame, MoxRect &bounds) const;
+	
+	// Hash of the frame's pixels as the exporter saw them.  Frames that
+	// hash the same decode the same, so held frames only need decoding once.
+	void setHash(int frame, MoxMxf::UInt64 hash);
+	bool getHash(int frame, MoxMxf::UInt64 &hash) const;
+	
+	// First frame that looks exactly like this one, maybe itself.
+	int sourceFrame(int frame) const;
+	
+	// for drawing the audio waveform
+	MoxAudioPeaks & peaks() { return _peaks; }
+	const MoxAudioPeaks & peaks() const { return _peaks; }
+	
+	// Size and date of the proxy movie we wrote with this one (MOX_Proxy.h),
+	// so we know it's the same one when we go to use it.
+	void setProxy(MoxMxf::UInt64 size, MoxMxf::UInt64 modified);
+	bool getProxy(MoxMxf::UInt64 &size, MoxMxf::UInt64 &modified) const;
+	
+	bool empty() const { return (_frames.empty() && _peaks.empty() && !_has_proxy); }
+	void clear() { _frames.clear(); _first.clear(); _peaks.clear(); _has_proxy = false; }
+	
+	// Tied to the movie's size and modification date, so write this after
+	// the movie is closed and it'll be ignored if the movie changes.
+	bool write(const std::string &movie_path) const;
+	bool read(const std::string &movie_path);
+	
+	static std::string sidecarPath(const std::string &movie_path);
+	
+  private:
+	struct Frame
+	{
+		bool has_bounds;
+		MoxRect bounds;
+		
+		bool has_hash;
+		MoxMxf::UInt64 hash;
+		
+		Frame() : has_bounds(false), has_hash(false), hash(0) {}
+	};
+	
+	std::vector<Frame> _frames;
+	
+	typedef std::map<MoxMxf::UInt64, int> FirstMap;
+	FirstMap _first; // hash -> earliest frame with it
+	
+	void findFirsts();
+	
+	MoxAudioPeaks _peaks;
+	
+	bool _has_proxy;
+	MoxMxf::UInt64 _proxy_size;
+	MoxMxf::UInt64 _proxy_modified;
+	
+	Frame & frame(int frame);
+};
+
+#endif // MOX_FRAMEINFO_H
@@ -0,0 +1,587 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_IndexCache.h"
+
+#include "MOX_Bytes.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+
+static const char kEntryMagic[8] = { 'M', 'O', 'X', 'I', 'N', 'D', 'E', 'X' };
+static const MoxMxf::UInt32 kEntryVersion = 1;
+static const char *kEntryExtension = ".moxidx";
+
+
+MoxIndexStream::MoxIndexStream(MoxMxf::IOStream &stream) :
+	_stream(stream),
+	_owned(NULL),
+	_position(0),
+	_stream_positioned(false),
+	_extent_bytes(0),
+	_file_size(0),
+	_modified(0),
+	_from_cache(false),
+	_recording(false),
+	_dirty(false),
+	_passthrough(true),
+	_max_record(0)
+{
+
+}
+
+
+MoxIndexStream::~MoxIndexStream()
+{
+	delete _owned;
+}
+
+
+int
+MoxIndexStream::FileSeek(MoxMxf::UInt64 offset)
+{
+	if(_passthrough)
+	{
+		const int result = _stream.FileSeek(offset);
+		
+		_position = offset;
+		_stream_positioned = true;
+		
+		return result;
+	}
+	else
+	{
+		// wait until we actually have to go to the file
+		_position = offset;
+		_stream_positioned = false;
+		
+		return 0;
+	}
+}
+
+
+MoxMxf::UInt64
+MoxIndexStream::FileRead(unsigned char *dest, MoxMxf::UInt64 size)
+{
+	if( cached(dest, size) )
+	{
+		_position += size;
+		_stream_positioned = false;
+		
+		return size;
+	}
+	
+	if(!_stream_positioned)
+	{
+		_stream.FileSeek(_position);
+		_stream_positioned = true;
+	}
+	
+	const MoxMxf::UInt64 bytes = _stream.FileRead(dest, size);
+	
+	record(dest, bytes);
+	
+	_position += bytes;
+	
+	return bytes;
+}
+
+
+MoxMxf::UInt64
+MoxIndexStream::FileWrite(const unsigned char *source, MoxMxf::UInt64 size)
+{
+	// file is changing, so what we have is no good
+	_extents.clear();
+	_extent_bytes = 0;
+	_recording = false;
+	_passthrough = true;
+	
+	if(!_stream_positioned)
+	{
+		_stream.FileSeek(_position);
+		_stream_positioned = true;
+	}
+	
+	const MoxMxf::UInt64 bytes = _stream.FileWrite(source, size);
+	
+	_position += bytes;
+	
+	return bytes;
+}
+
+
+MoxMxf::UInt64
+MoxIndexStream::FileTell()
+{
+	return _position;
+}
+
+
+void
+MoxIndexStream::FileFlush()
+{
+	if(_stream_positioned)
+		_stream.FileFlush();
+}
+
+
+void
+MoxIndexStream::FileTruncate(MoxMxf::Int64 newsize)
+{
+	_extents.clear();
+	_extent_bytes = 0;
+	_recording = false;
+	_passthrough = true;
+	
+	_stream.FileTruncate(newsize);
+}
+
+
+MoxMxf::Int64
+MoxIndexStream::FileSize()
+{
+	if(_passthrough)
+		return _stream.FileSize();
+	else
+		return _file_size; // from the stat
+}
+
+
+bool
+MoxIndexStream::cached(unsigned char *dest, MoxMxf::UInt64 size)
+{
+	if(_passthrough || _extents.empty())
+		return false;
+	
+	ExtentMap::const_iterator extent = _extents.upper_bound(_position);
+	
+	if(extent == _extents.begin())
+		return false;
+	
+	--extent;
+	
+	if(extent->first + extent->second.size() < _position + size)
+		return false;
+	
+	memcpy(dest, extent->second.data() + (_position - extent->first), size);
+	
+	return true;
+}
+
+
+void
+MoxIndexStream::record(const unsigned char *source, MoxMxf::UInt64 size)
+{
+	if(!_recording || size == 0)
+		return;
+	
+	if(_extent_bytes + size > _max_record)
+	{
+		// This isn't just header and index, so don't bother
+		if(!_from_cache)
+		{
+			_extents.clear();
+			_extent_bytes = 0;
+		}
+		
+		_recording = false;
+		_dirty = false;
+		
+		return;
+	}
+	
+	const MoxMxf::UInt64 end = _position + size;
+	
+	ExtentMap::iterator extent = _extents.upper_bound(_position);
+	
+	if(extent != _extents.begin())
+	{
+		--extent;
+		
+		const MoxMxf::UInt64 extent_end = extent->first + extent->second.size();
+		
+		if(extent_end >= end)
+			return; // already have it
+		
+		if(extent_end >= _position)
+		{
+			// tack it onto the end
+			const MoxMxf::UInt64 skip = extent_end - _position;
+			
+			extent->second.append((const char *)source + skip, size - skip);
+			
+			_extent_bytes += (size - skip);
+			_dirty = true;
+			
+			return;
+		}
+	}
+	
+	_extents[_position] = std::string((const char *)source, size);
+	
+	_extent_bytes += size;
+	_dirty = true;
+}
+
+
+#pragma mark-
+
+
+MoxIndexCache::MoxIndexCache(size_t max_bytes) :
+	_max_bytes(max_bytes),
+	_looked_for_dir(false),
+	_total_bytes(0),
+	_have_total(false)
+{
+
+}
+
+
+void
+MoxIndexCache::setMaxBytes(size_t max_bytes)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	_max_bytes = max_bytes;
+	
+	if(_max_bytes > 0 && _looked_for_dir && !_dir.empty())
+		trim();
+}
+
+
+MoxIndexStream *
+MoxIndexCache::open(const MoxUTF16Char *path, MoxMxf::IOStream *stream)
+{
+	MoxIndexStream *index_stream = NULL;
+	
+	try
+	{
+		index_stream = open(path, *stream);
+	}
+	catch(...)
+	{
+		delete stream;
+		
+		throw;
+	}
+	
+	index_stream->_owned = stream;
+	
+	return index_stream;
+}
+
+
+MoxIndexStream *
+MoxIndexCache::open(const MoxUTF16Char *path, MoxMxf::IOStream &stream)
+{
+	MoxIndexStream *index_stream = new MoxIndexStream(stream);
+	
+	if(_max_bytes == 0 || path == NULL)
+		return index_stream;
+	
+	index_stream->_path = MoxUTF8Path(path);
+	
+	// the stat is the only thing that touches the file if we have it cached
+	if( !MoxFileStat(index_stream->_path, &index_stream->_file_size, &index_stream->_modified) )
+		return index_stream;
+	
+	index_stream->_passthrough = false;
+	index_stream->_max_record = std::min<size_t>(_max_bytes / 4, 16 * 1024 * 1024);
+	
+	IlmThread::Lock lock(_mutex);
+	
+	index_stream->_from_cache = load(*index_stream);
+	
+	// pick up anything the cache didn't have
+	index_stream->_recording = true;
+	
+	return index_stream;
+}
+
+
+void
+MoxIndexCache::store(MoxIndexStream &stream)
+{
+	if(stream._recording && stream._dirty && !stream._extents.empty())
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		save(stream);
+		
+		trim();
+	}
+	
+	stream._extents.clear();
+	stream._extent_bytes = 0;
+	stream._recording = false;
+	stream._dirty = false;
+	
+	// the next read will seek the file if it has to
+	stream._passthrough = true;
+}
+
+
+std::string
+MoxIndexCache::entryPath(const std::string &path)
+{
+	if(!_looked_for_dir)
+	{
+		_dir = MoxCacheDirectory("Index");
+		
+		_looked_for_dir = true;
+	}
+	
+	if( _dir.empty() )
+		return std::string();
+	
+	const MoxMxf::UInt64 hash = MoxChecksum(path.data(), path.size());
+	
+	char name[32];
+	sprintf(name, "%08x%08x", (unsigned int)(hash >> 32), (unsigned int)(hash & 0xffffffff));
+	
+	return _dir + "/" + name + kEntryExtension;
+}
+
+
+bool
+MoxIndexCache::load(MoxIndexStream &stream)
+{
+	const std::string entry_path = entryPath(stream._path);
+	
+	if( entry_path.empty() )
+		return false;
+	
+	std::string buf;
+	
+	if( !MoxReadFile(entry_path, buf, _max_bytes) )
+		return false;
+	
+	MoxByteReader reader(buf);
+	
+	const std::string magic = reader.getBytes(sizeof(kEntryMagic));
+	
+	if(magic != std::string(kEntryMagic, sizeof(kEntryMagic)) || reader.getInt(4) != kEntryVersion)
+		return false;
+	
+	if( !reader.checksumOK() )
+	{
+		deleteEntry(entry_path);
+		
+		return false;
+	}
+	
+	const std::string path = reader.getBytes(reader.getInt(4));
+	const MoxMxf::UInt64 file_size = reader.getInt(8);
+	const MoxMxf::UInt64 modified = reader.getInt(8);
+	
+	if(!reader.ok() || path != stream._path || file_size != stream._file_size || modified != stream._modified)
+		return false; // different file, or it changed
+	
+	const MoxMxf::UInt64 extent_count = reader.getInt(4);
+	
+	MoxIndexStream::ExtentMap extents;
+	size_t extent_bytes = 0;
+	
+	for(MoxMxf::UInt64 i=0; i < extent_count && reader.ok(); i++)
+	{
+		const MoxMxf::UInt64 offset = reader.getInt(8);
+		const MoxMxf::UInt64 len = reader.getInt(4);
+		
+		extents[offset] = reader.getBytes(len);
+		
+		extent_bytes += len;
+	}
+	
+	if(!reader.ok())
+		return false;
+	
+	stream._extents.swap(extents);
+	stream._extent_bytes = extent_bytes;
+	
+	return true;
+}
+
+
+void
+MoxIndexCache::save(const MoxIndexStream &stream)
+{
+	const std::string entry_path = entryPath(stream._path);
+	
+	if( entry_path.empty() )
+		return;
+	
+	MoxByteWriter writer;
+	
+	writer.putBytes(kEntryMagic, sizeof(kEntryMagic));
+	writer.putInt(kEntryVersion, 4);
+	
+	writer.putInt(stream._path.size(), 4);
+	writer.putBytes(stream._path);
+	
+	writer.putInt(stream._file_size, 8);
+	writer.putInt(stream._modified, 8);
+	
+	writer.putInt(stream._extents.size(), 4);
+	
+	for(MoxIndexStream::ExtentMap::const_iterator i = stream._extents.begin(); i != stream._extents.end(); ++i)
+	{
+		writer.putInt(i->first, 8);
+		writer.putInt(i->second.size(), 4);
+		writer.putBytes(i->second);
+	}
+	
+	writer.putChecksum();
+	
+	if(writer.size() <= _max_bytes)
+	{
+		countTotal();
+		
+		// this replaces any entry that was there
+		MoxMxf::UInt64 old_size = 0, modified = 0;
+		
+		if( !MoxFileStat(entry_path, &old_size, &modified) )
+			old_size = 0;
+		
+		if( MoxWriteFile(entry_path, writer.data()) )
+			_total_bytes = _total_bytes - std::min(old_size, _total_bytes) + writer.size();
+	}
+}
+
+
+void
+MoxIndexCache::deleteEntry(const std::string &entry_path)
+{
+	MoxMxf::UInt64 size = 0, modified = 0;
+	
+	if( MoxFileStat(entry_path, &size, &modified) && MoxFileDelete(entry_path) && _have_total )
+		_total_bytes -= std::min(size, _total_bytes);
+}
+
+
+void
+MoxIndexCache::countTotal()
+{
+	if(_have_total || _dir.empty())
+		return;
+	
+	std::vector<MoxDirEntry> entries;
+	
+	MoxListDirectory(_dir, entries);
+	
+	_total_bytes = 0;
+	
+	for(std::vector<MoxDirEntry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+		_total_bytes += i->size;
+	
+	_have_total = true;
+}
+
+
+static bool
+OlderEntry(const MoxDirEntry &a, const MoxDirEntry &b)
+{
+	return (a.modified < b.modified);
+}
+
+
+void
+MoxIndexCache::trim()
+{
+	if( _dir.empty() )
+		return;
+	
+	countTotal();
+	
+	if(_total_bytes <= _max_bytes)
+		return;
+	
+	// only now do we need to see what's there
+	std::vector<MoxDirEntry> entries;
+	
+	MoxListDirectory(_dir, entries);
+	
+	MoxMxf::UInt64 total = 0;
+	
+	for(std::vector<MoxDirEntry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+		total += i->size;
+	
+	std::sort(entries.begin(), entries.end(), OlderEntry);
+	
+	for(std::vector<MoxDirEntry>::const_iterator i = entries.begin(); i != entries.end() && total > _max_bytes; ++i)
+	{
+		if( MoxFileDelete(i->path) )
+			total -= i->size;
+	}
+	
+	_total_bytes = total;
+}
+
+
+MoxIndexedStreamSource::MoxIndexedStreamSource(MoxIndexCache &cache, const MoxUTF16Char *path, MoxStreamSource *source) :
+	_cache(cache),
+	_source(source)
+{
+	if(path != NULL)
+	{
+		do{ _path.push_back(*path); }while(*path++ != 0);
+	}
+}
+
+
+MoxIndexedStreamSource::~MoxIndexedStreamSource()
+{
+	delete _source;
+}
+
+
+MoxMxf::IOStream *
+MoxIndexedStreamSource::openStream() const
+{
+	return _cache.open((_path.empty() ? NULL : &_path[0]), _source->openStream());
+}
+
+
+void
+MoxIndexedStreamSource::fileOpened(MoxMxf::IOStream &stream) const
+{
+	// only ever given streams we made
+	_cache.store( static_cast<MoxIndexStream &>(stream) );
+}
@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_INDEXCACHE_H
+#define MOX_INDEXCACHE_H
+
+#include "MOX_Platform.h"
+#include "MOX_StreamPool.h"
+
+#include <IlmThreadMutex.h>
+
+#include <map>
+#include <vector>
+
+// Sits between an InputFile and the real file while the InputFile opens.
+// Reads are either answered from what we saved last time or passed
+// through and remembered so we can save them for next time.
+class MoxIndexStream : public MoxMxf::IOStream
+{
+  public:
+	MoxIndexStream(MoxMxf::IOStream &stream); // not ours
+	virtual ~MoxIndexStream();
+	
+	virtual int FileSeek(MoxMxf::UInt64 offset);
+	virtual MoxMxf::UInt64 FileRead(unsigned char *dest, MoxMxf::UInt64 size);
+	virtual MoxMxf::UInt64 FileWrite(const unsigned char *source, MoxMxf::UInt64 size);
+	virtual MoxMxf::UInt64 FileTell();
+	virtual void FileFlush();
+	virtual void FileTruncate(MoxMxf::Int64 newsize);
+	virtual MoxMxf::Int64 FileSize();
+	
+	bool fromCache() const { return _from_cache; }
+	
+  private:
+	MoxMxf::IOStream &_stream;
+	MoxMxf::IOStream *_owned; // _stream, if we delete it
+	MoxMxf::UInt64 _position;
+	bool _stream_positioned;
+	
+	typedef std::map<MoxMxf::UInt64, std::string> ExtentMap; // offset, bytes
+	ExtentMap _extents;
+	size_t _extent_bytes;
+	
+	std::string _path;
+	MoxMxf::UInt64 _file_size;
+	MoxMxf::UInt64 _modified;
+	
+	bool _from_cache;
+	bool _recording;
+	bool _dirty; // recorded something new
+	bool _passthrough;
+	size_t _max_record;
+	
+	bool cached(unsigned char *dest, MoxMxf::UInt64 size);
+	void record(const unsigned char *source, MoxMxf::UInt64 size);
+	
+	friend class MoxIndexCache;
+	
+	MoxIndexStream(const MoxIndexStream &);
+	MoxIndexStream & operator = (const MoxIndexStream &);
+};
+
+
+// Folder of saved file headers and indexes, so opening a project full of
+// MOX files doesn't mean reading every one of them over the network.
+// Entries are tied to a file's path, size and modification date, and
+// carry a checksum.  The oldest ones go when the folder gets too big.
+class MoxIndexCache
+{
+  public:
+	MoxIndexCache(size_t max_bytes = (64 * 1024 * 1024)); // 0 turns it off
+	~MoxIndexCache() {}
+	
+	void setMaxBytes(size_t max_bytes);
+	size_t maxBytes() const { return _max_bytes; }
+	
+	// Make the stream to open an InputFile with.
+	MoxIndexStream * open(const MoxUTF16Char *path, MoxMxf::IOStream &stream);
+	MoxIndexStream * open(const MoxUTF16Char *path, MoxMxf::IOStream *stream); // takes the stream
+	
+	// Call once the InputFile is open.  Saves what it read if we didn't
+	// have it already, and after this the stream just goes to the file.
+	void store(MoxIndexStream &stream);
+	
+  private:
+	size_t _max_bytes;
+	std::string _dir;
+	bool _looked_for_dir;
+	
+	// The folder is only listed once, then we keep count as entries come and go
+	MoxMxf::UInt64 _total_bytes;
+	bool _have_total;
+	
+	IlmThread::Mutex _mutex;
+	
+	std::string entryPath(const std::string &path);
+	
+	bool load(MoxIndexStream &stream);
+	void save(const MoxIndexStream &stream);
+	void deleteEntry(const std::string &entry_path);
+	void countTotal();
+	void trim();
+	
+	MoxIndexCache(const MoxIndexCache &);
+	MoxIndexCache & operator = (const MoxIndexCache &);
+};
+
+
+// Streams that open InputFiles through the index cache, for the likes of
+// MoxReadAhead that make their own decoders and throw them away when idle.
+class MoxIndexedStreamSource : public MoxStreamSource
+{
+  public:
+	MoxIndexedStreamSource(MoxIndexCache &cache, const MoxUTF16Char *path, MoxStreamSource *source); // source is ours
+	virtual ~MoxIndexedStreamSource();
+	
+	virtual MoxMxf::IOStream * openStream() const;
+	virtual void fileOpened(MoxMxf::IOStream &stream) const;
+	
+  private:
+	MoxIndexCache &_cache;
+	std::vector<MoxUTF16Char> _path;
+	MoxStreamSource *_source;
+	
+	MoxIndexedStreamSource(const MoxIndexedStreamSource &);
+	MoxIndexedStreamSource & operator = (const MoxIndexedStreamSource &);
+};
+
+#endif // MOX_INDEXCACHE_H
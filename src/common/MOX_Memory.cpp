@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_Memory.h"
+
+#include <IlmThreadMutex.h>
+
+#include <assert.h>
+
+
+// Frames held by other globals get freed when those are destroyed, which
+// might be after anything here would be, so the mutex is never deleted.
+static IlmThread::Mutex *g_mutex = new IlmThread::Mutex;
+
+static size_t g_bytes[MoxMemory::NUM_KINDS] = { 0, 0, 0, 0, 0 };
+static unsigned long g_trims = 0;
+static size_t g_last_freed = 0;
+static MoxMxf::UInt64 g_total_freed = 0;
+
+
+void
+MoxMemory::add(Kind kind, size_t bytes)
+{
+	IlmThread::Lock lock(*g_mutex);
+	
+	g_bytes[kind] += bytes;
+}
+
+
+void
+MoxMemory::remove(Kind kind, size_t bytes)
+{
+	IlmThread::Lock lock(*g_mutex);
+	
+	assert(g_bytes[kind] >= bytes);
+	
+	g_bytes[kind] = (g_bytes[kind] > bytes ? g_bytes[kind] - bytes : 0);
+}
+
+
+size_t
+MoxMemory::bytes()
+{
+	IlmThread::Lock lock(*g_mutex);
+	
+	size_t total = 0;
+	
+	for(int i = 0; i < NUM_KINDS; i++)
+		total += g_bytes[i];
+	
+	return total;
+}
+
+
+size_t
+MoxMemory::bytes(Kind kind)
+{
+	IlmThread::Lock lock(*g_mutex);
+	
+	return g_bytes[kind];
+}
+
+
+size_t
+MoxMemory::decoderBytes(const MoxFiles::Header &head)
+{
+	const MoxFiles::ChannelList &channels = head.channels();
+	
+	size_t pixel_size = 0;
+	
+	for(MoxFiles::ChannelList::ConstIterator i = channels.begin(); i != channels.end(); ++i)
+		pixel_size += MoxFiles::PixelSize(i.channel().type);
+	
+	return (size_t)head.width() * (size_t)head.height() * pixel_size;
+}
+
+
+size_t
+MoxMemory::trimmed(size_t bytes_before)
+{
+	const size_t bytes_after = bytes();
+	
+	const size_t freed = (bytes_before > bytes_after ? bytes_before - bytes_after : 0);
+	
+	IlmThread::Lock lock(*g_mutex);
+	
+	g_trims++;
+	g_last_freed = freed;
+	g_total_freed += freed;
+	
+	return freed;
+}
+
+
+MoxMemory::Stats
+MoxMemory::stats()
+{
+	IlmThread::Lock lock(*g_mutex);
+	
+	Stats stats;
+	
+	stats.total = 0;
+	
+	for(int i = 0; i < NUM_KINDS; i++)
+	{
+		stats.bytes[i] = g_bytes[i];
+		stats.total += g_bytes[i];
+	}
+	
+	stats.trims = g_trims;
+	stats.last_freed = g_last_freed;
+	stats.total_freed = g_total_freed;
+	
+	return stats;
+}
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_MEMORY_H
+#define MOX_MEMORY_H
+
+#include <MoxFiles/InputFile.h>
+
+// Keeps count of the big things we hang on to between calls, so we know
+// when we're using too much and how much a trim gave back.
+
+class MoxMemory
+{
+  public:
+	enum Kind
+	{
+		FRAMES = 0,		// decoded frames in the cache and read-ahead
+		HOST_BUFFERS,	// buffers borrowed from the host and kept around
+		DECODERS,		// InputFiles and the codec state under them (a guess)
+		AUDIO,			// decoded samples waiting in audio read-ahead
+		SPARE_BUFFERS,	// freed buffers the buffer pool keeps to reuse
+		NUM_KINDS
+	};
+	
+	static void add(Kind kind, size_t bytes);
+	static void remove(Kind kind, size_t bytes);
+	
+	static size_t bytes();
+	static size_t bytes(Kind kind);
+	
+	// MoxFiles doesn't say what a decoder holds, so we figure on a full-size
+	// frame of the file's own pixel type for essence and codec buffers.
+	static size_t decoderBytes(const MoxFiles::Header &head);
+	
+	// Call when a trim is done with how many bytes we had before it.
+	// Returns how many it freed.
+	static size_t trimmed(size_t bytes_before);
+	
+	struct Stats
+	{
+		size_t bytes[NUM_KINDS];
+		size_t total;
+		unsigned long trims;
+		size_t last_freed;
+		MoxMxf::UInt64 total_freed;
+	};
+	
+	static Stats stats();
+};
+
+#endif // MOX_MEMORY_H
@@ -0,0 +1,727 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_Platform.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <string.h>
+	#include <io.h>
+#elif defined(__APPLE__)
+	#include <mach/mach.h>
+	#include <mach/mach_time.h>
+	#include <sys/types.h>
+	#include <sys/sysctl.h>
+	#include <sys/resource.h>
+#else
+	#include <unistd.h>
+	#include <time.h>
+	#include <sys/resource.h>
+#endif
+
+#ifndef _WIN32
+	#include <sys/mman.h>
+	
+	#ifndef MAP_ANONYMOUS
+		#define MAP_ANONYMOUS MAP_ANON
+	#endif
+#endif
+
+#include <sstream>
+
+#ifndef _WIN32
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#include <dirent.h>
+	#include <stdlib.h>
+	#include <limits.h>
+#endif
+
+
+MoxMxf::UInt64
+MoxPhysicalMemory()
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	
+	if( GlobalMemoryStatusEx(&status) )
+		return status.ullTotalPhys;
+	else
+		return 0;
+#elif defined(__APPLE__)
+	int mib[2] = { CTL_HW, HW_MEMSIZE };
+	
+	uint64_t mem_size = 0;
+	size_t len = sizeof(mem_size);
+	
+	if(sysctl(mib, 2, &mem_size, &len, NULL, 0) == 0)
+		return mem_size;
+	else
+		return 0;
+#else
+	const long pages = sysconf(_SC_PHYS_PAGES);
+	const long page_size = sysconf(_SC_PAGESIZE);
+	
+	return (pages > 0 && page_size > 0 ? (MoxMxf::UInt64)pages * page_size : 0);
+#endif
+}
+
+
+MoxMxf::UInt64
+MoxAvailableMemory()
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	
+	if( GlobalMemoryStatusEx(&status) )
+		return status.ullAvailPhys;
+	else
+		return 0;
+#elif defined(__APPLE__)
+	// inactive pages can be taken back without going to disk, so count them
+	vm_statistics_data_t vm_stats;
+	mach_msg_type_number_t count = HOST_VM_INFO_COUNT;
+	
+	if(host_statistics(mach_host_self(), HOST_VM_INFO, (host_info_t)&vm_stats, &count) == KERN_SUCCESS)
+		return ((MoxMxf::UInt64)vm_stats.free_count + vm_stats.inactive_count) * vm_page_size;
+	else
+		return 0;
+#else
+	const long pages = sysconf(_SC_AVPHYS_PAGES);
+	const long page_size = sysconf(_SC_PAGESIZE);
+	
+	return (pages > 0 && page_size > 0 ? (MoxMxf::UInt64)pages * page_size : 0);
+#endif
+}
+
+
+MoxMxf::UInt64
+MoxMilliseconds()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	
+	if(frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	
+	return (counter.QuadPart / frequency.QuadPart) * 1000 +
+			((counter.QuadPart % frequency.QuadPart) * 1000) / frequency.QuadPart;
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase = { 0, 0 };
+	
+	if(timebase.denom == 0)
+		mach_timebase_info(&timebase);
+	
+	const MoxMxf::UInt64 nanoseconds = (mach_absolute_time() * timebase.numer) / timebase.denom;
+	
+	return nanoseconds / 1000000;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ((MoxMxf::UInt64)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+#endif
+}
+
+
+int
+MoxFileDescriptorLimit()
+{
+#ifdef _WIN32
+	// Files are opened as Win32 handles, which don't have a small
+	// per-process limit like Unix file descriptors do.
+	return 16384;
+#else
+	struct rlimit limit;
+	
+	if(getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		if(limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > 65536)
+			return 65536;
+		else
+			return limit.rlim_cur;
+	}
+	else
+		return 256; // the Mac default
+#endif
+}
+
+
+#if defined(MADV_HUGEPAGE)
+static const size_t kHugePageSize = 2 * 1024 * 1024;
+#endif
+
+void *
+MoxPageAlloc(size_t bytes, bool prefault)
+{
+	if(bytes == 0)
+		return NULL;
+	
+#ifdef _WIN32
+	void *buffer = VirtualAlloc(NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	
+	if(buffer == NULL)
+		return NULL;
+#else
+	void *buffer = NULL;
+	
+  #if defined(MADV_HUGEPAGE)
+	if(bytes >= kHugePageSize)
+	{
+		// Map a little extra so the start can be moved up to a huge page boundary,
+		// then give back what's left over at either end.
+		const size_t map_size = bytes + kHugePageSize;
+		
+		void *mapped = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		
+		if(mapped == MAP_FAILED)
+			return NULL;
+		
+		const size_t offset = (kHugePageSize - ((size_t)mapped % kHugePageSize)) % kHugePageSize;
+		const size_t tail = map_size - offset - bytes;
+		
+		const size_t page_size = sysconf(_SC_PAGESIZE);
+		const size_t tail_start = (bytes + page_size - 1) / page_size * page_size;
+		
+		if(offset > 0)
+			munmap(mapped, offset);
+		
+		buffer = (char *)mapped + offset;
+		
+		if(tail > tail_start - bytes)
+			munmap((char *)buffer + tail_start, tail - (tail_start - bytes));
+		
+		madvise(buffer, bytes, MADV_HUGEPAGE);
+	}
+	else
+  #endif
+	{
+		buffer = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		
+		if(buffer == MAP_FAILED)
+			return NULL;
+	}
+#endif
+
+	if(prefault)
+	{
+		// one write per small page is enough
+		volatile char *p = (volatile char *)buffer;
+		
+		for(size_t i = 0; i < bytes; i += 4096)
+			p[i] = 0;
+	}
+	
+	return buffer;
+}
+
+
+void
+MoxPageFree(void *buffer, size_t bytes)
+{
+	if(buffer == NULL)
+		return;
+	
+#ifdef _WIN32
+	VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+	munmap(buffer, bytes); // the partial page at the end goes too
+#endif
+}
+
+
+std::string
+MoxUTF8Path(const MoxUTF16Char *path)
+{
+	std::string result;
+	
+	if(path == NULL)
+		return result;
+	
+	while(*path != 0)
+	{
+		unsigned int c = *path++;
+		
+		if(c >= 0xd800 && c <= 0xdbff && *path >= 0xdc00 && *path <= 0xdfff)
+		{
+			c = 0x10000 + ((c - 0xd800) << 10) + (*path++ - 0xdc00);
+		}
+		
+		if(c < 0x80)
+		{
+			result += (char)c;
+		}
+		else if(c < 0x800)
+		{
+			result += (char)(0xc0 | (c >> 6));
+			result += (char)(0x80 | (c & 0x3f));
+		}
+		else if(c < 0x10000)
+		{
+			result += (char)(0xe0 | (c >> 12));
+			result += (char)(0x80 | ((c >> 6) & 0x3f));
+			result += (char)(0x80 | (c & 0x3f));
+		}
+		else
+		{
+			result += (char)(0xf0 | (c >> 18));
+			result += (char)(0x80 | ((c >> 12) & 0x3f));
+			result += (char)(0x80 | ((c >> 6) & 0x3f));
+			result += (char)(0x80 | (c & 0x3f));
+		}
+	}
+	
+	return result;
+}
+
+
+#ifdef _WIN32
+static std::wstring
+WidePath(const std::string &path)
+{
+	const int len = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+	
+	if(len <= 0)
+		return std::wstring();
+	
+	std::vector<wchar_t> buf(len);
+	
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &buf[0], len);
+	
+	return std::wstring(&buf[0]);
+}
+
+static std::string
+NarrowPath(const wchar_t *path)
+{
+	const int len = WideCharToMultiByte(CP_UTF8, 0, path, -1, NULL, 0, NULL, NULL);
+	
+	if(len <= 0)
+		return std::string();
+	
+	std::vector<char> buf(len);
+	
+	WideCharToMultiByte(CP_UTF8, 0, path, -1, &buf[0], len, NULL, NULL);
+	
+	return std::string(&buf[0]);
+}
+#endif
+
+
+bool
+MoxFileStat(const std::string &path, MoxMxf::UInt64 *size, MoxMxf::UInt64 *modified)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	
+	if( !GetFileAttributesExW(WidePath(path).c_str(), GetFileExInfoStandard, &data) )
+		return false;
+	
+	if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		return false;
+	
+	if(size)
+		*size = ((MoxMxf::UInt64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	
+	if(modified)
+		*modified = ((MoxMxf::UInt64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+	
+	return true;
+#else
+	struct stat info;
+	
+	if(stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+		return false;
+	
+	if(size)
+		*size = info.st_size;
+	
+	if(modified)
+	{
+	#ifdef __APPLE__
+		*modified = ((MoxMxf::UInt64)info.st_mtimespec.tv_sec * 1000000000) + info.st_mtimespec.tv_nsec;
+	#else
+		*modified = ((MoxMxf::UInt64)info.st_mtim.tv_sec * 1000000000) + info.st_mtim.tv_nsec;
+	#endif
+	}
+	
+	return true;
+#endif
+}
+
+
+std::string
+MoxFileIdentity(const std::string &path)
+{
+	std::ostringstream identity;
+	
+	identity << std::hex;
+	
+#ifdef _WIN32
+	const std::wstring wide_path = WidePath(path);
+	
+	HANDLE fileH = CreateFileW(wide_path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+								NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	
+	if(fileH == INVALID_HANDLE_VALUE)
+		return std::string();
+	
+	BY_HANDLE_FILE_INFORMATION info;
+	
+	const BOOL got_info = GetFileInformationByHandle(fileH, &info);
+	
+	CloseHandle(fileH);
+	
+	if(got_info)
+	{
+		identity << info.dwVolumeSerialNumber << ":" << info.nFileIndexHigh << ":" << info.nFileIndexLow;
+	}
+	else
+	{
+		wchar_t full_path[MAX_PATH];
+		
+		const DWORD len = GetFullPathNameW(wide_path.c_str(), MAX_PATH, full_path, NULL);
+		
+		if(len == 0 || len >= MAX_PATH)
+			return path;
+		
+		CharLowerW(full_path); // Windows paths aren't case sensitive
+		
+		return NarrowPath(full_path);
+	}
+#else
+	struct stat info;
+	
+	if(stat(path.c_str(), &info) != 0)
+		return std::string();
+	
+	if(info.st_ino != 0)
+	{
+		identity << (MoxMxf::UInt64)info.st_dev << ":" << (MoxMxf::UInt64)info.st_ino;
+	}
+	else
+	{
+		char real_path[PATH_MAX];
+		
+		if(realpath(path.c_str(), real_path) == NULL)
+			return path;
+		
+		return std::string(real_path);
+	}
+#endif
+
+	return identity.str();
+}
+
+
+FILE *
+MoxFileOpen(const std::string &path, const char *mode)
+{
+#ifdef _WIN32
+	const std::wstring wide_mode(mode, mode + strlen(mode));
+	
+	return _wfopen(WidePath(path).c_str(), wide_mode.c_str());
+#else
+	return fopen(path.c_str(), mode);
+#endif
+}
+
+
+bool
+MoxFileRename(const std::string &from, const std::string &to)
+{
+#ifdef _WIN32
+	return (MoveFileExW(WidePath(from).c_str(), WidePath(to).c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE);
+#else
+	return (rename(from.c_str(), to.c_str()) == 0);
+#endif
+}
+
+
+bool
+MoxFileDelete(const std::string &path)
+{
+#ifdef _WIN32
+	return (DeleteFileW(WidePath(path).c_str()) != FALSE);
+#else
+	return (unlink(path.c_str()) == 0);
+#endif
+}
+
+
+MoxFileStream::MoxFileStream(const std::string &path, bool write) :
+	_fp(NULL),
+	_last_op(OP_NONE)
+{
+	_fp = MoxFileOpen(path, write ? "w+b" : "rb");
+	
+	if(_fp == NULL)
+		throw MoxMxf::IoExc("Could not open " + path);
+}
+
+
+MoxFileStream::~MoxFileStream()
+{
+	fclose(_fp);
+}
+
+
+int
+MoxFileStream::FileSeek(MoxMxf::UInt64 offset)
+{
+	_last_op = OP_NONE;
+
+#ifdef _WIN32
+	return _fseeki64(_fp, offset, SEEK_SET);
+#else
+	return fseeko(_fp, offset, SEEK_SET);
+#endif
+}
+
+
+MoxMxf::UInt64
+MoxFileStream::FileRead(unsigned char *dest, MoxMxf::UInt64 size)
+{
+	switchTo(OP_READ);
+	
+	return fread(dest, 1, (size_t)size, _fp);
+}
+
+
+MoxMxf::UInt64
+MoxFileStream::FileWrite(const unsigned char *source, MoxMxf::UInt64 size)
+{
+	switchTo(OP_WRITE);
+	
+	const size_t written = fwrite(source, 1, (size_t)size, _fp);
+	
+	if(written != size)
+		throw MoxMxf::IoExc("Write failed");
+	
+	return written;
+}
+
+
+MoxMxf::UInt64
+MoxFileStream::FileTell()
+{
+#ifdef _WIN32
+	return _ftelli64(_fp);
+#else
+	return ftello(_fp);
+#endif
+}
+
+
+void
+MoxFileStream::FileFlush()
+{
+	fflush(_fp);
+}
+
+
+void
+MoxFileStream::FileTruncate(MoxMxf::Int64 newsize)
+{
+	fflush(_fp);
+
+#ifdef _WIN32
+	_chsize_s(_fileno(_fp), newsize);
+#else
+	if(ftruncate(fileno(_fp), newsize) != 0)
+		throw MoxMxf::IoExc("Truncate failed");
+#endif
+}
+
+
+MoxMxf::Int64
+MoxFileStream::FileSize()
+{
+	fflush(_fp);
+
+	const MoxMxf::UInt64 position = FileTell();
+	
+#ifdef _WIN32
+	_fseeki64(_fp, 0, SEEK_END);
+#else
+	fseeko(_fp, 0, SEEK_END);
+#endif
+	
+	const MoxMxf::Int64 size = FileTell();
+	
+	FileSeek(position);
+	
+	return size;
+}
+
+
+void
+MoxFileStream::switchTo(LastOp op)
+{
+	if(_last_op != OP_NONE && _last_op != op)
+		FileSeek( FileTell() );
+	
+	_last_op = op;
+}
+
+
+void
+MoxListDirectory(const std::string &dir, std::vector<MoxDirEntry> &entries)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAW data;
+	
+	HANDLE findH = FindFirstFileW(WidePath(dir + "/*").c_str(), &data);
+	
+	if(findH == INVALID_HANDLE_VALUE)
+		return;
+	
+	do{
+		if( !(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) )
+		{
+			MoxDirEntry entry;
+			
+			entry.path = dir + "/" + NarrowPath(data.cFileName);
+			entry.size = ((MoxMxf::UInt64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+			entry.modified = ((MoxMxf::UInt64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+			
+			entries.push_back(entry);
+		}
+	}while( FindNextFileW(findH, &data) );
+	
+	FindClose(findH);
+#else
+	DIR *dirP = opendir(dir.c_str());
+	
+	if(dirP == NULL)
+		return;
+	
+	struct dirent *ent = NULL;
+	
+	while((ent = readdir(dirP)) != NULL)
+	{
+		MoxDirEntry entry;
+		
+		entry.path = dir + "/" + ent->d_name;
+		
+		if( MoxFileStat(entry.path, &entry.size, &entry.modified) )
+			entries.push_back(entry);
+	}
+	
+	closedir(dirP);
+#endif
+}
+
+
+static bool
+MakeDirectory(const std::string &path)
+{
+#ifdef _WIN32
+	return (CreateDirectoryW(WidePath(path).c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS);
+#else
+	struct stat info;
+	
+	if(stat(path.c_str(), &info) == 0)
+		return S_ISDIR(info.st_mode);
+	
+	return (mkdir(path.c_str(), 0755) == 0);
+#endif
+}
+
+
+std::string
+MoxCacheDirectory(const char *name)
+{
+	std::string base;
+	
+#ifdef _WIN32
+	wchar_t buf[MAX_PATH];
+	
+	DWORD len = GetEnvironmentVariableW(L"LOCALAPPDATA", buf, MAX_PATH);
+	
+	if(len == 0 || len >= MAX_PATH)
+		len = GetTempPathW(MAX_PATH, buf);
+	
+	if(len == 0 || len >= MAX_PATH)
+		return std::string();
+	
+	base = NarrowPath(buf);
+	
+	if(!base.empty() && (base[base.size() - 1] == '\\' || base[base.size() - 1] == '/'))
+		base.erase(base.size() - 1);
+	
+	base += "/MOX";
+#else
+	const char *home = getenv("HOME");
+	
+  #ifdef __APPLE__
+	if(home == NULL || *home == '\0')
+		return std::string();
+	
+	base = std::string(home) + "/Library/Caches/MOX";
+  #else
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	
+	if(xdg != NULL && *xdg != '\0')
+		base = std::string(xdg) + "/mox";
+	else if(home != NULL && *home != '\0')
+		base = std::string(home) + "/.cache/mox";
+	else
+		return std::string();
+  #endif
+#endif
+
+	// make each level as we go
+	for(size_t pos = 1; pos < base.size(); pos++)
+	{
+		if(base[pos] == '/' || base[pos] == '\\')
+			MakeDirectory(base.substr(0, pos));
+	}
+	
+	const std::string dir = base + "/" + name;
+	
+	if( MakeDirectory(base) && MakeDirectory(dir) )
+		return dir;
+	else
+		return std::string();
+}
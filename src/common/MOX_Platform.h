@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_PLATFORM_H
+#define MOX_PLATFORM_H
+
+#include <MoxMxf/PlatformIOStream.h>
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+// Little bits of OS stuff the hosts don't give us
+
+MoxMxf::UInt64 MoxPhysicalMemory();
+MoxMxf::UInt64 MoxAvailableMemory(); // physical memory nobody is using right now
+
+MoxMxf::UInt64 MoxMilliseconds(); // since some arbitrary point, never goes backwards
+
+int MoxFileDescriptorLimit(); // how many files the process can have open
+
+// Whole pages straight from the OS, so at least 64-byte aligned.  Big ones
+// get huge pages on Linux.  prefault touches every page now so the faults
+// don't happen later, one at a time.  NULL if there's no memory.
+void * MoxPageAlloc(size_t bytes, bool prefault);
+void MoxPageFree(void *buffer, size_t bytes);
+
+
+// Paths we make ourselves are UTF-8 everywhere and get converted for Windows.
+// Paths from the hosts come in as UTF-16.
+typedef unsigned short MoxUTF16Char;
+
+std::string MoxUTF8Path(const MoxUTF16Char *path);
+
+bool MoxFileStat(const std::string &path, MoxMxf::UInt64 *size, MoxMxf::UInt64 *modified);
+
+// Same for every path that leads to a file (device and inode, or the Windows
+// equivalent), falling back to the canonical path.  Empty if there's no file.
+std::string MoxFileIdentity(const std::string &path);
+
+FILE * MoxFileOpen(const std::string &path, const char *mode);
+bool MoxFileRename(const std::string &from, const std::string &to); // replaces "to"
+bool MoxFileDelete(const std::string &path);
+
+// A file of our own as an IOStream, for when the host didn't give us one
+class MoxFileStream : public MoxMxf::IOStream
+{
+  public:
+	MoxFileStream(const std::string &path, bool write); // write makes a new file
+	virtual ~MoxFileStream();
+	
+	virtual int FileSeek(MoxMxf::UInt64 offset);
+	virtual MoxMxf::UInt64 FileRead(unsigned char *dest, MoxMxf::UInt64 size);
+	virtual MoxMxf::UInt64 FileWrite(const unsigned char *source, MoxMxf::UInt64 size);
+	virtual MoxMxf::UInt64 FileTell();
+	virtual void FileFlush();
+	virtual void FileTruncate(MoxMxf::Int64 newsize);
+	virtual MoxMxf::Int64 FileSize();
+	
+  private:
+	FILE *_fp;
+	
+	enum LastOp { OP_NONE, OP_READ, OP_WRITE };
+	LastOp _last_op; // stdio wants a seek between reading and writing
+	
+	void switchTo(LastOp op);
+	
+	MoxFileStream(const MoxFileStream &);
+	MoxFileStream & operator = (const MoxFileStream &);
+};
+
+struct MoxDirEntry
+{
+	std::string path;
+	MoxMxf::UInt64 size;
+	MoxMxf::UInt64 modified;
+};
+
+void MoxListDirectory(const std::string &dir, std::vector<MoxDirEntry> &entries); // just files
+
+// Per-user cache folder with our own subfolder, created if necessary.
+// Returns an empty string if we couldn't make it.
+std::string MoxCacheDirectory(const char *name);
+
+#endif // MOX_PLATFORM_H
@@ -0,0 +1,194 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_Probe.h"
+
+#include <string.h>
+
+
+// SMPTE 377M partition pack key, bytes 13 and 14 are kind and status
+static const unsigned char kPartitionPackKey[13] = { 0x06, 0x0e, 0x2b, 0x34, 0x02, 0x05, 0x01, 0x01,
+														0x0d, 0x01, 0x02, 0x01, 0x01 };
+
+static const unsigned char kHeaderPartition = 0x02;
+
+// Operational pattern and essence container labels, skipping the version byte
+static const unsigned char kLabelPrefix[7] = { 0x06, 0x0e, 0x2b, 0x34, 0x04, 0x01, 0x01 };
+static const unsigned char kOperationalPatternPrefix[4] = { 0x0d, 0x01, 0x02, 0x01 };
+
+// fixed part of the partition pack before the essence container batch
+static const size_t kPartitionPackFixedSize = 2 + 2 + 4 + 8 + 8 + 8 + 8 + 8 + 4 + 8 + 4 + 16;
+
+
+static MoxMxf::UInt64
+ReadBig(const unsigned char *p, int bytes)
+{
+	MoxMxf::UInt64 value = 0;
+	
+	for(int i=0; i < bytes; i++)
+		value = (value << 8) | p[i];
+	
+	return value;
+}
+
+
+static bool
+IsLabel(const unsigned char *p)
+{
+	return (memcmp(p, kLabelPrefix, sizeof(kLabelPrefix)) == 0);
+}
+
+
+static bool
+CheckPartitionPack(const unsigned char *p, size_t size)
+{
+	// key
+	if(size < 16 || memcmp(p, kPartitionPackKey, sizeof(kPartitionPackKey)) != 0)
+		return false;
+	
+	const unsigned char kind = p[13];
+	const unsigned char status = p[14];
+	
+	if(kind != kHeaderPartition || status < 0x01 || status > 0x04 || p[15] != 0x00)
+		return false;
+	
+	p += 16;
+	size -= 16;
+	
+	
+	// BER length
+	if(size < 1)
+		return false;
+	
+	MoxMxf::UInt64 length = p[0];
+	
+	if(length & 0x80)
+	{
+		const int len_bytes = (int)(length & 0x7f);
+		
+		if(len_bytes < 1 || len_bytes > 8 || size < (size_t)len_bytes + 1)
+			return false;
+		
+		length = ReadBig(p + 1, len_bytes);
+		
+		p += len_bytes + 1;
+		size -= len_bytes + 1;
+	}
+	else
+	{
+		p += 1;
+		size -= 1;
+	}
+	
+	if(length < kPartitionPackFixedSize + 8 || size < kPartitionPackFixedSize + 8)
+		return false;
+	
+	
+	// the pack itself
+	const MoxMxf::UInt64 major_version = ReadBig(p + 0, 2);
+	const MoxMxf::UInt64 this_partition = ReadBig(p + 8, 8);
+	const MoxMxf::UInt64 previous_partition = ReadBig(p + 16, 8);
+	const unsigned char *operational_pattern = p + 64;
+	
+	if(major_version != 1 || this_partition != 0 || previous_partition != 0)
+		return false;
+	
+	if(!IsLabel(operational_pattern) || memcmp(operational_pattern + 8, kOperationalPatternPrefix, sizeof(kOperationalPatternPrefix)) != 0)
+		return false;
+	
+	
+	// essence container batch
+	p += kPartitionPackFixedSize;
+	size -= kPartitionPackFixedSize;
+	
+	const MoxMxf::UInt64 count = ReadBig(p + 0, 4);
+	const MoxMxf::UInt64 item_size = ReadBig(p + 4, 4);
+	
+	if(count == 0 || item_size != 16 || length < kPartitionPackFixedSize + 8 + (count * 16))
+		return false; // nothing for us to read
+	
+	p += 8;
+	size -= 8;
+	
+	for(MoxMxf::UInt64 i=0; i < count && size >= 16; i++)
+	{
+		if( !IsLabel(p) )
+			return false;
+		
+		p += 16;
+		size -= 16;
+	}
+	
+	return true;
+}
+
+
+bool
+MoxProbe(const unsigned char *data, size_t size)
+{
+	if(data == NULL)
+		return false;
+	
+	if(size > MoxProbeBytes)
+		size = MoxProbeBytes;
+	
+	// MXF allows some run-in before the header partition, so look for the key
+	for(size_t pos = 0; pos + sizeof(kPartitionPackKey) <= size; pos++)
+	{
+		if(data[pos] == kPartitionPackKey[0] &&
+			memcmp(data + pos, kPartitionPackKey, sizeof(kPartitionPackKey)) == 0)
+		{
+			return CheckPartitionPack(data + pos, size - pos);
+		}
+	}
+	
+	return false;
+}
+
+
+bool
+MoxProbe(MoxMxf::IOStream &stream)
+{
+	unsigned char buf[MoxProbeBytes];
+	
+	stream.FileSeek(0);
+	
+	const MoxMxf::UInt64 got = stream.FileRead(buf, sizeof(buf));
+	
+	return MoxProbe(buf, (size_t)got);
+}
@@ -0,0 +1,329 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_Proxy.h"
+
+#include "MOX_Downsample.h"
+
+#include <assert.h>
+
+
+static const int kProxyQuality = 75;
+
+
+std::string
+MoxProxyPath(const std::string &movie_path)
+{
+	return movie_path + ".proxy.mxf";
+}
+
+
+MoxProxyWriter::MoxProxyWriter(const std::string &movie_path, const MoxFiles::Header &header, bool have_alpha) :
+	_path( MoxProxyPath(movie_path) ),
+	_width( header.width() ),
+	_height( header.height() ),
+	_stream(NULL),
+	_file(NULL),
+	_frame(NULL)
+{
+	using namespace MoxFiles;
+	
+	const int proxy_width = (_width + kMoxProxyFactor - 1) / kMoxProxyFactor;
+	const int proxy_height = (_height + kMoxProxyFactor - 1) / kMoxProxyFactor;
+	
+	Header proxy_head(proxy_width, proxy_height, header.frameRate(), header.sampleRate(),
+						VideoCodec::pickCodec(false, UINT8, have_alpha), PCM);
+	
+	ChannelList &channels = proxy_head.channels();
+	
+	channels.insert("R", Channel(UINT8));
+	channels.insert("G", Channel(UINT8));
+	channels.insert("B", Channel(UINT8));
+	
+	if(have_alpha)
+		channels.insert("A", Channel(UINT8));
+	
+	VideoCodec::setQuality(proxy_head, kProxyQuality);
+	
+	try
+	{
+		_stream = new MoxFileStream(_path, true);
+		
+		_file = new OutputFile(*_stream, proxy_head);
+	}
+	catch(...)
+	{
+		abandon();
+	}
+}
+
+
+MoxProxyWriter::~MoxProxyWriter()
+{
+	abandon();
+}
+
+
+void
+MoxProxyWriter::pushFrame(const char *origin, ptrdiff_t rowbytes, MoxFiles::PixelType type, const char *order,
+							int repeats)
+{
+	if(_file == NULL)
+		return;
+	
+	try
+	{
+		const int proxy_width = _file->header().width();
+		const int proxy_height = _file->header().height();
+		
+		if(_frame == NULL || !_frame->matches(proxy_width, proxy_height, type, order))
+		{
+			delete _frame;
+			_frame = NULL;
+			
+			_frame = new MoxFrame(proxy_width, proxy_height, type, order);
+		}
+		
+		MoxBoxDownsample(origin, rowbytes, _width, _height,
+							_frame->data(), _frame->rowbytes(), proxy_width, proxy_height,
+							kMoxProxyFactor, kMoxProxyFactor, type);
+		
+		MoxFiles::FrameBuffer frame_buffer(proxy_width, proxy_height);
+		
+		_frame->insertSlices(frame_buffer);
+		
+		for(int i = 0; i < repeats; i++)
+			_file->pushFrame(frame_buffer);
+	}
+	catch(...)
+	{
+		abandon();
+	}
+}
+
+
+bool
+MoxProxyWriter::finish(MoxFrameInfo &info)
+{
+	if(_file == NULL)
+		return false;
+	
+	try
+	{
+		_file->finalize();
+		
+		delete _file;
+		_file = NULL;
+		
+		delete _stream;
+		_stream = NULL;
+	}
+	catch(...)
+	{
+		abandon();
+		
+		return false;
+	}
+	
+	delete _frame;
+	_frame = NULL;
+	
+	MoxMxf::UInt64 size = 0, modified = 0;
+	
+	if( !MoxFileStat(_path, &size, &modified) )
+		return false;
+	
+	info.setProxy(size, modified);
+	
+	return true;
+}
+
+
+void
+MoxProxyWriter::abandon()
+{
+	const bool started = (_stream != NULL);
+	
+	try
+	{
+		delete _file;
+	}
+	catch(...) {}
+	
+	_file = NULL;
+	
+	delete _stream;
+	_stream = NULL;
+	
+	delete _frame;
+	_frame = NULL;
+	
+	if(started)
+		MoxFileDelete(_path);
+}
+
+
+MoxProxyReader::MoxProxyReader(const std::string &path) :
+	_path(path),
+	_stream(NULL),
+	_file(NULL),
+	_width(0),
+	_height(0),
+	_frame(NULL)
+{
+	_stream = new MoxBoundStream(new MoxFileStream(_path, false));
+	
+	try
+	{
+		_file = new MoxFiles::InputFile(*_stream);
+	}
+	catch(...)
+	{
+		delete _stream;
+		
+		throw;
+	}
+	
+	_width = _file->header().width();
+	_height = _file->header().height();
+}
+
+
+MoxProxyReader::~MoxProxyReader()
+{
+	delete _frame;
+	
+	delete _file;
+	
+	delete _stream;
+}
+
+
+MoxProxyReader *
+MoxProxyReader::open(const std::string &movie_path, const MoxFrameInfo &info)
+{
+	MoxMxf::UInt64 expected_size = 0, expected_modified = 0;
+	
+	if( !info.getProxy(expected_size, expected_modified) )
+		return NULL;
+	
+	const std::string path = MoxProxyPath(movie_path);
+	
+	MoxMxf::UInt64 size = 0, modified = 0;
+	
+	if(!MoxFileStat(path, &size, &modified) || size != expected_size || modified != expected_modified)
+		return NULL;
+	
+	try
+	{
+		return new MoxProxyReader(path);
+	}
+	catch(...)
+	{
+		return NULL;
+	}
+}
+
+
+bool
+MoxProxyReader::draw(int frame, char *dest, ptrdiff_t rowbytes, int width, int height,
+						MoxFiles::PixelType type, const char *order, const MoxRect *region)
+{
+	if(width <= 0 || height <= 0 || width > _width || height > _height)
+		return false;
+	
+	const int factor_x = _width / width;
+	const int factor_y = _height / height;
+	
+	if((width != _width / factor_x && width != (_width + factor_x - 1) / factor_x) ||
+		(height != _height / factor_y && height != (_height + factor_y - 1) / factor_y))
+	{
+		return false;
+	}
+	
+	if(type != MoxFiles::UINT8 && type != MoxFiles::UINT16A && type != MoxFiles::FLOAT)
+		return false;
+	
+	if(frame < 0 || frame >= _file->header().duration())
+		return false;
+	
+	IlmThread::Lock lock(_mutex);
+	
+	if( !_stream->isBound() )
+		_stream->bind(new MoxFileStream(_path, false));
+	
+	if(_frame == NULL || !_frame->matches(_width, _height, type, order))
+	{
+		delete _frame;
+		_frame = NULL;
+		
+		_frame = new MoxFrame(_width, _height, type, order);
+	}
+	
+	MoxFiles::FrameBuffer frame_buffer(_width, _height);
+	
+	_frame->insertSlices(frame_buffer);
+	
+	_file->getFrame(frame, frame_buffer);
+	
+	if(width == _width && height == _height)
+	{
+		_frame->copyTo(dest, rowbytes, region);
+	}
+	else
+	{
+		MoxBoxDownsample(_frame->data(), _frame->rowbytes(), _width, _height,
+							dest, rowbytes, width, height,
+							factor_x, factor_y, type, region);
+	}
+	
+	return true;
+}
+
+
+void
+MoxProxyReader::release()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	if( _stream->isBound() )
+		_stream->unbind();
+	
+	delete _frame;
+	_frame = NULL;
+}
@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_PROXY_H
+#define MOX_PROXY_H
+
+#include "MOX_Frame.h"
+#include "MOX_FrameInfo.h"
+#include "MOX_BoundStream.h"
+#include "MOX_Platform.h"
+
+#include <MoxFiles/OutputFile.h>
+
+#include <IlmThreadMutex.h>
+
+#include <string>
+
+// A quarter-size 8-bit copy of a movie, for drafts and low-res playback.
+// MoxFiles only writes one video track, so the proxy is a movie of its own
+// next to the master: movie.mxf -> movie.mxf.proxy.mxf
+// The master's .moxinfo remembers the proxy's size and date, so a proxy
+// left over from some other export never gets used.
+
+static const int kMoxProxyFactor = 4;
+
+std::string MoxProxyPath(const std::string &movie_path);
+
+
+class MoxProxyWriter
+{
+  public:
+	MoxProxyWriter(const std::string &movie_path, const MoxFiles::Header &header, bool have_alpha);
+	~MoxProxyWriter(); // deletes the proxy if it wasn't finished
+	
+	// Frames at the master's size, in the same order.  If the proxy has trouble
+	// we stop writing it, but that's no reason to fail the master.
+	void pushFrame(const char *origin, ptrdiff_t rowbytes, MoxFiles::PixelType type, const char *order,
+					int repeats = 1);
+	
+	// close the proxy and note it in the master's info
+	bool finish(MoxFrameInfo &info);
+	
+  private:
+	const std::string _path;
+	const int _width;
+	const int _height;
+	
+	MoxFileStream *_stream;
+	MoxFiles::OutputFile *_file;
+	
+	MoxFrame *_frame; // shrunk down, before the file converts it to 8-bit
+	
+	void abandon();
+	
+	MoxProxyWriter(const MoxProxyWriter &);
+	MoxProxyWriter & operator = (const MoxProxyWriter &);
+};
+
+
+class MoxProxyReader
+{
+  public:
+	~MoxProxyReader();
+	
+	// NULL if the movie doesn't have a proxy we can trust
+	static MoxProxyReader * open(const std::string &movie_path, const MoxFrameInfo &info);
+	
+	int width() const { return _width; }
+	int height() const { return _height; }
+	
+	// Smaller sizes get box filtered from the proxy if they're a whole-number
+	// fraction of it.  Returns false for any other size.
+	// rowbytes can be negative for bottom-up buffers.
+	bool draw(int frame, char *dest, ptrdiff_t rowbytes, int width, int height,
+				MoxFiles::PixelType type, const char *order, const MoxRect *region = NULL);
+	
+	// close the file until it's needed again
+	void release();
+	
+  private:
+	MoxProxyReader(const std::string &path);
+	
+	const std::string _path;
+	
+	MoxBoundStream *_stream;
+	MoxFiles::InputFile *_file;
+	
+	int _width;
+	int _height;
+	
+	MoxFrame *_frame;
+	
+	IlmThread::Mutex _mutex;
+	
+	MoxProxyReader(const MoxProxyReader &);
+	MoxProxyReader & operator = (const MoxProxyReader &);
+};
+
+#endif // MOX_PROXY_H
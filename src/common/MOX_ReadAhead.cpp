@@ -0,0 +1,707 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_ReadAhead.h"
+
+#include "MOX_Memory.h"
+
+#include <IlmThread.h>
+
+#include <algorithm>
+
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+
+MoxWorkerPool MoxReadAhead::_pool(2);
+
+IlmThread::Mutex MoxReadAhead::_all_mutex;
+std::set<MoxReadAhead *> MoxReadAhead::_all;
+
+
+class MoxReadAheadTask : public IlmThread::Task
+{
+  public:
+	MoxReadAheadTask(IlmThread::TaskGroup *group, MoxReadAhead &read_ahead, int decoder) :
+		IlmThread::Task(group),
+		_read_ahead(read_ahead),
+		_decoder(decoder)
+	{}
+	
+	virtual ~MoxReadAheadTask() {}
+	
+	virtual void execute() { _read_ahead.decodeLoop(_decoder); }
+	
+  private:
+	MoxReadAhead &_read_ahead;
+	const int _decoder;
+};
+
+
+MoxReadAhead::MoxReadAhead(MoxStreamSource *source, int duration, const Settings &settings) :
+	_source(source),
+	_duration(duration),
+	_settings(settings),
+	_task_group(NULL),
+	_shutting_down(false),
+	_active_slots(0),
+	_width(0),
+	_height(0),
+	_type(MoxFiles::UINT8),
+	_last_frame(-1),
+	_step(0),
+	_run(0),
+	_depth(0)
+{
+	if(source == NULL)
+		throw MoxMxf::NullExc("Null source");
+
+	_order[0] = '\0';
+	
+	if(_settings.depth > 0 && _settings.decoders > 0 && IlmThread::supportsThreads())
+	{
+		_slots.resize(_settings.depth);
+		
+		for(std::vector<Slot>::iterator i = _slots.begin(); i != _slots.end(); ++i)
+			i->done = new IlmThread::Semaphore(0);
+		
+		_decoders.resize(_settings.decoders);
+		
+		_task_group = new IlmThread::TaskGroup;
+		
+		IlmThread::Lock lock(_all_mutex);
+		
+		_all.insert(this);
+	}
+}
+
+
+MoxReadAhead::~MoxReadAhead()
+{
+	{
+		IlmThread::Lock lock(_all_mutex);
+		
+		_all.erase(this);
+	}
+	
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		_shutting_down = true;
+		
+		cancelQueued();
+	}
+	
+	delete _task_group; // waits for the tasks to finish
+	
+	for(std::vector<Slot>::iterator i = _slots.begin(); i != _slots.end(); ++i)
+	{
+		assert(i->waiters == 0);
+	
+		delete i->buffer;
+		delete i->done;
+	}
+	
+	for(std::vector<Decoder>::iterator i = _decoders.begin(); i != _decoders.end(); ++i)
+		closeDecoder(*i);
+	
+	delete _source;
+}
+
+
+bool
+MoxReadAhead::fetch(int frame, int width, int height, MoxFiles::PixelType type, const char *order,
+					char *dest, ptrdiff_t rowbytes, const MoxRect *region)
+{
+	if(_task_group == NULL || frame < 0)
+		return false;
+
+	IlmThread::Lock lock(_mutex);
+	
+	if(frame >= _duration)
+		return false;
+	
+	if(_width != width || _height != height || _type != type || strcmp(_order, order) != 0)
+		setFormat(width, height, type, order);
+	
+	if(_active_slots == 0)
+		return false;
+	
+	notePattern(frame);
+	
+	bool hit = false;
+	
+	while(true)
+	{
+		const int s = findSlot( sourceFrame(frame) );
+		
+		if(s < 0)
+			break;
+		
+		Slot &slot = _slots[s];
+		
+		if(slot.state == SLOT_READY)
+		{
+			slot.buffer->copyTo(dest, rowbytes, region);
+			
+			hit = true;
+			
+			break;
+		}
+		else if(slot.state == SLOT_DECODING)
+		{
+			// it's on the way, wait for it
+			slot.waiters++;
+			
+			lock.release();
+			
+			slot.done->wait();
+			
+			lock.acquire();
+		}
+		else if(slot.state == SLOT_QUEUED)
+		{
+			// nobody's started on it, so the caller can do it
+			slot.state = SLOT_EMPTY;
+			
+			break;
+		}
+		else
+			break;
+	}
+	
+	schedule(frame);
+	
+	return hit;
+}
+
+
+void
+MoxReadAhead::setSourceFrames(const std::vector<int> &sources)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	_sources = sources;
+}
+
+
+void
+MoxReadAhead::reset(int duration)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	_duration = duration;
+	
+	// anything being decoded now is from the old file
+	for(std::vector<Slot>::iterator i = _slots.begin(); i != _slots.end(); ++i)
+	{
+		if(i->state == SLOT_DECODING)
+		{
+			i->stale = true;
+		}
+		else
+		{
+			i->state = SLOT_EMPTY;
+			i->frame = -1;
+		}
+	}
+	
+	for(std::vector<Decoder>::iterator i = _decoders.begin(); i != _decoders.end(); ++i)
+	{
+		if(i->busy)
+			i->reopen = true;
+		else
+			closeDecoder(*i);
+	}
+	
+	_sources.clear();
+	
+	_last_frame = -1;
+	_step = 0;
+	_run = 0;
+	_depth = 0;
+}
+
+
+bool
+MoxReadAhead::release()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	cancelQueued();
+	
+	for(std::vector<Decoder>::const_iterator i = _decoders.begin(); i != _decoders.end(); ++i)
+	{
+		if(i->busy)
+			return false;
+	}
+	
+	for(std::vector<Slot>::iterator i = _slots.begin(); i != _slots.end(); ++i)
+	{
+		assert(i->state != SLOT_DECODING && i->waiters == 0);
+		
+		delete i->buffer;
+		i->buffer = NULL;
+		
+		i->state = SLOT_EMPTY;
+		i->frame = -1;
+		i->stale = false;
+	}
+	
+	for(std::vector<Decoder>::iterator i = _decoders.begin(); i != _decoders.end(); ++i)
+		closeDecoder(*i);
+	
+	_last_frame = -1;
+	_step = 0;
+	_run = 0;
+	_depth = 0;
+	
+	return true;
+}
+
+
+void
+MoxReadAhead::setThreadCount(int count)
+{
+	if(count < 1)
+		count = 1;
+
+	_pool.setThreadCount(count);
+}
+
+
+void
+MoxReadAhead::shutdown()
+{
+	_pool.shutdown();
+}
+
+
+size_t
+MoxReadAhead::dropFrames()
+{
+	IlmThread::Lock lock(_all_mutex);
+	
+	size_t freed = 0;
+	
+	for(std::set<MoxReadAhead *>::iterator i = _all.begin(); i != _all.end(); ++i)
+		freed += (*i)->dropIdleFrames();
+	
+	return freed;
+}
+
+
+void
+MoxReadAhead::setFormat(int width, int height, MoxFiles::PixelType type, const char *order)
+{
+	// Everything decoded so far is the wrong format.
+	// Buffers get reallocated by the workers as they pick up new slots.
+	for(std::vector<Slot>::iterator i = _slots.begin(); i != _slots.end(); ++i)
+	{
+		if(i->state == SLOT_DECODING)
+		{
+			i->stale = true;
+		}
+		else
+		{
+			i->state = SLOT_EMPTY;
+			i->frame = -1;
+		}
+	}
+	
+	_width = width;
+	_height = height;
+	_type = type;
+	strncpy(_order, order, 5);
+	
+	const size_t frame_bytes = (size_t)width * (size_t)height * 4 * MoxFiles::PixelSize(type);
+	
+	const size_t max_slots = (frame_bytes > 0 ? _settings.max_bytes / frame_bytes : 0);
+	
+	_active_slots = (max_slots < _slots.size() ? max_slots : _slots.size());
+	
+	_last_frame = -1;
+	_step = 0;
+	_run = 0;
+	_depth = 0;
+}
+
+
+void
+MoxReadAhead::notePattern(int frame)
+{
+	// Sequential means moving the same small step as last time,
+	// forward or backward.  Anything else and we back off.
+	const int max_step = 4;
+
+	const int step = frame - _last_frame;
+	
+	if(_last_frame < 0 || step == 0)
+	{
+		// first request, or asking for the same frame again
+	}
+	else if(abs(step) <= max_step && (step == _step || _run == 0))
+	{
+		_step = step;
+		_run++;
+	}
+	else
+	{
+		_step = 0;
+		_run = 0;
+		
+		cancelQueued();
+	}
+	
+	_last_frame = frame;
+	
+	// ramp up as the run gets longer so a couple of accidental
+	// steps don't start decoding a whole bunch of frames
+	if(_run == 0)
+		_depth = 0;
+	else if(_depth == 0)
+		_depth = 1;
+	else if(_depth < _active_slots)
+		_depth *= 2;
+	
+	if(_depth > _active_slots)
+		_depth = _active_slots;
+}
+
+
+void
+MoxReadAhead::schedule(int frame)
+{
+	if(_shutting_down || _depth == 0 || _step == 0)
+		return;
+
+	const int first = frame + _step;
+	const int last = frame + (_step * _depth);
+	
+	const int low = (first < last ? first : last);
+	const int high = (first < last ? last : first);
+	
+	// what actually gets decoded for each frame in the window
+	std::vector<int> window;
+	
+	for(int f = first; f >= low && f <= high && f >= 0 && f < _duration; f += _step)
+		window.push_back( sourceFrame(f) );
+	
+	// anything queued outside the window is no longer wanted
+	for(int s = 0; s < _active_slots; s++)
+	{
+		Slot &slot = _slots[s];
+	
+		if(slot.state == SLOT_QUEUED && std::find(window.begin(), window.end(), slot.frame) == window.end())
+			slot.state = SLOT_EMPTY;
+	}
+	
+	const int current = sourceFrame(frame);
+	
+	for(int w = 0; w < (int)window.size(); w++)
+	{
+		const int f = window[w];
+	
+		if(findSlot(f) >= 0)
+			continue;
+		
+		// Take an empty slot if we have one, otherwise recycle a
+		// decoded frame that's outside the window.  Frames that are
+		// decoding or about to be are left alone.
+		int s = -1;
+		
+		for(int i = 0; i < _active_slots && s < 0; i++)
+		{
+			if(_slots[i].state == SLOT_EMPTY || _slots[i].state == SLOT_FAILED)
+				s = i;
+		}
+		
+		for(int i = 0; i < _active_slots && s < 0; i++)
+		{
+			const Slot &slot = _slots[i];
+			
+			if(slot.state == SLOT_READY && slot.frame != current &&
+				std::find(window.begin(), window.end(), slot.frame) == window.end())
+			{
+				s = i;
+			}
+		}
+		
+		if(s < 0)
+			break;
+		
+		_slots[s].state = SLOT_QUEUED;
+		_slots[s].frame = f;
+		_slots[s].wanted = first + (w * _step);
+		_slots[s].stale = false;
+	}
+	
+	startWorkers();
+}
+
+
+void
+MoxReadAhead::startWorkers()
+{
+	int queued = 0;
+	
+	for(int s = 0; s < _active_slots; s++)
+	{
+		if(_slots[s].state == SLOT_QUEUED)
+			queued++;
+	}
+	
+	for(int d = 0; d < (int)_decoders.size() && queued > 0; d++)
+	{
+		Decoder &decoder = _decoders[d];
+		
+		if(!decoder.busy)
+		{
+			decoder.busy = true;
+			
+			_pool.addTask(new MoxReadAheadTask(_task_group, *this, d));
+			
+			queued--;
+		}
+	}
+}
+
+
+void
+MoxReadAhead::cancelQueued()
+{
+	for(std::vector<Slot>::iterator i = _slots.begin(); i != _slots.end(); ++i)
+	{
+		if(i->state == SLOT_QUEUED)
+			i->state = SLOT_EMPTY;
+	}
+}
+
+
+int
+MoxReadAhead::findSlot(int frame) const
+{
+	for(int s = 0; s < _active_slots; s++)
+	{
+		const Slot &slot = _slots[s];
+	
+		if(slot.frame == frame && !slot.stale &&
+			(slot.state == SLOT_QUEUED || slot.state == SLOT_DECODING || slot.state == SLOT_READY))
+		{
+			return s;
+		}
+	}
+	
+	return -1;
+}
+
+
+void
+MoxReadAhead::closeDecoder(Decoder &decoder)
+{
+	if(decoder.file != NULL)
+	{
+		MoxMemory::remove(MoxMemory::DECODERS, MoxMemory::decoderBytes(decoder.file->header()));
+		
+		delete decoder.file;
+		decoder.file = NULL;
+	}
+	
+	delete decoder.stream;
+	decoder.stream = NULL;
+}
+
+
+int
+MoxReadAhead::sourceFrame(int frame) const
+{
+	if(frame >= 0 && frame < (int)_sources.size())
+		return _sources[frame];
+	else
+		return frame;
+}
+
+
+int
+MoxReadAhead::nextQueued() const
+{
+	// whichever queued frame the host will want first
+	int best = -1;
+	int best_distance = 0;
+	
+	for(int s = 0; s < _active_slots; s++)
+	{
+		const Slot &slot = _slots[s];
+		
+		if(slot.state == SLOT_QUEUED)
+		{
+			const int distance = abs(slot.wanted - _last_frame);
+			
+			if(best < 0 || distance < best_distance)
+			{
+				best = s;
+				best_distance = distance;
+			}
+		}
+	}
+	
+	return best;
+}
+
+
+size_t
+MoxReadAhead::dropIdleFrames()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	size_t freed = 0;
+	
+	// a slot being decoded is the worker's until it's done
+	for(std::vector<Slot>::iterator i = _slots.begin(); i != _slots.end(); ++i)
+	{
+		if(i->state != SLOT_DECODING && i->buffer != NULL)
+		{
+			freed += i->buffer->size();
+			
+			delete i->buffer;
+			i->buffer = NULL;
+			
+			i->state = SLOT_EMPTY;
+			i->frame = -1;
+		}
+	}
+	
+	return freed;
+}
+
+
+void
+MoxReadAhead::decodeLoop(int d)
+{
+	IlmThread::Lock lock(_mutex);
+
+	Decoder &decoder = _decoders[d];
+	
+	assert(decoder.busy);
+	
+	while(!_shutting_down)
+	{
+		const int s = nextQueued();
+		
+		if(s < 0)
+			break;
+		
+		Slot &slot = _slots[s];
+		
+		slot.state = SLOT_DECODING;
+		
+		const int frame = slot.frame;
+		const int width = _width;
+		const int height = _height;
+		const MoxFiles::PixelType type = _type;
+		char order[5];
+		strncpy(order, _order, 5);
+		
+		lock.release();
+		
+		
+		bool success = true;
+		
+		try
+		{
+			if(slot.buffer == NULL || !slot.buffer->matches(width, height, type, order))
+			{
+				delete slot.buffer;
+				slot.buffer = NULL;
+				
+				slot.buffer = new MoxFrame(width, height, type, order);
+			}
+		
+			if(decoder.file == NULL)
+			{
+				if(decoder.stream == NULL)
+					decoder.stream = _source->openStream();
+				
+				decoder.file = new MoxFiles::InputFile(*decoder.stream);
+				
+				_source->fileOpened(*decoder.stream);
+				
+				MoxMemory::add(MoxMemory::DECODERS, MoxMemory::decoderBytes(decoder.file->header()));
+			}
+			
+			MoxFiles::FrameBuffer frame_buffer(width, height);
+			
+			slot.buffer->insertSlices(frame_buffer);
+			
+			decoder.file->getFrame(frame, frame_buffer);
+		}
+		catch(...)
+		{
+			success = false;
+		}
+		
+		
+		lock.acquire();
+		
+		if(decoder.reopen)
+		{
+			closeDecoder(decoder);
+			
+			decoder.reopen = false;
+		}
+		
+		if(slot.stale)
+		{
+			slot.state = SLOT_EMPTY;
+			slot.frame = -1;
+			slot.stale = false;
+		}
+		else
+			slot.state = (success ? SLOT_READY : SLOT_FAILED);
+		
+		while(slot.waiters > 0)
+		{
+			slot.done->post();
+			
+			slot.waiters--;
+		}
+	}
+	
+	decoder.busy = false;
+}
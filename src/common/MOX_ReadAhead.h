@@ -0,0 +1,188 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_READAHEAD_H
+#define MOX_READAHEAD_H
+
+#include "MOX_Frame.h"
+#include "MOX_StreamPool.h"
+#include "MOX_WorkerPool.h"
+
+#include <MoxFiles/InputFile.h>
+
+#include <IlmThreadMutex.h>
+#include <IlmThreadSemaphore.h>
+#include <IlmThreadPool.h>
+
+#include <vector>
+#include <set>
+
+// When the host is playing through a file one frame after another,
+// MoxReadAhead decodes the frames it is about to ask for on background
+// threads.  Each file gets its own InputFiles for this so the
+// foreground decoder is never tied up.  Frames that don't arrive in
+// sequence make it back off and drop anything it hasn't started on.
+
+class MoxReadAhead
+{
+  public:
+	struct Settings
+	{
+		int depth;			// most frames to decode ahead, 0 turns it off
+		size_t max_bytes;	// most memory a single file can hold in decoded frames
+		int decoders;		// background InputFiles per file
+		
+		Settings() : depth(8), max_bytes(512 * 1024 * 1024), decoders(2) {}
+	};
+	
+	// The source opens a fresh stream on the same file for each background decoder.
+	MoxReadAhead(MoxStreamSource *source, int duration, const Settings &settings); // takes ownership of source
+	~MoxReadAhead();
+	
+	// Call this for every frame the host asks for.  Returns true if the frame
+	// was already decoded and has been copied to dest, otherwise the caller
+	// decodes it.  Either way the request is used to schedule what comes next.
+	// If region is not NULL, only those pixels are copied.
+	bool fetch(int frame, int width, int height, MoxFiles::PixelType type, const char *order,
+				char *dest, ptrdiff_t rowbytes, const MoxRect *region = NULL);
+	
+	// When frames repeat, sources[frame] is the first frame that looks the
+	// same.  Repeats share a slot instead of being decoded again.
+	void setSourceFrames(const std::vector<int> &sources);
+	
+	// The file has been written over.  Forget everything decoded and
+	// reopen the background decoders before using them again.
+	void reset(int duration);
+	
+	// Drop scheduled work and, if the workers are idle, close the background
+	// decoders and free the frames.  Returns false if work is still running.
+	bool release();
+	
+	
+	// The worker threads are shared by every file.
+	static void setThreadCount(int count);
+	static void shutdown();
+	
+	// Free every file's decoded frames that nobody is waiting on, for when
+	// memory is short.  Returns the bytes freed.
+	static size_t dropFrames();
+	
+  private:
+	enum SlotState
+	{
+		SLOT_EMPTY,
+		SLOT_QUEUED,
+		SLOT_DECODING,
+		SLOT_READY,
+		SLOT_FAILED
+	};
+	
+	struct Slot
+	{
+		SlotState state;
+		int frame;
+		int wanted; // the frame the host will ask for, if it's a repeat of this one
+		bool stale; // format changed while decoding
+		MoxFrame *buffer;
+		int waiters;
+		IlmThread::Semaphore *done;
+		
+		Slot() : state(SLOT_EMPTY), frame(-1), wanted(-1), stale(false), buffer(NULL), waiters(0), done(NULL) {}
+	};
+	
+	struct Decoder
+	{
+		bool busy;
+		bool reopen; // close when done with the current frame
+		MoxMxf::IOStream *stream;
+		MoxFiles::InputFile *file;
+		
+		Decoder() : busy(false), reopen(false), stream(NULL), file(NULL) {}
+	};
+	
+	MoxStreamSource *_source;
+	int _duration;
+	const Settings _settings;
+	
+	IlmThread::Mutex _mutex;
+	IlmThread::TaskGroup *_task_group;
+	bool _shutting_down;
+	
+	std::vector<Slot> _slots;
+	int _active_slots;
+	
+	std::vector<Decoder> _decoders;
+	
+	std::vector<int> _sources;
+	
+	int _width;
+	int _height;
+	MoxFiles::PixelType _type;
+	char _order[5];
+	
+	int _last_frame;
+	int _step;
+	int _run;
+	int _depth;
+	
+	void setFormat(int width, int height, MoxFiles::PixelType type, const char *order);
+	void notePattern(int frame);
+	void schedule(int frame);
+	void startWorkers();
+	void cancelQueued();
+	int findSlot(int frame) const;
+	int sourceFrame(int frame) const;
+	int nextQueued() const;
+	void closeDecoder(Decoder &decoder);
+	
+	void decodeLoop(int decoder);
+	
+	size_t dropIdleFrames();
+	
+	friend class MoxReadAheadTask;
+	
+	static MoxWorkerPool _pool; // every file shares the pool
+	
+	static IlmThread::Mutex _all_mutex; // taken before any file's _mutex
+	static std::set<MoxReadAhead *> _all;
+	
+	MoxReadAhead(const MoxReadAhead &);
+	MoxReadAhead & operator = (const MoxReadAhead &);
+};
+
+#endif // MOX_READAHEAD_H
@@ -0,0 +1,471 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_StreamPool.h"
+
+#include "MOX_Platform.h"
+
+#include <assert.h>
+
+
+// Holds the stream open for the length of one call
+class MoxPooledStreamUse
+{
+  public:
+	MoxPooledStreamUse(MoxPooledStream &stream) : _stream(stream) { _stream._pool.checkOut(&_stream); }
+	~MoxPooledStreamUse() { _stream._pool.checkIn(&_stream); }
+	
+	MoxMxf::IOStream & stream() { return *_stream._stream; }
+	
+  private:
+	MoxPooledStream &_stream;
+};
+
+
+MoxPooledStream::MoxPooledStream(MoxStreamPool &pool, const MoxStreamSource &source) :
+	_pool(pool),
+	_source(source),
+	_stream(NULL),
+	_position(0),
+	_opened_before(false),
+	_opening(false),
+	_opened(0),
+	_waiters(0),
+	_busy(0),
+	_used(false),
+	_last_access(MoxMilliseconds())
+{
+	_pool.add(this);
+}
+
+
+MoxPooledStream::~MoxPooledStream()
+{
+	_pool.remove(this);
+}
+
+
+int
+MoxPooledStream::FileSeek(MoxMxf::UInt64 offset)
+{
+	MoxPooledStreamUse use(*this);
+	
+	const int result = use.stream().FileSeek(offset);
+	
+	_position = offset;
+	
+	return result;
+}
+
+
+MoxMxf::UInt64
+MoxPooledStream::FileRead(unsigned char *dest, MoxMxf::UInt64 size)
+{
+	MoxPooledStreamUse use(*this);
+	
+	const MoxMxf::UInt64 bytes = use.stream().FileRead(dest, size);
+	
+	_position += bytes;
+	
+	return bytes;
+}
+
+
+MoxMxf::UInt64
+MoxPooledStream::FileWrite(const unsigned char *source, MoxMxf::UInt64 size)
+{
+	MoxPooledStreamUse use(*this);
+	
+	const MoxMxf::UInt64 bytes = use.stream().FileWrite(source, size);
+	
+	_position += bytes;
+	
+	return bytes;
+}
+
+
+MoxMxf::UInt64
+MoxPooledStream::FileTell()
+{
+	return _position;
+}
+
+
+void
+MoxPooledStream::FileFlush()
+{
+	if(_stream != NULL)
+	{
+		MoxPooledStreamUse use(*this);
+		
+		use.stream().FileFlush();
+	}
+}
+
+
+void
+MoxPooledStream::FileTruncate(MoxMxf::Int64 newsize)
+{
+	MoxPooledStreamUse use(*this);
+	
+	use.stream().FileTruncate(newsize);
+}
+
+
+MoxMxf::Int64
+MoxPooledStream::FileSize()
+{
+	MoxPooledStreamUse use(*this);
+	
+	return use.stream().FileSize();
+}
+
+
+#pragma mark-
+
+
+MoxStreamPool::MoxStreamPool(int max_open) :
+	_max_open(max_open > 0 ? max_open : defaultMaxOpen()),
+	_open(0),
+	_streams(0),
+	_opens(0),
+	_reopens(0),
+	_evictions(0)
+{
+
+}
+
+
+MoxStreamPool::~MoxStreamPool()
+{
+	assert(_streams == 0);
+	assert(_lru.empty());
+}
+
+
+void
+MoxStreamPool::setMaxOpen(int max_open)
+{
+	ClosedList closed;
+	
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		_max_open = (max_open > 0 ? max_open : defaultMaxOpen());
+		
+		makeRoom(0, closed);
+	}
+	
+	deleteClosed(closed);
+}
+
+
+void
+MoxStreamPool::closeIdle(MoxMxf::UInt64 milliseconds)
+{
+	ClosedList closed;
+	
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		const MoxMxf::UInt64 now = MoxMilliseconds();
+		
+		StreamList::iterator i = _lru.begin();
+		
+		while(i != _lru.end())
+		{
+			MoxPooledStream *stream = *i++;
+			
+			IlmThread::Lock stream_lock(stream->_mutex);
+			
+			if(stream->_busy == 0 && (now - stream->_last_access) > milliseconds)
+				closeStream(stream, closed);
+		}
+	}
+	
+	deleteClosed(closed);
+}
+
+
+MoxStreamPool::Stats
+MoxStreamPool::stats() const
+{
+	IlmThread::Lock lock(_mutex);
+	
+	Stats stats;
+	
+	stats.open = _open;
+	stats.streams = _streams;
+	stats.opens = _opens;
+	stats.reopens = _reopens;
+	stats.evictions = _evictions;
+	
+	return stats;
+}
+
+
+int
+MoxStreamPool::defaultMaxOpen()
+{
+	// Leave most of the descriptors for the host and everybody else
+	const int limit = MoxFileDescriptorLimit() / 4;
+	
+	return (limit < 16 ? 16 : limit > 4096 ? 4096 : limit);
+}
+
+
+void
+MoxStreamPool::add(MoxPooledStream *)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	_streams++;
+}
+
+
+void
+MoxStreamPool::remove(MoxPooledStream *stream)
+{
+	ClosedList closed;
+	
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		IlmThread::Lock stream_lock(stream->_mutex);
+		
+		assert(stream->_busy == 0);
+		
+		if(stream->_stream != NULL)
+			closeStream(stream, closed);
+		
+		_streams--;
+	}
+	
+	deleteClosed(closed);
+}
+
+
+void
+MoxStreamPool::checkOut(MoxPooledStream *stream)
+{
+	{
+		IlmThread::Lock stream_lock(stream->_mutex);
+		
+		// another call on this stream is opening it
+		while(stream->_opening)
+		{
+			stream->_waiters++;
+			
+			stream_lock.release();
+			
+			stream->_opened.wait();
+			
+			stream_lock.acquire();
+		}
+		
+		stream->_busy++;
+		
+		stream->_last_access = MoxMilliseconds();
+		
+		if(stream->_stream != NULL)
+		{
+			// already open, the pool doesn't need to know right now
+			stream->_used = true;
+			
+			return;
+		}
+		
+		stream->_opening = true;
+	}
+	
+	ClosedList closed;
+	
+	// count it as open now, so room is made before the file is opened
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		makeRoom(1, closed);
+		
+		_open++;
+	}
+	
+	deleteClosed(closed);
+	
+	// Open without holding any lock, a slow network open only holds up this stream
+	MoxMxf::IOStream *opened = NULL;
+	
+	try
+	{
+		opened = stream->_source.openStream();
+		
+		if(stream->_position != 0)
+			opened->FileSeek(stream->_position);
+	}
+	catch(...)
+	{
+		delete opened;
+		
+		IlmThread::Lock lock(_mutex);
+		
+		_open--;
+		
+		IlmThread::Lock stream_lock(stream->_mutex);
+		
+		stream->_opening = false;
+		stream->_busy--;
+		
+		while(stream->_waiters > 0)
+		{
+			stream->_waiters--;
+			
+			stream->_opened.post();
+		}
+		
+		throw;
+	}
+	
+	IlmThread::Lock lock(_mutex);
+	
+	if(stream->_opened_before)
+		_reopens++;
+	else
+		_opens++;
+	
+	_lru.push_front(stream);
+	
+	IlmThread::Lock stream_lock(stream->_mutex);
+	
+	stream->_stream = opened;
+	stream->_opened_before = true;
+	stream->_opening = false;
+	stream->_used = false;
+	stream->_lru_position = _lru.begin();
+	
+	while(stream->_waiters > 0)
+	{
+		stream->_waiters--;
+		
+		stream->_opened.post();
+	}
+}
+
+
+void
+MoxStreamPool::checkIn(MoxPooledStream *stream)
+{
+	IlmThread::Lock stream_lock(stream->_mutex);
+	
+	assert(stream->_busy > 0);
+	
+	stream->_busy--;
+	
+	stream->_last_access = MoxMilliseconds();
+}
+
+
+void
+MoxStreamPool::closeStream(MoxPooledStream *stream, ClosedList &closed)
+{
+	// both locks are held, the file gets closed later without them
+	assert(stream->_stream != NULL);
+	assert(stream->_busy == 0);
+	
+	closed.push_back(stream->_stream);
+	
+	stream->_stream = NULL;
+	
+	_lru.erase(stream->_lru_position);
+	
+	_open--;
+}
+
+
+void
+MoxStreamPool::makeRoom(int open_count, ClosedList &closed)
+{
+	// Close from the least recently used end.  A stream that's been used
+	// since we last came by goes back to the front instead, once.
+	// Streams in the middle of a call are skipped, so we can go over
+	// for a moment if everything is busy.
+	StreamList::iterator i = _lru.end();
+	
+	int looked = 0;
+	const int look_limit = 2 * _open;
+	
+	while(_open + open_count > _max_open && i != _lru.begin() && looked < look_limit)
+	{
+		--i;
+		
+		looked++;
+		
+		MoxPooledStream *stream = *i;
+		
+		IlmThread::Lock stream_lock(stream->_mutex);
+		
+		if(stream->_busy > 0)
+			continue;
+		
+		StreamList::iterator next = i;
+		++next;
+		
+		if(stream->_used)
+		{
+			stream->_used = false;
+			
+			_lru.splice(_lru.begin(), _lru, i);
+		}
+		else
+		{
+			closeStream(stream, closed);
+			
+			_evictions++;
+		}
+		
+		i = next;
+	}
+}
+
+
+void
+MoxStreamPool::deleteClosed(ClosedList &closed)
+{
+	for(ClosedList::iterator i = closed.begin(); i != closed.end(); ++i)
+		delete *i;
+	
+	closed.clear();
+}
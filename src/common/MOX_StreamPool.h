@@ -0,0 +1,192 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_STREAMPOOL_H
+#define MOX_STREAMPOOL_H
+
+#include <MoxMxf/PlatformIOStream.h>
+
+#include <IlmThreadMutex.h>
+#include <IlmThreadSemaphore.h>
+
+#include <list>
+#include <vector>
+
+// Opens a stream on a particular file, as many times as you like
+class MoxStreamSource
+{
+  public:
+	virtual ~MoxStreamSource() {}
+	
+	virtual MoxMxf::IOStream * openStream() const = 0;
+	
+	// after an InputFile has read its header from one of our streams
+	virtual void fileOpened(MoxMxf::IOStream &stream) const {}
+};
+
+
+class MoxStreamPool;
+
+// An IOStream that only holds an open file while the pool lets it.
+// When the pool closes it, the next read reopens the file and seeks
+// back to where it was, so an InputFile on top never notices.
+class MoxPooledStream : public MoxMxf::IOStream
+{
+  public:
+	MoxPooledStream(MoxStreamPool &pool, const MoxStreamSource &source);
+	virtual ~MoxPooledStream();
+	
+	virtual int FileSeek(MoxMxf::UInt64 offset);
+	virtual MoxMxf::UInt64 FileRead(unsigned char *dest, MoxMxf::UInt64 size);
+	virtual MoxMxf::UInt64 FileWrite(const unsigned char *source, MoxMxf::UInt64 size);
+	virtual MoxMxf::UInt64 FileTell();
+	virtual void FileFlush();
+	virtual void FileTruncate(MoxMxf::Int64 newsize);
+	virtual MoxMxf::Int64 FileSize();
+	
+	bool isOpen() const { return (_stream != NULL); }
+	MoxMxf::UInt64 lastAccess() const { return _last_access; } // MoxMilliseconds()
+	
+  private:
+	MoxStreamPool &_pool;
+	const MoxStreamSource &_source;
+	
+	// The pool's lock is only for opening and closing.  Calls on a stream
+	// that's already open just take this one.
+	IlmThread::Mutex _mutex;
+	
+	MoxMxf::IOStream *_stream;
+	MoxMxf::UInt64 _position;
+	bool _opened_before;
+	
+	bool _opening; // by some thread, without any lock
+	IlmThread::Semaphore _opened;
+	int _waiters;
+	
+	int _busy;
+	bool _used; // since the pool last looked, so it gets another chance
+	MoxMxf::UInt64 _last_access;
+	
+	std::list<MoxPooledStream *>::iterator _lru_position;
+	
+	friend class MoxStreamPool;
+	friend class MoxPooledStreamUse;
+	
+	MoxPooledStream(const MoxPooledStream &);
+	MoxPooledStream & operator = (const MoxPooledStream &);
+};
+
+
+// Makes pooled streams, for handing to something like MoxReadAhead
+class MoxPooledStreamSource : public MoxStreamSource
+{
+  public:
+	MoxPooledStreamSource(MoxStreamPool &pool, const MoxStreamSource &source) : _pool(pool), _source(source) {}
+	virtual ~MoxPooledStreamSource() {}
+	
+	virtual MoxMxf::IOStream * openStream() const { return new MoxPooledStream(_pool, _source); }
+	
+  private:
+	MoxStreamPool &_pool;
+	const MoxStreamSource &_source; // not ours
+};
+
+
+// Keeps no more than a set number of files open at once,
+// closing the least recently used one to make room.
+class MoxStreamPool
+{
+  public:
+	MoxStreamPool(int max_open = 0); // 0 means figure it out from the descriptor limit
+	~MoxStreamPool();
+	
+	void setMaxOpen(int max_open);
+	int maxOpen() const { return _max_open; }
+	
+	// close anything that hasn't been touched in a while
+	void closeIdle(MoxMxf::UInt64 milliseconds);
+	
+	struct Stats
+	{
+		int open;
+		int streams;
+		unsigned long opens;
+		unsigned long reopens;
+		unsigned long evictions;
+	};
+	
+	Stats stats() const;
+	
+	static int defaultMaxOpen();
+	
+  private:
+	int _max_open;
+	
+	typedef std::list<MoxPooledStream *> StreamList;
+	
+	StreamList _lru; // open streams, roughly most recently used at the front
+	int _open;
+	int _streams;
+	
+	unsigned long _opens;
+	unsigned long _reopens;
+	unsigned long _evictions;
+	
+	IlmThread::Mutex _mutex;
+	
+	typedef std::vector<MoxMxf::IOStream *> ClosedList; // to delete after the lock is gone
+	
+	void add(MoxPooledStream *);
+	void remove(MoxPooledStream *stream);
+	
+	void checkOut(MoxPooledStream *stream);
+	void checkIn(MoxPooledStream *stream);
+	
+	void closeStream(MoxPooledStream *stream, ClosedList &closed);
+	void makeRoom(int open_count, ClosedList &closed);
+	
+	static void deleteClosed(ClosedList &closed);
+	
+	friend class MoxPooledStream;
+	friend class MoxPooledStreamUse;
+	
+	MoxStreamPool(const MoxStreamPool &);
+	MoxStreamPool & operator = (const MoxStreamPool &);
+};
+
+#endif // MOX_STREAMPOOL_H
@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_Threads.h"
+
+#include <MoxFiles/Thread.h>
+
+#include <assert.h>
+
+
+IlmThread::Mutex MoxGlobalThreads::_mutex;
+int MoxGlobalThreads::_refs = 0;
+int MoxGlobalThreads::_count = 1;
+int MoxGlobalThreads::_applied = 0;
+
+
+void
+MoxGlobalThreads::acquire(int count)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	// Big enough for whoever asked for the most
+	if(_refs++ == 0 || count > _count)
+		_count = (count > 1 ? count : 1);
+	
+	apply(_count);
+}
+
+
+void
+MoxGlobalThreads::release()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	assert(_refs > 0);
+	
+	if(_refs > 0 && --_refs == 0)
+		apply(0);
+}
+
+
+void
+MoxGlobalThreads::setThreadCount(int count)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	_count = (count > 1 ? count : 1);
+	
+	if(_refs > 0)
+		apply(_count);
+}
+
+
+int
+MoxGlobalThreads::threadCount()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	return _count;
+}
+
+
+void
+MoxGlobalThreads::apply(int count)
+{
+	// Changing the count joins and restarts every thread in the pool,
+	// so don't do it unless something is different.
+	if(count != _applied && MoxFiles::supportsThreads())
+	{
+		MoxFiles::setGlobalThreadCount(count);
+		
+		_applied = count;
+	}
+}
@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_WorkerPool.h"
+
+#include <assert.h>
+
+
+MoxWorkerPool::MoxWorkerPool(int threads) :
+	_pool(NULL),
+	_threads(threads),
+	_reserved(0)
+{
+
+}
+
+
+void
+MoxWorkerPool::setThreadCount(int count)
+{
+	IlmThread::Lock lock(_mutex);
+	
+	_threads = count;
+	
+	if(_pool != NULL)
+		_pool->setNumThreads(_threads + _reserved);
+}
+
+
+void
+MoxWorkerPool::reserveThread()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	_reserved++;
+	
+	// adding threads doesn't wait for the running tasks, taking them away does
+	if(_pool != NULL && _pool->numThreads() < _threads + _reserved)
+		_pool->setNumThreads(_threads + _reserved);
+}
+
+
+void
+MoxWorkerPool::releaseThread()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	assert(_reserved > 0);
+	
+	_reserved--;
+}
+
+
+void
+MoxWorkerPool::addTask(IlmThread::Task *task)
+{
+	// not under the lock, with no threads the task runs right here
+	pool().addTask(task);
+}
+
+
+void
+MoxWorkerPool::shutdown()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	assert(_reserved == 0);
+	
+	delete _pool;
+	
+	_pool = NULL;
+}
+
+
+IlmThread::ThreadPool &
+MoxWorkerPool::pool()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	if(_pool == NULL)
+		_pool = new IlmThread::ThreadPool(_threads + _reserved);
+	
+	return *_pool;
+}
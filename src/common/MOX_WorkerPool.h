@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_WORKERPOOL_H
+#define MOX_WORKERPOOL_H
+
+#include <IlmThreadMutex.h>
+#include <IlmThreadPool.h>
+
+#include <stddef.h>
+
+// A thread pool that every file shares, made the first time a task is
+// added.  Background work that needs a thread to itself for as long as it's
+// around reserves one, the rest shares however many setThreadCount() asks for.
+
+class MoxWorkerPool
+{
+  public:
+	MoxWorkerPool(int threads);
+	
+	void setThreadCount(int count);
+	
+	void reserveThread();
+	void releaseThread(); // the pool doesn't shrink until shutdown()
+	
+	void addTask(IlmThread::Task *task); // takes ownership of task
+	
+	void shutdown(); // after every task is done
+	
+  private:
+	IlmThread::Mutex _mutex;
+	IlmThread::ThreadPool *_pool;
+	int _threads;
+	int _reserved;
+	
+	IlmThread::ThreadPool & pool();
+	
+	MoxWorkerPool(const MoxWorkerPool &);
+	MoxWorkerPool & operator = (const MoxWorkerPool &);
+};
+
+#endif // MOX_WORKERPOOL_H
@@ -0,0 +1,373 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#include "MOX_WriteBehind.h"
+
+#include "MOX_BufferPool.h"
+
+#include <MoxMxf/Exception.h>
+
+#include <string.h>
+#include <assert.h>
+
+
+MoxWriteBehindStream::MoxWriteBehindStream(MoxMxf::IOStream *stream, const Settings &settings) :
+	MoxBackgroundWriter(settings.chunks > 0),
+	_stream(stream),
+	_settings(settings),
+	_position(0),
+	_size(0),
+	_current(NULL),
+	_chunks(0),
+	_error(false)
+{
+	if(_stream == NULL)
+		throw MoxMxf::NullExc("Null stream");
+	
+	try
+	{
+		if(_settings.chunk_size == 0)
+			throw MoxMxf::ArgExc("Invalid chunk size");
+		
+		_position = _stream->FileTell();
+		_size = _stream->FileSize();
+	}
+	catch(...)
+	{
+		// the stream is ours even if we don't get made
+		delete _stream;
+		
+		throw;
+	}
+}
+
+
+MoxWriteBehindStream::~MoxWriteBehindStream()
+{
+	try
+	{
+		wait();
+	}
+	catch(...) {}
+	
+	stopWriter();
+	
+	assert(_current == NULL && _full.empty());
+	
+	for(std::vector<Chunk *>::iterator i = _free.begin(); i != _free.end(); ++i)
+	{
+		MoxBufferPool::release((*i)->data, _settings.chunk_size);
+		
+		delete *i;
+	}
+	
+	delete _stream;
+}
+
+
+int
+MoxWriteBehindStream::FileSeek(MoxMxf::UInt64 offset)
+{
+	// the next write starts a new chunk if it has to
+	_position = offset;
+	
+	return 0;
+}
+
+
+MoxMxf::UInt64
+MoxWriteBehindStream::FileRead(unsigned char *dest, MoxMxf::UInt64 size)
+{
+	wait();
+	
+	_stream->FileSeek(_position);
+	
+	const MoxMxf::UInt64 bytes = _stream->FileRead(dest, size);
+	
+	_position += bytes;
+	
+	return bytes;
+}
+
+
+MoxMxf::UInt64
+MoxWriteBehindStream::FileWrite(const unsigned char *source, MoxMxf::UInt64 size)
+{
+	{
+		IlmThread::Lock lock(_mutex);
+		
+		if(_error)
+			throw MoxMxf::IoExc("Error writing file");
+	}
+	
+	const MoxMxf::UInt64 total = size;
+	
+	while(size > 0)
+	{
+		if(_current != NULL && _position != _current->offset + _current->length)
+			submit();
+		
+		if(_current == NULL)
+		{
+			_current = getChunk();
+			
+			_current->offset = _position;
+			_current->length = 0;
+		}
+		
+		// fill up to the next chunk boundary in the file
+		const MoxMxf::UInt64 boundary = ((_current->offset / _settings.chunk_size) + 1) * _settings.chunk_size;
+		const MoxMxf::UInt64 room = boundary - (_current->offset + _current->length);
+		
+		const size_t bytes = (size_t)(size < room ? size : room);
+		
+		memcpy(_current->data + _current->length, source, bytes);
+		
+		_current->length += bytes;
+		_position += bytes;
+		
+		source += bytes;
+		size -= bytes;
+		
+		if(_position > (MoxMxf::UInt64)_size)
+			_size = _position;
+		
+		if(_current->offset + _current->length == boundary)
+			submit();
+	}
+	
+	return total;
+}
+
+
+MoxMxf::UInt64
+MoxWriteBehindStream::FileTell()
+{
+	return _position;
+}
+
+
+void
+MoxWriteBehindStream::FileFlush()
+{
+	wait();
+	
+	_stream->FileFlush();
+}
+
+
+void
+MoxWriteBehindStream::FileTruncate(MoxMxf::Int64 newsize)
+{
+	wait();
+	
+	_stream->FileTruncate(newsize);
+	
+	_size = newsize;
+}
+
+
+MoxMxf::Int64
+MoxWriteBehindStream::FileSize()
+{
+	// no need to wait for the writes to know this
+	return _size;
+}
+
+
+MoxWriteBehindStream::Chunk *
+MoxWriteBehindStream::getChunk()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	while(_free.empty() && _chunks >= _settings.chunks && busy() && !_error)
+	{
+		waitForWriter(lock);
+	}
+	
+	if(_error)
+		throw MoxMxf::IoExc("Error writing file");
+	
+	if(!_free.empty())
+	{
+		Chunk *chunk = _free.back();
+		
+		_free.pop_back();
+		
+		return chunk;
+	}
+	
+	Chunk *chunk = new Chunk;
+	
+	try
+	{
+		chunk->data = (unsigned char *)MoxBufferPool::allocate(_settings.chunk_size);
+	}
+	catch(...)
+	{
+		delete chunk;
+		
+		throw;
+	}
+	
+	chunk->offset = 0;
+	chunk->length = 0;
+	
+	_chunks++;
+	
+	return chunk;
+}
+
+
+void
+MoxWriteBehindStream::submit()
+{
+	assert(_current != NULL);
+	
+	Chunk *chunk = _current;
+	
+	_current = NULL;
+	
+	if( !threaded() )
+	{
+		// no thread, write it right here
+		try
+		{
+			writeChunk(*chunk);
+		}
+		catch(...)
+		{
+			IlmThread::Lock lock(_mutex);
+			
+			_free.push_back(chunk);
+			
+			_error = true;
+			
+			throw;
+		}
+		
+		IlmThread::Lock lock(_mutex);
+		
+		_free.push_back(chunk);
+		
+		return;
+	}
+	
+	IlmThread::Lock lock(_mutex);
+	
+	_full.push_back(chunk);
+	
+	const bool start_writer = markBusy();
+	
+	lock.release();
+	
+	if(start_writer)
+		start();
+}
+
+
+void
+MoxWriteBehindStream::writeChunk(const Chunk &chunk)
+{
+	if(_stream->FileSeek(chunk.offset) != 0)
+		throw MoxMxf::IoExc("Seek failed");
+	
+	if(_stream->FileWrite(chunk.data, chunk.length) != chunk.length)
+		throw MoxMxf::IoExc("Write failed");
+}
+
+
+void
+MoxWriteBehindStream::wait()
+{
+	if(_current != NULL)
+		submit();
+	
+	IlmThread::Lock lock(_mutex);
+	
+	waitUntilIdle(lock);
+	
+	if(_error)
+		throw MoxMxf::IoExc("Error writing file");
+}
+
+
+void
+MoxWriteBehindStream::writeLoop()
+{
+	IlmThread::Lock lock(_mutex);
+	
+	while(!_full.empty() && !_error)
+	{
+		Chunk *chunk = _full.front();
+		
+		_full.pop_front();
+		
+		lock.release();
+		
+		bool error = false;
+		
+		try
+		{
+			writeChunk(*chunk);
+		}
+		catch(...)
+		{
+			error = true;
+		}
+		
+		lock.acquire();
+		
+		if(error)
+			_error = true;
+		
+		_free.push_back(chunk);
+		
+		wakeWaiters();
+	}
+	
+	// after an error the rest never get written
+	while(!_full.empty())
+	{
+		_free.push_back(_full.front());
+		
+		_full.pop_front();
+	}
+	
+	writerDone();
+}
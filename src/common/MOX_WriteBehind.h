@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2015, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// MOX plug-in common code
+//
+// by Brendan Bolles <brendan@fnordware.com>
+//
+// ------------------------------------------------------------------------
+
+#ifndef MOX_WRITEBEHIND_H
+#define MOX_WRITEBEHIND_H
+
+#include "MOX_BackgroundWriter.h"
+
+#include <MoxMxf/PlatformIOStream.h>
+
+#include <deque>
+#include <vector>
+
+// MoxFiles writes a movie one KLV packet at a time, and on a network drive
+// every one of those small writes waits for the server.  This IOStream
+// gathers them into big chunks that a background thread writes in order.
+// Chunks end on multiples of the chunk size in the file, so after the
+// first one the writes are aligned.  Seeking back to patch the header
+// just starts a new chunk, and it gets written after the ones before it.
+// Reads, flushes and truncates wait for everything to be written first.
+// Write errors come out of the next call after they happen.
+
+class MoxWriteBehindStream : public MoxMxf::IOStream, private MoxBackgroundWriter
+{
+  public:
+	struct Settings
+	{
+		size_t chunk_size;	// bytes in each write
+		int chunks;			// how many can be waiting at once
+		
+		Settings() : chunk_size(8 * 1024 * 1024), chunks(4) {}
+	};
+	
+	MoxWriteBehindStream(MoxMxf::IOStream *stream, const Settings &settings); // we own the stream
+	virtual ~MoxWriteBehindStream(); // writes what's left, but any error is lost
+	
+	virtual int FileSeek(MoxMxf::UInt64 offset);
+	virtual MoxMxf::UInt64 FileRead(unsigned char *dest, MoxMxf::UInt64 size);
+	virtual MoxMxf::UInt64 FileWrite(const unsigned char *source, MoxMxf::UInt64 size);
+	virtual MoxMxf::UInt64 FileTell();
+	virtual void FileFlush();
+	virtual void FileTruncate(MoxMxf::Int64 newsize);
+	virtual MoxMxf::Int64 FileSize();
+	
+  private:
+	MoxMxf::IOStream *_stream;
+	const Settings _settings;
+	
+	MoxMxf::UInt64 _position;
+	MoxMxf::Int64 _size; // what the file will be once everything is written
+	
+	struct Chunk
+	{
+		unsigned char *data;
+		MoxMxf::UInt64 offset;
+		size_t length;
+	};
+	
+	Chunk *_current; // being filled, NULL if there isn't one
+	
+	std::deque<Chunk *> _full; // waiting to be written, in order
+	std::vector<Chunk *> _free;
+	int _chunks; // allocated so far
+	bool _error;
+	
+	Chunk * getChunk();
+	void submit();
+	void writeChunk(const Chunk &chunk);
+	void wait(); // for everything to be written
+	
+	virtual void writeLoop();
+	
+	MoxWriteBehindStream(const MoxWriteBehindStream &);
+	MoxWriteBehindStream & operator = (const MoxWriteBehindStream &);
+};
+
+#endif // MOX_WRITEBEHIND_H
@@ -42,6 +42,14 @@
 
 #include "MOX_Premiere_Export_Params.h"
 
+#include "MOX_FrameInfo.h"
+#include "MOX_Platform.h"
+#include "MOX_Threads.h"
+#include "MOX_Proxy.h"
+#include "MOX_EncodeQueue.h"
+#include "MOX_BufferPool.h"
+#include "MOX_BackgroundWriter.h"
+
 #include <MoxFiles/OutputFile.h>
 
 #include <MoxFiles/Thread.h>
@@ -69,6 +77,8 @@ static const csSDK_int32 MOX_Export_Class = 'MOX ';
 
 extern int g_num_cpus;
 
+static bool g_holds_threads = false;
+
 
 
 class PrIOStream : public MoxMxf::IOStream
@@ -299,6 +309,13 @@ exSDKStartup(
 		info[1] = kPrTrue; // one spot past isCacheable
 	#endif
 	}
+	
+	if(!g_holds_threads)
+	{
+		MoxGlobalThreads::acquire(g_num_cpus);
+		
+		g_holds_threads = true;
+	}
 
 	return malNoError;
 }
@@ -307,8 +324,14 @@ exSDKStartup(
 static prMALError
 exSDKShutdown()
 {
-	if( MoxFiles::supportsThreads() )
-		MoxFiles::setGlobalThreadCount(0);
+	MoxBackgroundWriter::shutdown();
+	
+	if(g_holds_threads)
+	{
+		MoxGlobalThreads::release();
+		
+		g_holds_threads = false;
+	}
 	
 	return malNoError;
 }
@@ -574,6 +597,13 @@ exSDKExport(
 	paramSuite->GetParamValue(exID, gIdx, MOXVideoCodec, &videoCodecP);
 	paramSuite->GetParamValue(exID, gIdx, MOXAudioBitDepth, &audioBitDepthP);
 	
+	// presets from before there was a proxy option won't have it
+	exParamValues writeProxyP;
+	writeProxyP.value.intValue = kPrFalse;
+	
+	if(paramSuite->GetParamValue(exID, gIdx, MOXWriteProxy, &writeProxyP) != malNoError)
+		writeProxyP.value.intValue = kPrFalse;
+	
 	const MOX_VideoBitDepth videoBitDepth = (MOX_VideoBitDepth)videoBitDepthP.value.intValue;
 	const MOX_AudioBitDepth audioBitDepth = (MOX_AudioBitDepth)audioBitDepthP.value.intValue;
 				
@@ -631,15 +661,35 @@ exSDKExport(
 	}
 
 	
+	MoxFrameInfo frame_info;
+	
+	MoxProxyWriter *proxy = NULL;
+	
+	// Premiere's audio comes in here, then gets interleaved for the queue
+	float *pr_audio_buffer[6] = {NULL, NULL, NULL, NULL, NULL, NULL};
+	float *interleaved_audio = NULL;
+	size_t audio_buffer_bytes = 0;
+	
+	std::string moviePath; // for the files that go next to the movie
+	
+	{
+		csSDK_int32 pathLen = 0;
+		
+		if(exportFileSuite->GetPlatformPath(exportInfoP->fileObject, &pathLen, NULL) == malNoError && pathLen > 0)
+		{
+			std::vector<prUTF16Char> path(pathLen + 1, 0);
+			
+			if(exportFileSuite->GetPlatformPath(exportInfoP->fileObject, &pathLen, &path[0]) == malNoError)
+				moviePath = MoxUTF8Path(reinterpret_cast<const MoxUTF16Char *>(&path[0]));
+		}
+	}
+	
 	if(result == malNoError)
 	{
 		try
 		{
 			using namespace MoxFiles;
 			
-			if( supportsThreads() )
-				setGlobalThreadCount(g_num_cpus);
-			
 		
 			//const Rational par(pixelAspectRatioP.value.ratioValue.numerator, pixelAspectRatioP.value.ratioValue.denominator);
 			const Rational frameRate = get_framerate(ticksPerSecond, frameRateP.value.timeValue);
@@ -698,7 +748,7 @@ exSDKExport(
 			csSDK_int32 maxBlip = 100;
 			mySettings->sequenceAudioSuite->GetMaxBlip(audioRenderID, frameRateP.value.timeValue, &maxBlip);
 			
-			float *pr_audio_buffer[6] = {NULL, NULL, NULL, NULL, NULL, NULL};
+			std::vector<std::string> audio_names;
 			
 			if(exportInfoP->exportAudio)
 			{
@@ -733,10 +783,34 @@ exSDKExport(
 					assert(false);
 				
 				
+				audio_buffer_bytes = maxBlip * sizeof(float);
+				
 				for(int i = 0; i < numAudioChannels; i++)
 				{
-					pr_audio_buffer[i] = (float *)malloc(maxBlip * sizeof(float));
+					pr_audio_buffer[i] = (float *)MoxBufferPool::allocate(audio_buffer_bytes);
+				}
+				
+				// in the same order as Premiere's buffers
+				if(numAudioChannels == 1)
+				{
+					audio_names.push_back("Mono");
+				}
+				else if(numAudioChannels == 2)
+				{
+					audio_names.push_back("Left");
+					audio_names.push_back("Right");
+				}
+				else if(numAudioChannels == 6)
+				{
+					audio_names.push_back("Left");
+					audio_names.push_back("Right");
+					audio_names.push_back("RearLeft");
+					audio_names.push_back("RearRight");
+					audio_names.push_back("Center");
+					audio_names.push_back("LFE");
 				}
+				
+				interleaved_audio = (float *)MoxBufferPool::allocate(audio_buffer_bytes * numAudioChannels);
 			}
 			
 			
@@ -744,6 +818,11 @@ exSDKExport(
 			
 			OutputFile outfile(outstream, head);
 			
+			if(exportInfoP->exportVideo && writeProxyP.value.intValue && !moviePath.empty())
+				proxy = new MoxProxyWriter(moviePath, head, alpha);
+			
+			MoxEncodeQueue queue(outfile, frame_info, proxy, alpha, MoxEncodeQueue::Settings());
+			
 			
 			//const PrAudioSample endAudioSample = (exportInfoP->endTime - exportInfoP->startTime) /
 			//										(ticksPerSecond / (PrAudioSample)sampleRateP.value.floatValue);
@@ -795,49 +874,20 @@ exSDKExport(
 						pixSuite->GetRowBytes(renderResult.outFrame, &rowbytes);
 						
 						
-						FrameBuffer frame(width, height);
-						
-						if(pixFormat == PrPixelFormat_BGRA_4444_8u)
-						{
-							char *origin = frameBufferP + ((height - 1) * rowbytes);
-							
-							frame.insert("B", Slice(MoxFiles::UINT8, origin + (0 * sizeof(unsigned char)), sizeof(unsigned char) * 4, -rowbytes, 1, 1, 0));
-							frame.insert("G", Slice(MoxFiles::UINT8, origin + (1 * sizeof(unsigned char)), sizeof(unsigned char) * 4, -rowbytes, 1, 1, 0));
-							frame.insert("R", Slice(MoxFiles::UINT8, origin + (2 * sizeof(unsigned char)), sizeof(unsigned char) * 4, -rowbytes, 1, 1, 0));
-							
-							if(alpha)
-								frame.insert("A", Slice(MoxFiles::UINT8, origin + (3 * sizeof(unsigned char)), sizeof(unsigned char) * 4, -rowbytes, 1, 1, 255));
-						}
-						else if(pixFormat == PrPixelFormat_BGRA_4444_16u)
-						{
-							char *origin = frameBufferP + ((height - 1) * rowbytes);
-							
-							frame.insert("B", Slice(MoxFiles::UINT16A, origin + (0 * sizeof(unsigned short)), sizeof(unsigned short) * 4, -rowbytes, 1, 1, 0));
-							frame.insert("G", Slice(MoxFiles::UINT16A, origin + (1 * sizeof(unsigned short)), sizeof(unsigned short) * 4, -rowbytes, 1, 1, 0));
-							frame.insert("R", Slice(MoxFiles::UINT16A, origin + (2 * sizeof(unsigned short)), sizeof(unsigned short) * 4, -rowbytes, 1, 1, 0));
-							
-							if(alpha)
-								frame.insert("A", Slice(MoxFiles::UINT16A, origin + (3 * sizeof(unsigned short)), sizeof(unsigned short) * 4, -rowbytes, 1, 1, 32768));
-						}
-						else if(pixFormat == PrPixelFormat_BGRA_4444_32f_Linear)
-						{
-							char *origin = frameBufferP + ((height - 1) * rowbytes);
-							
-							frame.insert("B", Slice(MoxFiles::FLOAT, origin + (0 * sizeof(float)), sizeof(float) * 4, -rowbytes, 1, 1, 0.0));
-							frame.insert("G", Slice(MoxFiles::FLOAT, origin + (1 * sizeof(float)), sizeof(float) * 4, -rowbytes, 1, 1, 0.0));
-							frame.insert("R", Slice(MoxFiles::FLOAT, origin + (2 * sizeof(float)), sizeof(float) * 4, -rowbytes, 1, 1, 0.0));
-							
-							if(alpha)
-								frame.insert("A", Slice(MoxFiles::FLOAT, origin + (3 * sizeof(float)), sizeof(float) * 4, -rowbytes, 1, 1, 1.0));
-						}
-						else
-							assert(false);
-
-						if(frame.size() == 0)
-							throw MoxMxf::LogicExc("Empty FrameBuffer");
+						const PixelType bufferType = (pixFormat == PrPixelFormat_BGRA_4444_8u ? MoxFiles::UINT8 :
+														pixFormat == PrPixelFormat_BGRA_4444_16u ? MoxFiles::UINT16A :
+														pixFormat == PrPixelFormat_BGRA_4444_32f_Linear ? MoxFiles::FLOAT :
+														MoxFiles::UINT8);
 						
+						assert(pixFormat == PrPixelFormat_BGRA_4444_8u ||
+								pixFormat == PrPixelFormat_BGRA_4444_16u ||
+								pixFormat == PrPixelFormat_BGRA_4444_32f_Linear);
+					
+						const int frameNum = (videoTime - exportInfoP->startTime) / frameRateP.value.timeValue;
 						
-						outfile.pushFrame(frame);
+						// Premiere is bottom-up, the queue copies it and gets back to rendering
+						queue.pushFrame(frameNum, 1, frameBufferP + ((height - 1) * rowbytes), -rowbytes,
+										width, height, bufferType, "BGRA");
 					
 						pixSuite->Dispose(renderResult.outFrame);
 					}
@@ -856,30 +906,21 @@ exSDKExport(
 						
 						if(result == suiteError_NoError)
 						{
-							AudioBuffer audioBuffer(get_samples);
-							
-							if(numAudioChannels == 1)
+							// the queue wants them interleaved
+							for(int c = 0; c < numAudioChannels; c++)
 							{
-								audioBuffer.insert("Mono", AudioSlice(MoxFiles::AFLOAT, (char *)pr_audio_buffer[0], sizeof(float)));
-							}
-							else if(numAudioChannels == 2)
-							{
-								audioBuffer.insert("Left", AudioSlice(MoxFiles::AFLOAT, (char *)pr_audio_buffer[0], sizeof(float)));
-								audioBuffer.insert("Right", AudioSlice(MoxFiles::AFLOAT, (char *)pr_audio_buffer[1], sizeof(float)));
-							}
-							else if(numAudioChannels == 6)
-							{
-								audioBuffer.insert("Left", AudioSlice(MoxFiles::AFLOAT, (char *)pr_audio_buffer[0], sizeof(float)));
-								audioBuffer.insert("Right", AudioSlice(MoxFiles::AFLOAT, (char *)pr_audio_buffer[1], sizeof(float)));
-								audioBuffer.insert("RearLeft", AudioSlice(MoxFiles::AFLOAT, (char *)pr_audio_buffer[2], sizeof(float)));
-								audioBuffer.insert("RearRight", AudioSlice(MoxFiles::AFLOAT, (char *)pr_audio_buffer[3], sizeof(float)));
-								audioBuffer.insert("Center", AudioSlice(MoxFiles::AFLOAT, (char *)pr_audio_buffer[4], sizeof(float)));
-								audioBuffer.insert("LFE", AudioSlice(MoxFiles::AFLOAT, (char *)pr_audio_buffer[5], sizeof(float)));
+								const float *in = pr_audio_buffer[c];
+								float *out = &interleaved_audio[c];
+								
+								for(PrAudioSample i = 0; i < get_samples; i++)
+								{
+									*out = *in++;
+									
+									out += numAudioChannels;
+								}
 							}
-							else
-								assert(false);
 							
-							outfile.pushAudio(audioBuffer);
+							queue.pushAudio(get_samples, MoxFiles::AFLOAT, (const char *)interleaved_audio, audio_names);
 							
 							samples_to_get -= get_samples;
 						}
@@ -900,14 +941,12 @@ exSDKExport(
 				}
 			}
 			
-			outfile.finalize();
+			queue.finish();
 			
+			outfile.finalize();
 			
-			for(int i = 0; i < 6; i++)
-			{
-				if(pr_audio_buffer[i] != NULL)
-					free(pr_audio_buffer[i]);
-			}
+			if(proxy != NULL && result == malNoError)
+				proxy->finish(frame_info);
 		}
 		catch(...)
 		{
@@ -915,6 +954,20 @@ exSDKExport(
 		}
 	}
 	
+	// an unfinished proxy file goes with it
+	delete proxy;
+	
+	for(int i = 0; i < 6; i++)
+		MoxBufferPool::release(pr_audio_buffer[i], audio_buffer_bytes);
+	
+	MoxBufferPool::release(interleaved_audio, audio_buffer_bytes * numAudioChannels);
+	
+	
+	if(result == malNoError && !frame_info.empty() && !moviePath.empty())
+	{
+		// PrIOStream has closed the movie by now
+		frame_info.write(moviePath);
+	}
 	
 	
 	if(exportInfoP->exportVideo)
@@ -426,6 +426,23 @@ exSDKGenerateDefaultParams(
 	codecParam.paramValues = codecValues;
 	
 	exportParamSuite->AddParam(exID, gIdx, ADBEVideoCodecGroup, &codecParam);
+	
+	
+	// Proxy
+	exParamValues proxyValues;
+	proxyValues.structVersion = 1;
+	proxyValues.value.intValue = kPrFalse;
+	proxyValues.disabled = kPrFalse;
+	proxyValues.hidden = kPrFalse;
+	
+	exNewParamInfo proxyParam;
+	proxyParam.structVersion = 1;
+	strncpy(proxyParam.identifier, MOXWriteProxy, 255);
+	proxyParam.paramType = exParamType_bool;
+	proxyParam.flags = exParamFlag_none;
+	proxyParam.paramValues = proxyValues;
+	
+	exportParamSuite->AddParam(exID, gIdx, ADBEVideoCodecGroup, &proxyParam);
 
 									
 	// Version
@@ -771,6 +788,11 @@ exSDKPostProcessParams(
 		exportParamSuite->AddConstrainedValuePair(exID, gIdx, MOXVideoCodec, &tempVideoCodec, paramString);
 	}
 	
+	
+	// Proxy
+	utf16ncpy(paramString, "Write quarter-size proxy", 255);
+	exportParamSuite->SetParamName(exID, gIdx, MOXWriteProxy, paramString);
+	
 
 	// Audio Settings group
 	utf16ncpy(paramString, "Audio Settings", 255);
@@ -85,6 +85,7 @@ typedef enum {
 #define MOXLossless			"MOXLossless"
 #define MOXQuality			"MOXQuality"
 #define MOXVideoCodec		"MOXVideoCodec"
+#define MOXWriteProxy		"MOXWriteProxy"
 #define MOXAudioBitDepth	"MOXAudioBitDepth"
 
 
@@ -39,6 +39,14 @@
 
 #include "MOX_Premiere_Import.h"
 
+#include "MOX_BoundStream.h"
+#include "MOX_AudioAhead.h"
+#include "MOX_IndexCache.h"
+#include "MOX_FrameInfo.h"
+#include "MOX_Platform.h"
+#include "MOX_Threads.h"
+#include "MOX_Proxy.h"
+
 #include <MoxFiles/InputFile.h>
 #include <MoxFiles/Thread.h>
 #include <MoxMxf/PlatformIOStream.h>
@@ -56,6 +64,8 @@
 
 int g_num_cpus = 1;
 
+static MoxIndexCache g_index_cache;
+
 
 
 #if IMPORTMOD_VERSION <= IMPORTMOD_VERSION_9
@@ -79,8 +89,12 @@ typedef struct
 	csSDK_int32				frameRateNum;
 	csSDK_int32				frameRateDen;
 	
-	PlatformIOStream		*stream;
+	MoxBoundStream			*stream; // file handle comes and goes, InputFile stays
+	MoxIndexStream			*index_stream;
 	MoxFiles::InputFile		*file;
+	MoxFrameInfo			*info;
+	MoxAudioAhead			*audio_ahead;
+	MoxProxyReader			*proxy; // quarter size, for low playback resolutions
 	
 	csSDK_uint8				bit_depth;
 	float					audioSampleRate;
@@ -162,6 +176,8 @@ SDKInit(
 	g_num_cpus = systemInfo.dwNumberOfProcessors;
 #endif
 
+	MoxGlobalThreads::acquire(g_num_cpus);
+
 	return malNoError;
 }
 
@@ -169,8 +185,9 @@ SDKInit(
 static prMALError
 SDKShutdown()
 {
-	if( MoxFiles::supportsThreads() )
-		MoxFiles::setGlobalThreadCount(0);
+	MoxAudioAhead::shutdown();
+
+	MoxGlobalThreads::release();
 	
 	return malNoError;
 }
@@ -220,6 +237,107 @@ SDKGetIndFormat(
 
 
 
+static imFileRef
+OpenFileRef(const prUTF16Char *path, bool read_write)
+{
+#ifdef PRWIN_ENV
+	const DWORD permissions = (read_write ? GENERIC_WRITE : GENERIC_READ);
+
+	HANDLE fileH = CreateFileW(path,
+								permissions,
+								FILE_SHARE_READ,
+								NULL,
+								OPEN_EXISTING,
+								FILE_ATTRIBUTE_NORMAL,
+								NULL);
+	
+	return fileH;
+#else
+	FSIORefNum refNum = CAST_REFNUM(imInvalidHandleValue);
+			
+	CFStringRef filePathCFSR = CFStringCreateWithCharacters(NULL, path, prUTF16CharLength(path));
+												
+	CFURLRef filePathURL = CFURLCreateWithFileSystemPath(NULL, filePathCFSR, kCFURLPOSIXPathStyle, false);
+	
+	if(filePathURL != NULL)
+	{
+		FSRef fileRef;
+		Boolean success = CFURLGetFSRef(filePathURL, &fileRef);
+		
+		if(success)
+		{
+			HFSUniStr255 dataForkName;
+			FSGetDataForkName(&dataForkName);
+		
+			const SInt8 permissions = (read_write ? fsRdWrPerm : fsRdPerm);
+		
+			OSErr err = FSOpenFork(	&fileRef,
+									dataForkName.length,
+									dataForkName.unicode,
+									permissions,
+									&refNum);
+									
+			if(err != noErr)
+				refNum = CAST_REFNUM(imInvalidHandleValue);
+		}
+									
+		CFRelease(filePathURL);
+	}
+								
+	CFRelease(filePathCFSR);
+	
+	return CAST_FILEREF(refNum);
+#endif
+}
+
+
+static void
+CloseFileRef(imFileRef fileRef)
+{
+#ifdef PRWIN_ENV
+	CloseHandle(fileRef);
+#else
+	FSCloseFork( CAST_REFNUM(fileRef) );
+#endif
+}
+
+
+// Our own read-only handle on the file, so audio can be read ahead
+// in the background without getting in the way of Premiere's.
+class PrFileStream : public MoxBoundStream
+{
+  public:
+	PrFileStream(imFileRef fileRef) : MoxBoundStream(new PlatformIOStream(CAST_REFNUM(fileRef))), _fileRef(fileRef) {}
+	virtual ~PrFileStream() { unbind(); CloseFileRef(_fileRef); }
+	
+  private:
+	const imFileRef _fileRef;
+};
+
+class PrStreamSource : public MoxStreamSource
+{
+  public:
+	PrStreamSource(const prUTF16Char *path)
+	{
+		do{ _path.push_back(*path); }while(*path++ != 0);
+	}
+	virtual ~PrStreamSource() {}
+	
+	virtual MoxMxf::IOStream * openStream() const
+	{
+		const imFileRef fileRef = OpenFileRef(&_path[0], false);
+		
+		if(fileRef == imInvalidHandleValue)
+			throw MoxMxf::IoExc("Could not open file");
+		
+		return new PrFileStream(fileRef);
+	}
+	
+  private:
+	std::vector<prUTF16Char> _path;
+};
+
+
 prMALError 
 SDKOpenFile8(
 	imStdParms		*stdParms, 
@@ -249,7 +367,11 @@ SDKOpenFile8(
 		localRecP = reinterpret_cast<ImporterLocalRec8Ptr>( *localRecH );
 		
 		localRecP->stream = NULL;
+		localRecP->index_stream = NULL;
 		localRecP->file = NULL;
+		localRecP->info = NULL;
+		localRecP->audio_ahead = NULL;
+		localRecP->proxy = NULL;
 		
 		
 		// Acquire needed suites
@@ -275,80 +397,64 @@ SDKOpenFile8(
 
 	if(localRecP)
 	{
-		const prUTF16Char *path = SDKfileOpenRec8->fileinfo.filepath;
-	
-	#ifdef PRWIN_ENV
-		const DWORD permissions = (SDKfileOpenRec8->inReadWrite == kPrOpenFileAccess_ReadWrite ? GENERIC_WRITE : GENERIC_READ);
+		const bool read_write = (SDKfileOpenRec8->inReadWrite == kPrOpenFileAccess_ReadWrite);
 	
-		HANDLE fileH = CreateFileW(path,
-									permissions,
-									FILE_SHARE_READ,
-									NULL,
-									OPEN_EXISTING,
-									FILE_ATTRIBUTE_NORMAL,
-									NULL);
-									
-		if(fileH != imInvalidHandleValue)
+		const imFileRef fileRef = OpenFileRef(SDKfileOpenRec8->fileinfo.filepath, read_write);
+		
+		if(fileRef != imInvalidHandleValue)
 		{
-			SDKfileOpenRec8->fileinfo.fileref = *SDKfileRef = fileH;
+			SDKfileOpenRec8->fileinfo.fileref = *SDKfileRef = fileRef;
 		}
 		else
 			result = imFileOpenFailed;
-	#else
-		FSIORefNum refNum = CAST_REFNUM(imInvalidHandleValue);
-				
-		CFStringRef filePathCFSR = CFStringCreateWithCharacters(NULL, path, prUTF16CharLength(path));
-													
-		CFURLRef filePathURL = CFURLCreateWithFileSystemPath(NULL, filePathCFSR, kCFURLPOSIXPathStyle, false);
-		
-		if(filePathURL != NULL)
-		{
-			FSRef fileRef;
-			Boolean success = CFURLGetFSRef(filePathURL, &fileRef);
-			
-			if(success)
-			{
-				HFSUniStr255 dataForkName;
-				FSGetDataForkName(&dataForkName);
-			
-				const SInt8 permissions = (SDKfileOpenRec8->inReadWrite == kPrOpenFileAccess_ReadWrite ? fsRdWrPerm : fsRdPerm);
-			
-				OSErr err = FSOpenFork(	&fileRef,
-										dataForkName.length,
-										dataForkName.unicode,
-										permissions,
-										&refNum);
-										
-				if(err != noErr)
-					result = imFileOpenFailed;
-			}
-										
-			CFRelease(filePathURL);
-		}
-									
-		CFRelease(filePathCFSR);
+	}
 
-		if(CAST_FILEREF(refNum) != imInvalidHandleValue)
+	if(result == malNoError && localRecP->file != NULL)
+	{
+		// we were quieted, so the header and index are still here
+		try
 		{
-			SDKfileOpenRec8->fileinfo.fileref = *SDKfileRef = CAST_FILEREF(refNum);
+			localRecP->stream->bind(new PlatformIOStream(CAST_REFNUM(*SDKfileRef)));
 		}
-		else
-			result = imFileOpenFailed;
-	#endif
+		catch(MoxMxf::IoExc &e)
+		{	result = imFileOpenFailed;	}
+		catch(...)
+		{	result = imOtherErr;	}
 	}
-
-	if(result == malNoError && localRecP->file == NULL)
+	else if(result == malNoError && localRecP->file == NULL)
 	{
 		assert(localRecP->stream == NULL);
 		
 		try
 		{
-			if( supportsThreads() )
-				setGlobalThreadCount(g_num_cpus);
-		
-			localRecP->stream = new PlatformIOStream(CAST_REFNUM(*SDKfileRef));
+			localRecP->stream = new MoxBoundStream(new PlatformIOStream(CAST_REFNUM(*SDKfileRef)));
+			
+			// header and index come from the cache when we have them
+			const prUTF16Char *path = SDKfileOpenRec8->fileinfo.filepath;
+			
+			localRecP->index_stream = g_index_cache.open(reinterpret_cast<const MoxUTF16Char *>(path), *localRecP->stream);
+			
+			localRecP->file = new MoxFiles::InputFile(*localRecP->index_stream);
+			
+			g_index_cache.store(*localRecP->index_stream);
 			
-			localRecP->file = new MoxFiles::InputFile(*localRecP->stream);
+			// which frames are repeats, if we exported this file
+			localRecP->info = new MoxFrameInfo;
+			
+			localRecP->info->read( MoxUTF8Path(reinterpret_cast<const MoxUTF16Char *>(path)) );
+			
+			// and the proxy we wrote with it
+			localRecP->proxy = MoxProxyReader::open(MoxUTF8Path(reinterpret_cast<const MoxUTF16Char *>(path)), *localRecP->info);
+			
+			// reads audio ahead during playback, with its own handle
+			if(localRecP->file->header().audioChannels().size() > 0)
+			{
+				localRecP->audio_ahead = new MoxAudioAhead(new MoxIndexedStreamSource(g_index_cache,
+																		reinterpret_cast<const MoxUTF16Char *>(path),
+																		new PrStreamSource(path)),
+															MoxAudioAhead::audioLength(localRecP->file->header()),
+															MoxAudioAhead::Settings());
+			}
 			
 			assert(SDKfileOpenRec8->inReadWrite == kPrOpenFileAccess_ReadOnly);
 		}
@@ -365,6 +471,13 @@ SDKOpenFile8(
 	{
 		if(SDKfileOpenRec8->privatedata)
 		{
+			delete localRecP->audio_ahead;
+			delete localRecP->proxy;
+			delete localRecP->info;
+			delete localRecP->file;
+			delete localRecP->index_stream;
+			delete localRecP->stream;
+			
 			stdParms->piSuites->memFuncs->disposeHandle(reinterpret_cast<PrMemoryHandle>(SDKfileOpenRec8->privatedata));
 			SDKfileOpenRec8->privatedata = NULL;
 		}
@@ -388,6 +501,8 @@ SDKQuietFile(
 	// "Quiet File" really means close the file handle, but we're still
 	// using it and might open it again, so hold on to any stored data
 	// structures you don't want to re-create.
+	// That includes the InputFile, which keeps everything it parsed
+	// out of the header.  Only the handle under it goes away.
 
 	// If file has not yet been closed
 	if(SDKfileRef && *SDKfileRef != imInvalidHandleValue)
@@ -398,27 +513,19 @@ SDKQuietFile(
 
 		ImporterLocalRec8Ptr localRecP = reinterpret_cast<ImporterLocalRec8Ptr>( *ldataH );
 		
-		if(localRecP->file != NULL)
-		{
-			delete localRecP->file;
-			
-			localRecP->file = NULL;
-		}
-		
 		if(localRecP->stream != NULL)
-		{
-			delete localRecP->stream;
-			
-			localRecP->stream = NULL;
-		}
+			localRecP->stream->unbind();
+		
+		// our own handle goes too
+		if(localRecP->audio_ahead != NULL)
+			localRecP->audio_ahead->release(true);
+		
+		if(localRecP->proxy != NULL)
+			localRecP->proxy->release();
 
 		stdParms->piSuites->memFuncs->unlockHandle(reinterpret_cast<char**>(ldataH));
 
-	#ifdef PRWIN_ENV
-		CloseHandle(*SDKfileRef);
-	#else
-		FSCloseFork( CAST_REFNUM(*SDKfileRef) );
-	#endif
+		CloseFileRef(*SDKfileRef);
 	
 		*SDKfileRef = imInvalidHandleValue;
 	}
@@ -448,6 +555,48 @@ SDKCloseFile(
 		stdParms->piSuites->memFuncs->lockHandle(reinterpret_cast<char**>(ldataH));
 
 		ImporterLocalRec8Ptr localRecP = reinterpret_cast<ImporterLocalRec8Ptr>( *ldataH );
+		
+		if(localRecP->audio_ahead != NULL)
+		{
+			delete localRecP->audio_ahead;
+			
+			localRecP->audio_ahead = NULL;
+		}
+		
+		if(localRecP->proxy != NULL)
+		{
+			delete localRecP->proxy;
+			
+			localRecP->proxy = NULL;
+		}
+		
+		if(localRecP->info != NULL)
+		{
+			delete localRecP->info;
+			
+			localRecP->info = NULL;
+		}
+		
+		if(localRecP->file != NULL)
+		{
+			delete localRecP->file;
+			
+			localRecP->file = NULL;
+		}
+		
+		if(localRecP->index_stream != NULL)
+		{
+			delete localRecP->index_stream;
+			
+			localRecP->index_stream = NULL;
+		}
+		
+		if(localRecP->stream != NULL)
+		{
+			delete localRecP->stream;
+			
+			localRecP->stream = NULL;
+		}
 
 		localRecP->BasicSuite->ReleaseSuite(kPrSDKPPixCreatorSuite, kPrSDKPPixCreatorSuiteVersion);
 		localRecP->BasicSuite->ReleaseSuite(kPrSDKPPixCacheSuite, PrCacheVersion);
@@ -731,6 +880,14 @@ SDKPreferredFrameSize(
 		preferredFrameSizeRec->outWidth = localRecP->width;
 		preferredFrameSizeRec->outHeight = localRecP->height;
 	}
+	else if(preferredFrameSizeRec->inIndex == 1 && localRecP->proxy != NULL)
+	{
+		// the proxy is the one smaller size we can make quickly
+		preferredFrameSizeRec->outWidth = localRecP->proxy->width();
+		preferredFrameSizeRec->outHeight = localRecP->proxy->height();
+		
+		result = malNoError;
+	}
 	else
 	{
 		// we store width and height in private data so we can produce it here
@@ -784,6 +941,10 @@ SDKGetSourceVideo(
 		PrTime ticksPerFrame = (ticksPerSecond * (PrTime)localRecP->frameRateDen) / (PrTime)localRecP->frameRateNum;
 		theFrame = sourceVideoRec->inFrameTime / ticksPerFrame;
 	}
+	
+	// Held frames are all decoded and cached as the first frame that looks like them
+	if(localRecP->info != NULL)
+		theFrame = localRecP->info->sourceFrame(theFrame);
 
 	// Check to see if frame is already in cache
 	result = localRecP->PPixCacheSuite->GetFrameFromCache(	localRecP->importerID,
@@ -837,6 +998,22 @@ SDKGetSourceVideo(
 			char *origin = frameBufferP + (rowbytes * (frameFormat->inFrameHeight - 1));
 			
 			
+			// Premiere asks for the proxy size at low playback resolutions
+			bool fromProxy = false;
+			
+			if(localRecP->proxy != NULL &&
+				(frameFormat->inFrameWidth != localRecP->width || frameFormat->inFrameHeight != localRecP->height))
+			{
+				const PixelType pixelType = (pix_fmt == PrPixelFormat_BGRA_4444_16u ? MoxFiles::UINT16A :
+												pix_fmt == PrPixelFormat_BGRA_4444_32f_Linear ? MoxFiles::FLOAT :
+												MoxFiles::UINT8);
+			
+				fromProxy = localRecP->proxy->draw(theFrame, origin, -rowbytes,
+													frameFormat->inFrameWidth, frameFormat->inFrameHeight,
+													pixelType, "BGRA");
+			}
+			
+			
 			FrameBuffer frameBuffer(frameFormat->inFrameWidth, frameFormat->inFrameHeight);
 			
 			if(pix_fmt == PrPixelFormat_BGRA_4444_8u)
@@ -864,7 +1041,8 @@ SDKGetSourceVideo(
 				assert(false);
 			
 			
-			infile->getFrame(theFrame, frameBuffer);
+			if(!fromProxy)
+				infile->getFrame(theFrame, frameBuffer);
 
 
 			localRecP->PPixCacheSuite->AddFrameToCache(	localRecP->importerID,
@@ -915,7 +1093,7 @@ SDKImportAudio7(
 		const AudioChannelList &chans = infile->header().audioChannels();
 		
 		
-		AudioBuffer buffer(audioRec7->size);
+		MoxAudioAhead::ChannelList channels;
 		
 		const ptrdiff_t stride = sizeof(float);
 		
@@ -923,39 +1101,50 @@ SDKImportAudio7(
 		{
 			assert(localRecP->numChannels == 1);
 		
-			buffer.insert("Mono", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[0], stride));
+			channels.push_back( MoxAudioAhead::Channel("Mono", (char *)audioRec7->buffer[0], stride) );
 		}
-		if(chans.size() == 2)
+		else if(chans.size() == 2)
 		{
 			assert(localRecP->numChannels == 2);
 		
-			buffer.insert("Left", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[0], stride));
-			buffer.insert("Right", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[1], stride));
+			channels.push_back( MoxAudioAhead::Channel("Left", (char *)audioRec7->buffer[0], stride) );
+			channels.push_back( MoxAudioAhead::Channel("Right", (char *)audioRec7->buffer[1], stride) );
 		}
-		if(chans.size() == 6)
+		else if(chans.size() == 6)
 		{
 			assert(localRecP->numChannels == 6);
 		
-			buffer.insert("Left", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[0], stride));
-			buffer.insert("Right", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[1], stride));
-			buffer.insert("RearLeft", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[2], stride));
-			buffer.insert("RearRight", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[3], stride));
-			buffer.insert("Center", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[4], stride));
-			buffer.insert("LFE", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[5], stride));
+			channels.push_back( MoxAudioAhead::Channel("Left", (char *)audioRec7->buffer[0], stride) );
+			channels.push_back( MoxAudioAhead::Channel("Right", (char *)audioRec7->buffer[1], stride) );
+			channels.push_back( MoxAudioAhead::Channel("RearLeft", (char *)audioRec7->buffer[2], stride) );
+			channels.push_back( MoxAudioAhead::Channel("RearRight", (char *)audioRec7->buffer[3], stride) );
+			channels.push_back( MoxAudioAhead::Channel("Center", (char *)audioRec7->buffer[4], stride) );
+			channels.push_back( MoxAudioAhead::Channel("LFE", (char *)audioRec7->buffer[5], stride) );
 		}
 		else
 		{
 			// what we go to when there's some large number of channels
 			assert(localRecP->numChannels == 2);
 		
-			buffer.insert("Channel1", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[0], stride));
-			buffer.insert("Channel2", AudioSlice(MoxFiles::AFLOAT, (char *)audioRec7->buffer[1], stride));
+			channels.push_back( MoxAudioAhead::Channel("Channel1", (char *)audioRec7->buffer[0], stride) );
+			channels.push_back( MoxAudioAhead::Channel("Channel2", (char *)audioRec7->buffer[1], stride) );
 		}
 				
 		
-		infile->seekAudio(audioRec7->position);
+		// during playback this is usually already read
+		MoxAudioAhead *audio_ahead = localRecP->audio_ahead;
 		
-		infile->readAudio(audioRec7->size, buffer);
+		if(audio_ahead == NULL || !audio_ahead->read(audioRec7->position, audioRec7->size, MoxFiles::AFLOAT, channels))
+		{
+			AudioBuffer buffer(audioRec7->size);
+			
+			for(MoxAudioAhead::ChannelList::const_iterator i = channels.begin(); i != channels.end(); ++i)
+				buffer.insert(i->name, AudioSlice(MoxFiles::AFLOAT, i->base, i->stride));
+			
+			infile->seekAudio(audioRec7->position);
+			
+			infile->readAudio(audioRec7->size, buffer);
+		}
 	}
 	catch(...)
 	{
@@ -971,6 +1160,47 @@ SDKImportAudio7(
 }
 
 
+static prMALError 
+SDKGetPeakAudio(
+	imStdParms			*stdParms, 
+	imFileRef			SDKfileRef, 
+	imPeakAudioRec		*peakAudioRec)
+{
+	// Our exporter saves peaks so the waveform doesn't need all the audio.
+	// Without them, Premiere will figure them out itself.
+	prMALError		result		= malNoError;
+
+	ImporterLocalRec8H ldataH = reinterpret_cast<ImporterLocalRec8H>(peakAudioRec->privateData);
+	stdParms->piSuites->memFuncs->lockHandle(reinterpret_cast<char**>(ldataH));
+	ImporterLocalRec8Ptr localRecP = reinterpret_cast<ImporterLocalRec8Ptr>( *ldataH );
+	
+	if(localRecP->info != NULL && !localRecP->info->peaks().empty() &&
+		localRecP->info->peaks().channels() >= localRecP->numChannels &&
+		peakAudioRec->position >= 0 && peakAudioRec->samplesPerPeak > 0)
+	{
+		const MoxAudioPeaks &peaks = localRecP->info->peaks();
+		
+		// they might want the peaks at some other sample rate
+		const double rate_scale = (peakAudioRec->sampleRate > 0 ? localRecP->audioSampleRate / peakAudioRec->sampleRate : 1.0);
+		
+		const MoxMxf::UInt64 position = (MoxMxf::UInt64)((double)peakAudioRec->position * rate_scale + 0.5);
+		const MoxMxf::UInt64 samples_per_peak = (MoxMxf::UInt64)((double)peakAudioRec->samplesPerPeak * rate_scale + 0.5);
+		
+		for(int c = 0; c < localRecP->numChannels; c++)
+		{
+			peaks.get(c, position, (samples_per_peak > 0 ? samples_per_peak : 1), peakAudioRec->numSampleFrames,
+						peakAudioRec->maxima[c], peakAudioRec->minima[c]);
+		}
+	}
+	else
+		result = imUnsupported;
+	
+	stdParms->piSuites->memFuncs->unlockHandle(reinterpret_cast<char**>(ldataH));
+	
+	return result;
+}
+
+
 PREMPLUGENTRY DllExport xImportEntry (
 	csSDK_int32		selector, 
 	imStdParms		*stdParms, 
@@ -1055,6 +1285,12 @@ PREMPLUGENTRY DllExport xImportEntry (
 											reinterpret_cast<imFileRef>(param1),
 											reinterpret_cast<imImportAudioRec7*>(param2));
 			break;
+			
+		case imGetPeakAudio:
+			result =	SDKGetPeakAudio(	stdParms,
+											reinterpret_cast<imFileRef>(param1),
+											reinterpret_cast<imPeakAudioRec*>(param2));
+			break;
 
 		case imCreateAsyncImporter:
 			result =	imUnsupported;